@@ -2,9 +2,11 @@
 #include "board.h"
 #include "display.h"
 #include "system_info.h"
+#include "task_topology.h"
 #include "audio_codec.h"
 #include "mqtt_protocol.h"
 #include "websocket_protocol.h"
+#include "udp_protocol.h"
 #include "assets/lang_config.h"
 #include "mcp_server.h"
 #include "assets.h"
@@ -110,8 +112,19 @@ void Application::Initialize() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_WAKE_WORD_DETECTED);
     };
     callbacks.on_vad_change = [this](bool speaking) {
+        // Only the end of speech while listening ends a turn, the VAD also runs while speaking with AEC
+        if (!speaking && GetDeviceState() == kDeviceStateListening) {
+            audio_service_.GetLatencyTracer().MarkSpeechEnd();
+        }
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+    callbacks.on_encoder_frame_duration_changed = [this](int frame_duration) {
+        Schedule([this, frame_duration]() {
+            if (protocol_ && protocol_->IsAudioChannelOpened()) {
+                protocol_->SendAudioParams(frame_duration);
+            }
+        });
+    };
     audio_service_.SetCallbacks(callbacks);
 
     // Add state change listeners
@@ -215,8 +228,9 @@ void Application::Run() {
         MAIN_EVENT_ACTIVATION_DONE |
         MAIN_EVENT_STATE_CHANGED;
 
+    TickType_t send_audio_wait = portMAX_DELAY;
     while (true) {
-        auto bits = xEventGroupWaitBits(event_group_, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
+        auto bits = xEventGroupWaitBits(event_group_, ALL_EVENTS, pdTRUE, pdFALSE, send_audio_wait);
 
         if (bits & MAIN_EVENT_ERROR) {
             SetDeviceState(kDeviceStateIdle);
@@ -251,12 +265,8 @@ void Application::Run() {
             HandleStopListeningEvent();
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-            }
+        if ((bits & MAIN_EVENT_SEND_AUDIO) || send_audio_wait != portMAX_DELAY) {
+            send_audio_wait = SendQueuedAudio();
         }
 
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
@@ -288,6 +298,11 @@ void Application::Run() {
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
             }
+#if CONFIG_TASK_STACK_REPORT_INTERVAL > 0
+            if (clock_ticks_ % CONFIG_TASK_STACK_REPORT_INTERVAL == 0) {
+                TaskTopology::GetInstance().PrintReport();
+            }
+#endif
 
             // Speaking timeout safety - if stuck in Speaking for >60s, force recovery
             // This handles cases where server doesn't send tts/stop (network issue, server bug)
@@ -315,12 +330,12 @@ void Application::HandleNetworkConnectedEvent() {
             return;
         }
 
-        xTaskCreate([](void* arg) {
+        TaskTopology::GetInstance().Create(kTaskActivation, [](void* arg) {
             Application* app = static_cast<Application*>(arg);
             app->ActivationTask();
             app->activation_task_handle_ = nullptr;
             vTaskDelete(NULL);
-        }, "activation", 4096 * 2, this, 2, &activation_task_handle_);
+        }, this, &activation_task_handle_);
     }
 
     // Update the status bar immediately to show the network state
@@ -520,7 +535,9 @@ void Application::InitializeProtocol() {
 
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
-    if (ota_->HasMqttConfig()) {
+    if (ota_->HasUdpConfig()) {
+        protocol_ = std::make_unique<UdpProtocol>();
+    } else if (ota_->HasMqttConfig()) {
         protocol_ = std::make_unique<MqttProtocol>();
     } else if (ota_->HasWebsocketConfig()) {
         protocol_ = std::make_unique<WebsocketProtocol>();
@@ -545,12 +562,20 @@ void Application::InitializeProtocol() {
             if (board.IsMusicPlaying()) {
                 return;  // Drop TTS audio
             }
+            audio_service_.GetLatencyTracer().OnResponsePacket();
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
     
+    protocol_->OnLinkReport([this](int rtt_ms, int loss_percent) {
+        audio_service_.UpdateLinkQuality(rtt_ms, loss_percent);
+    });
+
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
+        audio_service_.ResetEncoderProfile(protocol_->link_rtt_ms());
+        auto board_type = board.GetBoardType();
+        hold_audio_for_batch_ = board_type == "ml307" || board_type == "nt26";
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -847,12 +872,58 @@ void Application::HandleStopListeningEvent() {
         return;
     } else if (state == kDeviceStateListening) {
         if (protocol_) {
+            // The end of the speech may still be held for a batch, it must reach the server before the stop
+            SendQueuedAudio(true);
             protocol_->SendStopListening();
+            audio_service_.GetLatencyTracer().MarkSpeechEnd();
         }
         SetDeviceState(kDeviceStateIdle);
     }
 }
 
+/*
+ * Sends the queued Opus frames, coalescing up to audio_batch_frames() per message. When holding
+ * for full batches, returns how long the caller may wait before the held frames must be flushed.
+ * flush sends everything queued without holding, before a listen stop.
+ */
+TickType_t Application::SendQueuedAudio(bool flush) {
+    size_t batch_frames = protocol_ ? protocol_->audio_batch_frames() : 1;
+    std::vector<std::unique_ptr<AudioStreamPacket>> packets;
+    while (true) {
+        size_t queued = audio_service_.GetSendQueueSize();
+        if (queued == 0) {
+            audio_hold_start_us_ = 0;
+            return portMAX_DELAY;
+        }
+        if (hold_audio_for_batch_ && !flush && queued < batch_frames) {
+            int64_t now = esp_timer_get_time();
+            if (audio_hold_start_us_ == 0) {
+                audio_hold_start_us_ = now;
+            }
+            /* The adaptive encoder may run shorter or longer frames than OPUS_FRAME_DURATION_MS */
+            int64_t remaining_ms = batch_frames * audio_service_.GetEncoderFrameDuration() - (now - audio_hold_start_us_) / 1000;
+            if (remaining_ms > portTICK_PERIOD_MS) {
+                return pdMS_TO_TICKS(remaining_ms);
+            }
+        }
+        audio_hold_start_us_ = 0;
+
+        packets.clear();
+        while (packets.size() < batch_frames) {
+            auto packet = audio_service_.PopPacketFromSendQueue();
+            if (!packet) {
+                break;
+            }
+            packets.push_back(std::move(packet));
+        }
+        uint32_t send_start = AudioLatencyTracer::Now();
+        if (protocol_ && !protocol_->SendAudioBatch(packets)) {
+            return portMAX_DELAY;
+        }
+        audio_service_.GetLatencyTracer().Record(kLatencyStageSend, send_start);
+    }
+}
+
 void Application::HandleWakeWordDetectedEvent() {
     if (!protocol_) {
         return;
@@ -861,6 +932,10 @@ void Application::HandleWakeWordDetectedEvent() {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
+        // Connect in the background while the wake word audio is encoded
+        if (!protocol_->IsAudioChannelOpened()) {
+            protocol_->PreConnect();
+        }
         audio_service_.EncodeWakeWord();
         auto wake_word = audio_service_.GetLastWakeWord();
 
@@ -1241,7 +1316,9 @@ bool Application::SendChatText(const std::string& text) {
         protocol_->SendWakeWordDetected(text_to_send);
         
         // Tell server we stopped listening (text input complete, process now)
+        SendQueuedAudio(true);
         protocol_->SendStopListening();
+        audio_service_.GetLatencyTracer().MarkSpeechEnd();
         
         ESP_LOGI(TAG, "📨 [MainThread] Text sent to server, waiting for AI response via TTS");
     });
@@ -159,6 +159,8 @@ private:
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
     int clock_ticks_ = 0;
     int abort_count_ = 0;  // Count consecutive abort attempts in Speaking state
+    bool hold_audio_for_batch_ = false;  // Wait for a full batch before sending (cellular)
+    int64_t audio_hold_start_us_ = 0;
     TaskHandle_t activation_task_handle_ = nullptr;
 
 
@@ -173,6 +175,7 @@ private:
     void HandleWakeWordDetectedEvent();
     void ContinueOpenAudioChannel(ListeningMode mode);
     void ContinueWakeWordInvoke(const std::string& wake_word);
+    TickType_t SendQueuedAudio(bool flush = false);
 
     // Activation task (runs in background)
     void ActivationTask();
@@ -0,0 +1,228 @@
+#include "audio_benchmark.h"
+#include "audio_service.h"
+#include "audio_frame_pool.h"
+#include "task_topology.h"
+
+#include <cmath>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#define TAG "AudioBenchmark"
+
+#define BENCHMARK_SAMPLE_RATE 16000
+
+void AudioBenchmark::StageResult::Add(uint32_t us) {
+    frames++;
+    total_us += us;
+    if (us > max_us) {
+        max_us = us;
+    }
+}
+
+AudioBenchmark::AudioBenchmark(int frame_duration_ms, int output_sample_rate)
+    : frame_duration_ms_(frame_duration_ms), output_sample_rate_(output_sample_rate) {
+}
+
+static size_t PoolFallbacks() {
+    auto& pool = AudioFramePool::GetInstance();
+    size_t fallbacks = 0;
+    for (int i = 0; i < AudioFramePool::kBlockClassCount; i++) {
+        fallbacks += pool.GetStats((AudioFramePool::BlockClass)i).fallbacks;
+    }
+    return fallbacks;
+}
+
+/* A 200Hz-3.4kHz sweep with some noise keeps the encoder out of DTX and exercises every band */
+static void GenerateSignal(AudioPcm& pcm, uint32_t& phase_step, float& phase, uint32_t& seed) {
+    for (auto& sample : pcm) {
+        float freq = 200.0f + (phase_step++ % (BENCHMARK_SAMPLE_RATE * 2)) * (3200.0f / (BENCHMARK_SAMPLE_RATE * 2));
+        phase += 2.0f * (float)M_PI * freq / BENCHMARK_SAMPLE_RATE;
+        if (phase > 2.0f * (float)M_PI) {
+            phase -= 2.0f * (float)M_PI;
+        }
+        seed = seed * 1664525 + 1013904223;
+        int noise = (int)(seed >> 20) - 2048;
+        sample = (int16_t)(sinf(phase) * 8000.0f) + noise;
+    }
+}
+
+bool AudioBenchmark::Run(int seconds) {
+    struct TaskArgs {
+        AudioBenchmark* benchmark;
+        int seconds;
+        bool ok;
+        SemaphoreHandle_t done;
+    };
+    TaskArgs args = {this, seconds, false, xSemaphoreCreateBinary()};
+    if (args.done == nullptr) {
+        return false;
+    }
+
+    // The task is deleted when the run ends, so its stack stays in internal RAM
+    auto& task = TaskTopology::GetInstance().Get(kTaskOpusEncode);
+    BaseType_t created = xTaskCreatePinnedToCore([](void* arg) {
+        auto args = (TaskArgs*)arg;
+        args->ok = args->benchmark->RunStages(args->seconds);
+        xSemaphoreGive(args->done);
+        vTaskDelete(NULL);
+    }, "audio_bench", task.stack_size, &args, task.priority, nullptr, task.core);
+    if (created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create benchmark task with %lu bytes of stack", (unsigned long)task.stack_size);
+        vSemaphoreDelete(args.done);
+        return false;
+    }
+    xSemaphoreTake(args.done, portMAX_DELAY);
+    vSemaphoreDelete(args.done);
+    return args.ok;
+}
+
+bool AudioBenchmark::RunStages(int seconds) {
+    encode_ = StageResult();
+    decode_ = StageResult();
+    resample_ = StageResult();
+    audio_ms_ = 0;
+    encoded_bytes_ = 0;
+
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    esp_opus_enc_config_t enc_cfg = AS_OPUS_ENC_CONFIG();
+    enc_cfg.frame_duration = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(frame_duration_ms_);
+    void* encoder = nullptr;
+    esp_opus_enc_open(&enc_cfg, sizeof(esp_opus_enc_config_t), &encoder);
+    esp_opus_dec_cfg_t dec_cfg = OPUS_DEC_CFG(BENCHMARK_SAMPLE_RATE, frame_duration_ms_);
+    void* decoder = nullptr;
+    esp_opus_dec_open(&dec_cfg, sizeof(esp_opus_dec_cfg_t), &decoder);
+    esp_ae_rate_cvt_handle_t resampler = nullptr;
+    if (output_sample_rate_ != BENCHMARK_SAMPLE_RATE) {
+        esp_ae_rate_cvt_cfg_t resampler_cfg = RATE_CVT_CFG(BENCHMARK_SAMPLE_RATE, output_sample_rate_, ESP_AUDIO_MONO);
+        esp_ae_rate_cvt_open(&resampler_cfg, &resampler);
+    }
+    codec_heap_bytes_ = (int)heap_before - (int)heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    bool ok = encoder != nullptr && decoder != nullptr && (resampler != nullptr || output_sample_rate_ == BENCHMARK_SAMPLE_RATE);
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to open codecs");
+    } else {
+        int frame_size = 0;
+        int outbuf_size = 0;
+        esp_opus_enc_get_frame_size(encoder, &frame_size, &outbuf_size);
+        AudioPcm pcm(frame_size / sizeof(int16_t));
+        AudioPcm decoded(pcm.size());
+        uint32_t phase_step = 0;
+        float phase = 0;
+        uint32_t seed = 1;
+
+        int frames = seconds * 1000 / frame_duration_ms_;
+        for (int i = 0; i < frames; i++) {
+            GenerateSignal(pcm, phase_step, phase, seed);
+
+            size_t fallbacks = PoolFallbacks();
+            uint32_t start = (uint32_t)esp_timer_get_time();
+            AudioPayload payload;
+            payload.resize(outbuf_size);
+            esp_audio_enc_in_frame_t in = {
+                .buffer = (uint8_t*)pcm.data(),
+                .len = (uint32_t)frame_size,
+            };
+            esp_audio_enc_out_frame_t out = {
+                .buffer = payload.data(),
+                .len = (uint32_t)outbuf_size,
+                .encoded_bytes = 0,
+            };
+            if (esp_opus_enc_process(encoder, &in, &out) != ESP_AUDIO_ERR_OK) {
+                ESP_LOGE(TAG, "Failed to encode frame %d", i);
+                ok = false;
+                break;
+            }
+            payload.resize(out.encoded_bytes);
+            encode_.Add((uint32_t)esp_timer_get_time() - start);
+            encode_.pool_fallbacks += PoolFallbacks() - fallbacks;
+            encoded_bytes_ += out.encoded_bytes;
+
+            fallbacks = PoolFallbacks();
+            start = (uint32_t)esp_timer_get_time();
+            esp_audio_dec_in_raw_t raw = {
+                .buffer = payload.data(),
+                .len = (uint32_t)payload.size(),
+                .consumed = 0,
+                .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
+            };
+            esp_audio_dec_out_frame_t out_frame = {
+                .buffer = (uint8_t*)decoded.data(),
+                .len = (uint32_t)(decoded.size() * sizeof(int16_t)),
+                .decoded_size = 0,
+            };
+            esp_audio_dec_info_t dec_info = {};
+            if (esp_opus_dec_decode(decoder, &raw, &out_frame, &dec_info) != ESP_AUDIO_ERR_OK) {
+                ESP_LOGE(TAG, "Failed to decode frame %d", i);
+                ok = false;
+                break;
+            }
+            decode_.Add((uint32_t)esp_timer_get_time() - start);
+            decode_.pool_fallbacks += PoolFallbacks() - fallbacks;
+
+            if (resampler != nullptr) {
+                fallbacks = PoolFallbacks();
+                start = (uint32_t)esp_timer_get_time();
+                uint32_t in_samples = out_frame.decoded_size / sizeof(int16_t);
+                uint32_t target_size = 0;
+                esp_ae_rate_cvt_get_max_out_sample_num(resampler, in_samples, &target_size);
+                AudioPcm resampled(target_size);
+                uint32_t actual_output = target_size;
+                esp_ae_rate_cvt_process(resampler, (esp_ae_sample_t)decoded.data(), in_samples,
+                                        (esp_ae_sample_t)resampled.data(), &actual_output);
+                resample_.Add((uint32_t)esp_timer_get_time() - start);
+                resample_.pool_fallbacks += PoolFallbacks() - fallbacks;
+            }
+            audio_ms_ += frame_duration_ms_;
+        }
+    }
+
+    if (resampler != nullptr) {
+        esp_ae_rate_cvt_close(resampler);
+    }
+    if (decoder != nullptr) {
+        esp_opus_dec_close(decoder);
+    }
+    if (encoder != nullptr) {
+        esp_opus_enc_close(encoder);
+    }
+    return ok;
+}
+
+static cJSON* StageToJson(const AudioBenchmark::StageResult& stage, int audio_ms) {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "frames", stage.frames);
+    if (stage.frames > 0 && stage.total_us > 0) {
+        cJSON_AddNumberToObject(json, "frames_per_second", stage.frames * 1000000.0 / stage.total_us);
+        cJSON_AddNumberToObject(json, "realtime_factor", audio_ms * 1000.0 / stage.total_us);
+        cJSON_AddNumberToObject(json, "avg_us", (double)(stage.total_us / stage.frames));
+    }
+    cJSON_AddNumberToObject(json, "max_us", stage.max_us);
+    cJSON_AddNumberToObject(json, "pool_fallbacks", stage.pool_fallbacks);
+    return json;
+}
+
+std::string AudioBenchmark::GetResultJson() const {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "audio_ms", audio_ms_);
+    cJSON_AddNumberToObject(root, "frame_duration", frame_duration_ms_);
+    cJSON_AddNumberToObject(root, "output_sample_rate", output_sample_rate_);
+    if (audio_ms_ > 0) {
+        cJSON_AddNumberToObject(root, "encoded_kbps", encoded_bytes_ * 8.0 / audio_ms_);
+    }
+    cJSON_AddNumberToObject(root, "codec_heap_bytes", codec_heap_bytes_);
+    cJSON_AddItemToObject(root, "encode", StageToJson(encode_, audio_ms_));
+    cJSON_AddItemToObject(root, "decode", StageToJson(decode_, audio_ms_));
+    cJSON_AddItemToObject(root, "resample", StageToJson(resample_, audio_ms_));
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,51 @@
+#ifndef AUDIO_BENCHMARK_H
+#define AUDIO_BENCHMARK_H
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Offline benchmark of the voice pipeline codecs.
+ *
+ * Pushes a generated test signal (a speech band sweep with noise) through Opus encode, Opus
+ * decode and output resampling with private encoder / decoder / resampler instances, so it can
+ * run next to the live AudioService. Every stage reports frames per second, per frame latency and
+ * the buffers that missed the audio frame pool, so codec or resampler regressions show up from a
+ * single MCP call instead of a listening test.
+ */
+class AudioBenchmark {
+public:
+    struct StageResult {
+        uint32_t frames = 0;
+        uint64_t total_us = 0;
+        uint32_t max_us = 0;
+        size_t pool_fallbacks = 0;  // Audio frame pool misses that went to the heap
+
+        void Add(uint32_t us);
+    };
+
+    AudioBenchmark(int frame_duration_ms, int output_sample_rate);
+
+    /*
+     * Runs all stages over `seconds` of audio and waits for them to finish. The stages run on a
+     * task with the stack, priority and core of the opus_encode task, so the numbers match the
+     * live encoder and the caller's stack is not used. Returns false if the task could not be
+     * created or a codec could not be opened.
+     */
+    bool Run(int seconds);
+    std::string GetResultJson() const;
+
+private:
+    bool RunStages(int seconds);
+
+    int frame_duration_ms_;
+    int output_sample_rate_;
+    int audio_ms_ = 0;
+    size_t encoded_bytes_ = 0;
+    int codec_heap_bytes_ = 0;  // Heap taken by the encoder, decoder and resampler state
+    StageResult encode_;
+    StageResult decode_;
+    StageResult resample_;
+};
+
+#endif // AUDIO_BENCHMARK_H
@@ -25,7 +25,9 @@ public:
     virtual void EnableOutput(bool enable);
 
     virtual void OutputData(std::vector<int16_t>& data);
+    void OutputData(const int16_t* data, size_t samples);
     virtual bool InputData(std::vector<int16_t>& data);
+    bool InputData(int16_t* data, size_t samples);
     virtual void Start();
 
     inline bool duplex() const { return duplex_; }
@@ -0,0 +1,100 @@
+#include "audio_encoder_controller.h"
+#include "audio_service.h"
+
+#include <algorithm>
+
+#include <esp_log.h>
+
+#define TAG "AudioEncoderController"
+
+#define ENCODER_DEFAULT_LEVEL 2
+/* Reported audio loss from which longer frames, and then FEC, are used */
+#define ENCODER_LOSSY_PERCENT 3
+#define ENCODER_FEC_LOSS_PERCENT 10
+
+static const OpusEncoderProfile kProfiles[] = {
+    { .frame_duration_ms = 20, .bitrate = ESP_OPUS_BITRATE_AUTO, .complexity = 0, .enable_fec = false },
+    { .frame_duration_ms = 40, .bitrate = ESP_OPUS_BITRATE_AUTO, .complexity = 0, .enable_fec = false },
+    { .frame_duration_ms = OPUS_FRAME_DURATION_MS, .bitrate = ESP_OPUS_BITRATE_AUTO, .complexity = 0, .enable_fec = false },
+    { .frame_duration_ms = OPUS_FRAME_DURATION_MS, .bitrate = 16000, .complexity = 0, .enable_fec = true },
+};
+static const int kMaxLevel = sizeof(kProfiles) / sizeof(kProfiles[0]) - 1;
+
+AudioEncoderController::AudioEncoderController() : level_(ENCODER_DEFAULT_LEVEL) {
+}
+
+void AudioEncoderController::Reset(int rtt_ms) {
+    rtt_ms_ = rtt_ms;
+    loss_percent_ = 0;
+    reset_requested_ = true;
+}
+
+void AudioEncoderController::UpdateLink(int rtt_ms, int loss_percent) {
+    rtt_ms_ = rtt_ms;
+    loss_percent_ = loss_percent;
+}
+
+int AudioEncoderController::LevelFloor() const {
+    int rtt_ms = rtt_ms_.load();
+    int loss_percent = loss_percent_.load();
+    /* In-band FEC only pays off once packets are actually lost */
+    if (rtt_ms > 300 || loss_percent >= ENCODER_FEC_LOSS_PERCENT) {
+        return 3;
+    } else if (rtt_ms > 150 || loss_percent >= ENCODER_LOSSY_PERCENT) {
+        return 2;
+    } else if (rtt_ms > 80) {
+        return 1;
+    }
+    return 0;
+}
+
+bool AudioEncoderController::Update(size_t send_queue_depth, size_t send_queue_capacity) {
+    int old_level = level_;
+    if (reset_requested_.exchange(false)) {
+        /* A new channel always starts with the frame duration announced in the hello message */
+        level_ = ENCODER_DEFAULT_LEVEL;
+        congested_frames_ = 0;
+        idle_ms_ = 0;
+    }
+
+#if CONFIG_USE_ADAPTIVE_OPUS_ENCODER
+    if (send_queue_depth * 2 >= send_queue_capacity) {
+        idle_ms_ = 0;
+        if (++congested_frames_ >= ENCODER_CONGESTION_FRAMES) {
+            congested_frames_ = 0;
+            level_ = std::min(level_ + 1, kMaxLevel);
+        }
+    } else if (send_queue_depth <= 1) {
+        congested_frames_ = 0;
+        idle_ms_ += kProfiles[level_].frame_duration_ms;
+        if (idle_ms_ >= ENCODER_STEP_DOWN_MS) {
+            idle_ms_ = 0;
+            level_ = std::max(level_ - 1, 0);
+        }
+    }
+    level_ = std::max(level_, LevelFloor());
+#endif
+
+    if (level_ != old_level) {
+        auto& profile = kProfiles[level_];
+        ESP_LOGI(TAG, "Encoder profile %d -> %d: %dms, bitrate %d, fec %d (queue %u/%u, rtt %dms, loss %d%%)", old_level,
+                 level_, profile.frame_duration_ms, profile.bitrate, profile.enable_fec, send_queue_depth,
+                 send_queue_capacity, rtt_ms_.load(), loss_percent_.load());
+        return true;
+    }
+    return false;
+}
+
+const OpusEncoderProfile& AudioEncoderController::profile() const {
+    return kProfiles[level_];
+}
+
+esp_opus_enc_config_t AudioEncoderController::GetEncoderConfig() const {
+    esp_opus_enc_config_t config = AS_OPUS_ENC_CONFIG();
+    auto& p = profile();
+    config.bitrate = p.bitrate;
+    config.frame_duration = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(p.frame_duration_ms);
+    config.complexity = p.complexity;
+    config.enable_fec = p.enable_fec;
+    return config;
+}
@@ -0,0 +1,55 @@
+#ifndef AUDIO_ENCODER_CONTROLLER_H
+#define AUDIO_ENCODER_CONTROLLER_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "esp_opus_enc.h"
+
+/* Send queue at least half full for this many frames steps towards larger frames */
+#define ENCODER_CONGESTION_FRAMES 8
+/* Send queue drained for this long steps towards shorter frames */
+#define ENCODER_STEP_DOWN_MS 10000
+
+struct OpusEncoderProfile {
+    int frame_duration_ms;
+    int bitrate;
+    int complexity;
+    bool enable_fec;
+};
+
+/*
+ * Picks the Opus encoder profile from the send queue depth and the link RTT.
+ *
+ * Level 0 uses 20ms frames for the lowest end-of-speech latency on good Wi-Fi, level 3 uses 60ms
+ * frames at a reduced bitrate with in-band FEC for lossy cellular links. The RTT and, where the
+ * transport reports it, the audio loss set a floor on the level, a backed up send queue raises it
+ * quickly and a drained queue lowers it slowly.
+ *
+ * Update() is called by the opus encode task only, Reset() and UpdateLink() may be called from
+ * any task and are applied on the next Update().
+ */
+class AudioEncoderController {
+public:
+    AudioEncoderController();
+
+    void Reset(int rtt_ms);
+    /* Link quality reported during a session, unlike Reset() it keeps the current level */
+    void UpdateLink(int rtt_ms, int loss_percent);
+    bool Update(size_t send_queue_depth, size_t send_queue_capacity);
+
+    const OpusEncoderProfile& profile() const;
+    esp_opus_enc_config_t GetEncoderConfig() const;
+
+private:
+    int level_;
+    int congested_frames_ = 0;
+    int idle_ms_ = 0;
+    std::atomic<int> rtt_ms_{0};
+    std::atomic<int> loss_percent_{0};
+    std::atomic<bool> reset_requested_{false};
+
+    int LevelFloor() const;
+};
+
+#endif // AUDIO_ENCODER_CONTROLLER_H
@@ -0,0 +1,229 @@
+#include "audio_frame_pool.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cassert>
+#include <cstring>
+
+#define TAG "AudioFramePool"
+
+/* Large enough for AudioTask and AudioStreamPacket */
+#define AUDIO_FRAME_POOL_OBJECT_BLOCK_SIZE 32
+/* A 60ms Opus packet at the bitrates used by the server stays well below this */
+#define AUDIO_FRAME_POOL_OPUS_BLOCK_SIZE 512
+/* 60ms of 48kHz mono PCM */
+#define AUDIO_FRAME_POOL_PCM_BLOCK_SIZE (2880 * sizeof(int16_t))
+
+AudioFramePool::AudioFramePool() {
+#if CONFIG_AUDIO_FRAME_POOL_IN_PSRAM
+    uint32_t caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+#else
+    uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+#endif
+    InitSlab(slabs_[kBlockClassObject], AUDIO_FRAME_POOL_OBJECT_BLOCK_SIZE, CONFIG_AUDIO_FRAME_POOL_PACKET_BLOCKS * 2, caps);
+    InitSlab(slabs_[kBlockClassOpus], AUDIO_FRAME_POOL_OPUS_BLOCK_SIZE, CONFIG_AUDIO_FRAME_POOL_PACKET_BLOCKS, caps);
+    InitSlab(slabs_[kBlockClassPcm], AUDIO_FRAME_POOL_PCM_BLOCK_SIZE, CONFIG_AUDIO_FRAME_POOL_PCM_BLOCKS, caps);
+}
+
+AudioFramePool::~AudioFramePool() {
+    for (auto& slab : slabs_) {
+        if (slab.base != nullptr) {
+            heap_caps_free(slab.base);
+        }
+        delete[] slab.bitmap;
+    }
+}
+
+void AudioFramePool::InitSlab(Slab& slab, size_t block_size, size_t block_count, uint32_t caps) {
+    slab.block_size = block_size;
+    if (block_count == 0) {
+        return;
+    }
+    slab.base = (uint8_t*)heap_caps_malloc(block_size * block_count, caps);
+    if (slab.base == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate %u x %u bytes, falling back to default heap", block_count, block_size);
+        slab.base = (uint8_t*)heap_caps_malloc(block_size * block_count, MALLOC_CAP_8BIT);
+    }
+    if (slab.base == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u x %u bytes, pool class disabled", block_count, block_size);
+        return;
+    }
+    size_t words = (block_count + 31) / 32;
+    slab.bitmap = new std::atomic<uint32_t>[words];
+    for (size_t i = 0; i < words; i++) {
+        slab.bitmap[i].store(0, std::memory_order_relaxed);
+    }
+    /* Mark the tail bits of the last word as used so they are never handed out */
+    if (block_count % 32 != 0) {
+        slab.bitmap[words - 1].store(~((1u << (block_count % 32)) - 1), std::memory_order_relaxed);
+    }
+    slab.block_count = block_count;
+}
+
+void* AudioFramePool::TryAllocate(Slab& slab) {
+    size_t words = (slab.block_count + 31) / 32;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t bits = slab.bitmap[i].load(std::memory_order_relaxed);
+        while (bits != 0xFFFFFFFF) {
+            int bit = __builtin_ctz(~bits);
+            if (slab.bitmap[i].compare_exchange_weak(bits, bits | (1u << bit), std::memory_order_acquire,
+                                                     std::memory_order_relaxed)) {
+                size_t in_use = slab.in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+                size_t high_water = slab.high_water.load(std::memory_order_relaxed);
+                while (in_use > high_water &&
+                       !slab.high_water.compare_exchange_weak(high_water, in_use, std::memory_order_relaxed)) {
+                }
+                return slab.base + (i * 32 + bit) * slab.block_size;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void* AudioFramePool::Allocate(size_t size, size_t* capacity) {
+    /* Only the smallest fitting class is used, so small packets never starve the PCM blocks */
+    for (auto& slab : slabs_) {
+        if (size > slab.block_size) {
+            continue;
+        }
+        if (slab.block_count > 0) {
+            void* ptr = TryAllocate(slab);
+            if (ptr != nullptr) {
+                if (capacity != nullptr) {
+                    *capacity = slab.block_size;
+                }
+                return ptr;
+            }
+        }
+        slab.fallbacks.fetch_add(1, std::memory_order_relaxed);
+        break;
+    }
+    if (capacity != nullptr) {
+        *capacity = size;
+    }
+    return heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+void AudioFramePool::Free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    for (auto& slab : slabs_) {
+        if (slab.block_count == 0) {
+            continue;
+        }
+        uint8_t* p = (uint8_t*)ptr;
+        if (p >= slab.base && p < slab.base + slab.block_size * slab.block_count) {
+            size_t index = (p - slab.base) / slab.block_size;
+            slab.bitmap[index / 32].fetch_and(~(1u << (index % 32)), std::memory_order_release);
+            slab.in_use.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    heap_caps_free(ptr);
+}
+
+AudioFramePool::Stats AudioFramePool::GetStats(BlockClass block_class) const {
+    const Slab& slab = slabs_[block_class];
+    return Stats {
+        .block_size = slab.block_size,
+        .block_count = slab.block_count,
+        .in_use = slab.in_use.load(std::memory_order_relaxed),
+        .high_water = slab.high_water.load(std::memory_order_relaxed),
+        .fallbacks = slab.fallbacks.load(std::memory_order_relaxed),
+    };
+}
+
+void AudioFramePool::PrintStats() const {
+    static const char* names[kBlockClassCount] = { "object", "opus", "pcm" };
+    for (int i = 0; i < kBlockClassCount; i++) {
+        auto stats = GetStats((BlockClass)i);
+        ESP_LOGI(TAG, "%s: %u/%u in use, high water %u, heap fallbacks %u", names[i],
+                 stats.in_use, stats.block_count, stats.high_water, stats.fallbacks);
+    }
+}
+
+AudioPayload::AudioPayload(AudioPayload&& other) noexcept
+    : buffer_(other.buffer_), offset_(other.offset_), size_(other.size_), capacity_(other.capacity_) {
+    other.buffer_ = nullptr;
+    other.offset_ = kHeadroom;
+    other.size_ = 0;
+    other.capacity_ = 0;
+}
+
+AudioPayload AudioPayload::View(const uint8_t* data, size_t size) {
+    assert(size <= UINT16_MAX);
+    AudioPayload payload;
+    payload.buffer_ = const_cast<uint8_t*>(data);
+    payload.offset_ = 0;
+    payload.size_ = size;
+    return payload;
+}
+
+AudioPayload& AudioPayload::operator=(AudioPayload&& other) noexcept {
+    if (this != &other) {
+        if (owned()) {
+            AudioFramePool::GetInstance().Free(buffer_);
+        }
+        buffer_ = other.buffer_;
+        offset_ = other.offset_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        other.buffer_ = nullptr;
+        other.offset_ = kHeadroom;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+    return *this;
+}
+
+AudioPayload::~AudioPayload() {
+    if (owned()) {
+        AudioFramePool::GetInstance().Free(buffer_);
+    }
+}
+
+void AudioPayload::Reallocate(size_t headroom, size_t size) {
+    size_t capacity = headroom + size;
+    assert(capacity <= UINT16_MAX);
+    /* A pool block is usually larger than asked for, later growth within it needs no copy */
+    auto buffer = (uint8_t*)AudioFramePool::GetInstance().Allocate(capacity, &capacity);
+    if (capacity > UINT16_MAX) {
+        capacity = UINT16_MAX;
+    }
+    if (buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+    if (size_ > 0) {
+        memcpy(buffer + headroom, data(), size_ < size ? size_ : size);
+    }
+    if (owned()) {
+        AudioFramePool::GetInstance().Free(buffer_);
+    }
+    buffer_ = buffer;
+    offset_ = headroom;
+    capacity_ = capacity;
+}
+
+void AudioPayload::resize(size_t size) {
+    if (!owned() || offset_ + size > capacity_) {
+        Reallocate(kHeadroom, size);
+    }
+    size_ = size;
+}
+
+void AudioPayload::assign(const uint8_t* first, const uint8_t* last) {
+    size_t size = last - first;
+    size_ = 0;
+    resize(size);
+    memcpy(data(), first, size);
+}
+
+uint8_t* AudioPayload::Prepend(size_t size) {
+    if (!owned() || size > offset_) {
+        Reallocate(size, size_);
+    }
+    offset_ -= size;
+    size_ += size;
+    return data();
+}
@@ -0,0 +1,143 @@
+#ifndef AUDIO_FRAME_POOL_H
+#define AUDIO_FRAME_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+/*
+ * Fixed pool of audio frame buffers, allocated once at startup.
+ *
+ * Blocks come in three size classes: small objects (AudioTask / AudioStreamPacket), Opus packets
+ * and PCM frames. Allocation takes the smallest class that fits and scans an atomic bitmap, so
+ * no lock is taken on the real-time path. Requests that do not fit, or arrive when a class is
+ * exhausted, fall back to the heap and are counted so the pool can be sized from the logs.
+ */
+class AudioFramePool {
+public:
+    enum BlockClass {
+        kBlockClassObject = 0,
+        kBlockClassOpus,
+        kBlockClassPcm,
+        kBlockClassCount,
+    };
+
+    struct Stats {
+        size_t block_size;
+        size_t block_count;
+        size_t in_use;
+        size_t high_water;
+        size_t fallbacks;
+    };
+
+    static AudioFramePool& GetInstance() {
+        static AudioFramePool instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    AudioFramePool(const AudioFramePool&) = delete;
+    AudioFramePool& operator=(const AudioFramePool&) = delete;
+
+    /* capacity, if given, receives the usable size, which is the whole block when the pool serves */
+    void* Allocate(size_t size, size_t* capacity = nullptr);
+    void Free(void* ptr);
+
+    Stats GetStats(BlockClass block_class) const;
+    void PrintStats() const;
+
+private:
+    struct Slab {
+        uint8_t* base = nullptr;
+        size_t block_size = 0;
+        size_t block_count = 0;
+        std::atomic<uint32_t>* bitmap = nullptr;
+        std::atomic<size_t> in_use{0};
+        std::atomic<size_t> high_water{0};
+        std::atomic<size_t> fallbacks{0};
+    };
+
+    Slab slabs_[kBlockClassCount];
+
+    AudioFramePool();
+    ~AudioFramePool();
+
+    void InitSlab(Slab& slab, size_t block_size, size_t block_count, uint32_t caps);
+    void* TryAllocate(Slab& slab);
+};
+
+/* STL allocator backed by AudioFramePool, falls back to the heap when the pool cannot serve */
+template <typename T>
+class AudioFrameAllocator {
+public:
+    using value_type = T;
+
+    AudioFrameAllocator() noexcept = default;
+    template <typename U>
+    AudioFrameAllocator(const AudioFrameAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        void* ptr = AudioFramePool::GetInstance().Allocate(n * sizeof(T));
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) noexcept {
+        AudioFramePool::GetInstance().Free(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const AudioFrameAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AudioFrameAllocator<U>&) const noexcept { return false; }
+};
+
+/*
+ * Opus payload in a pooled buffer with headroom in front of the data, so a transport can write
+ * its header (or AES nonce) right before the payload and send both with a single pointer,
+ * without copying the payload. Sizes are limited to 64KB, far above any Opus packet.
+ *
+ * View() borrows read-only memory that outlives the payload (e.g. an embedded or flash-mapped
+ * sound) instead of copying it; resize() and Prepend() turn a view into an owned copy first.
+ */
+class AudioPayload {
+public:
+    /* Fits BinaryProtocol2 and the MQTT/UDP nonce */
+    static const size_t kHeadroom = 16;
+
+    AudioPayload() = default;
+    AudioPayload(const uint8_t* first, const uint8_t* last) { assign(first, last); }
+    static AudioPayload View(const uint8_t* data, size_t size);
+    AudioPayload(AudioPayload&& other) noexcept;
+    AudioPayload& operator=(AudioPayload&& other) noexcept;
+    AudioPayload(const AudioPayload&) = delete;
+    AudioPayload& operator=(const AudioPayload&) = delete;
+    ~AudioPayload();
+
+    uint8_t* data() { return buffer_ + offset_; }
+    const uint8_t* data() const { return buffer_ + offset_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /* Keeps the existing bytes, new bytes are uninitialized */
+    void resize(size_t size);
+    void assign(const uint8_t* first, const uint8_t* last);
+    /* Grows the payload at the front and returns the new start, moves the data if headroom is short */
+    uint8_t* Prepend(size_t size);
+
+private:
+    uint8_t* buffer_ = nullptr;
+    uint16_t offset_ = kHeadroom;
+    uint16_t size_ = 0;
+    uint16_t capacity_ = 0;  // 0 with a buffer means the memory is borrowed
+
+    bool owned() const { return capacity_ != 0; }
+    void Reallocate(size_t headroom, size_t size);
+};
+
+using AudioPcm = std::vector<int16_t, AudioFrameAllocator<int16_t>>;
+
+#endif // AUDIO_FRAME_POOL_H
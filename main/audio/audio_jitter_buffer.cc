@@ -0,0 +1,172 @@
+#include "audio_jitter_buffer.h"
+
+#include <algorithm>
+
+#include <esp_log.h>
+
+#define TAG "AudioJitterBuffer"
+
+AudioJitterBuffer::AudioJitterBuffer() : slots_(JITTER_BUFFER_MAX_FRAMES) {
+}
+
+void AudioJitterBuffer::Clear() {
+    for (auto& slot : slots_) {
+        slot.reset();
+    }
+    count_.store(0, std::memory_order_relaxed);
+}
+
+void AudioJitterBuffer::Reset() {
+    Clear();
+    has_stream_ = false;
+    playing_ = false;
+    gap_start_ms_ = -1;
+}
+
+bool AudioJitterBuffer::Full() const {
+    return has_stream_ && (int32_t)(highest_seq_ - next_seq_) + 1 >= JITTER_BUFFER_MAX_FRAMES;
+}
+
+int AudioJitterBuffer::TargetFrames() const {
+    int target = (jitter_ms_ + frame_duration_ - 1) / frame_duration_;
+    if (target > JITTER_BUFFER_MAX_FRAMES / 2) {
+        target = JITTER_BUFFER_MAX_FRAMES / 2;
+    }
+    return target;
+}
+
+uint32_t AudioJitterBuffer::LowestSeq() {
+    uint32_t seq = next_seq_;
+    while (seq != highest_seq_ && !Slot(seq)) {
+        seq++;
+    }
+    return seq;
+}
+
+void AudioJitterBuffer::UpdateJitter(uint32_t seq, int64_t now_ms) {
+    /* Lateness relative to the earliest arrival of this stream, early (bursty) packets rebase it */
+    int64_t delay = now_ms - (int64_t)(int32_t)(seq - base_seq_) * frame_duration_;
+    if (delay < min_delay_ms_) {
+        min_delay_ms_ = delay;
+    }
+    int lateness = (int)std::min<int64_t>(delay - min_delay_ms_, JITTER_BUFFER_MAX_FRAMES * frame_duration_);
+    if (lateness > jitter_ms_) {
+        jitter_ms_ = lateness;
+    } else {
+        jitter_ms_ -= (jitter_ms_ - lateness + 63) / 64;
+    }
+    stats_.jitter_ms = jitter_ms_;
+}
+
+void AudioJitterBuffer::Push(std::unique_ptr<AudioStreamPacket> packet, int64_t now_ms) {
+    stats_.received++;
+    if (packet->frame_duration > 0) {
+        frame_duration_ = packet->frame_duration;
+    }
+
+    /* A long pause means the server started a new stream */
+    if (has_stream_ && count_.load(std::memory_order_relaxed) == 0 && now_ms - last_arrival_ms_ > JITTER_BUFFER_IDLE_RESET_MS) {
+        has_stream_ = false;
+        playing_ = false;
+    }
+    last_arrival_ms_ = now_ms;
+
+    uint32_t seq = packet->sequence;
+    if (seq == 0) {
+        seq = has_stream_ ? highest_seq_ + 1 : 1;
+    }
+
+    bool resync = !has_stream_;
+    if (has_stream_) {
+        int32_t ahead = (int32_t)(seq - next_seq_);
+        if (ahead < 0) {
+            if (played_ || (int32_t)(highest_seq_ - seq) >= JITTER_BUFFER_MAX_FRAMES - 1) {
+                stats_.late++;
+                return;
+            }
+            /* Reordered packet from the head of the stream, nothing has been played yet */
+            next_seq_ = seq;
+        } else if (ahead >= JITTER_BUFFER_MAX_FRAMES) {
+            ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, resync", next_seq_, seq);
+            stats_.skipped += ahead;
+            resync = true;
+        }
+    }
+    if (resync) {
+        Clear();
+        has_stream_ = true;
+        playing_ = false;
+        played_ = false;
+        next_seq_ = highest_seq_ = base_seq_ = seq;
+        min_delay_ms_ = now_ms;
+        gap_start_ms_ = -1;
+    }
+
+    auto& slot = Slot(seq);
+    if (slot) {
+        /* Duplicate */
+        stats_.late++;
+        return;
+    }
+    if (!playing_ && count_.load(std::memory_order_relaxed) == 0) {
+        prebuffer_start_ms_ = now_ms;
+    }
+    if ((int32_t)(seq - highest_seq_) > 0) {
+        highest_seq_ = seq;
+    }
+    UpdateJitter(seq, now_ms);
+    slot = std::move(packet);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+AudioJitterBuffer::PopResult AudioJitterBuffer::Pop(int64_t now_ms, std::unique_ptr<AudioStreamPacket>& packet, int& wait_ms) {
+    wait_ms = -1;
+    if (count_.load(std::memory_order_relaxed) == 0) {
+        /* Underrun or end of stream, prebuffer again when packets come back */
+        playing_ = false;
+        gap_start_ms_ = -1;
+        return kPopNone;
+    }
+
+    int target = TargetFrames();
+    if (!playing_) {
+        int64_t deadline = prebuffer_start_ms_ + target * frame_duration_;
+        if ((int32_t)(highest_seq_ - next_seq_) + 1 <= target && now_ms < deadline) {
+            wait_ms = deadline - now_ms;
+            return kPopNone;
+        }
+        playing_ = true;
+        played_ = true;
+        stats_.target_frames = target;
+    }
+
+    if (!Slot(next_seq_)) {
+        uint32_t lowest = LowestSeq();
+        uint32_t gap = lowest - next_seq_;
+        if (gap > JITTER_BUFFER_MAX_CONCEAL_FRAMES) {
+            stats_.skipped += gap;
+            next_seq_ = lowest;
+            gap_start_ms_ = -1;
+        } else {
+            /* Give a reordered packet a chance to arrive before concealing it */
+            if (gap_start_ms_ < 0) {
+                gap_start_ms_ = now_ms;
+            }
+            int64_t deadline = gap_start_ms_ + std::max(target, 1) * frame_duration_;
+            if ((int32_t)(highest_seq_ - next_seq_) <= target && now_ms < deadline) {
+                wait_ms = deadline - now_ms;
+                return kPopNone;
+            }
+            next_seq_++;
+            gap_start_ms_ = -1;
+            stats_.concealed++;
+            return kPopLost;
+        }
+    }
+
+    packet = std::move(Slot(next_seq_));
+    next_seq_++;
+    gap_start_ms_ = -1;
+    count_.fetch_sub(1, std::memory_order_relaxed);
+    return kPopPacket;
+}
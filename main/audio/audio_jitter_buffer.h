@@ -0,0 +1,85 @@
+#ifndef AUDIO_JITTER_BUFFER_H
+#define AUDIO_JITTER_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "protocol.h"
+
+/* Upper bound of frames held by the jitter buffer, 960ms of 60ms frames */
+#define JITTER_BUFFER_MAX_FRAMES 16
+/* Longest gap that is concealed, larger gaps are skipped */
+#define JITTER_BUFFER_MAX_CONCEAL_FRAMES 3
+/* Arrivals separated by more than this start a new stream */
+#define JITTER_BUFFER_IDLE_RESET_MS 1000
+
+/*
+ * Reorders incoming Opus packets by sequence number and decides when each frame is played.
+ *
+ * Arrival lateness is measured against the earliest arrival seen in the current stream, and the
+ * target depth follows its peak (fast attack, slow decay). On a clean link the target stays at
+ * zero frames and nothing is added on top of the playback queue; on a lossy cell the buffer grows
+ * until playback is smooth again. Missing frames are reported as lost so the caller can run the
+ * decoder's packet loss concealment.
+ *
+ * Packets with sequence 0 (transports without numbering) are numbered in arrival order.
+ *
+ * Only the opus decode task may call Push() / Pop() / Reset(), Size() may be read from any task.
+ */
+class AudioJitterBuffer {
+public:
+    enum PopResult {
+        kPopNone,    // Nothing to play yet, retry after wait_ms (-1 means wait for the next packet)
+        kPopPacket,  // Play the returned packet
+        kPopLost,    // The next frame is missing, conceal it
+    };
+
+    struct Stats {
+        uint32_t received = 0;
+        uint32_t late = 0;
+        uint32_t concealed = 0;
+        uint32_t skipped = 0;
+        int jitter_ms = 0;
+        int target_frames = 0;
+    };
+
+    AudioJitterBuffer();
+
+    void Push(std::unique_ptr<AudioStreamPacket> packet, int64_t now_ms);
+    PopResult Pop(int64_t now_ms, std::unique_ptr<AudioStreamPacket>& packet, int& wait_ms);
+    void Reset();
+
+    bool Full() const;
+    size_t Size() const { return count_.load(std::memory_order_relaxed); }
+    bool Empty() const { return Size() == 0; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    std::vector<std::unique_ptr<AudioStreamPacket>> slots_;
+    std::atomic<size_t> count_{0};
+    Stats stats_;
+
+    bool has_stream_ = false;   // next_seq_ / highest_seq_ are valid
+    bool playing_ = false;      // Prebuffering is done
+    bool played_ = false;       // Something of this stream was played, next_seq_ may not move back
+    uint32_t next_seq_ = 0;
+    uint32_t highest_seq_ = 0;
+    int frame_duration_ = 60;
+
+    int64_t last_arrival_ms_ = 0;
+    int64_t prebuffer_start_ms_ = 0;
+    int64_t gap_start_ms_ = -1;
+
+    uint32_t base_seq_ = 0;
+    int64_t min_delay_ms_ = 0;
+    int jitter_ms_ = 0;
+
+    std::unique_ptr<AudioStreamPacket>& Slot(uint32_t seq) { return slots_[seq % JITTER_BUFFER_MAX_FRAMES]; }
+    void Clear();
+    void UpdateJitter(uint32_t seq, int64_t now_ms);
+    int TargetFrames() const;
+    uint32_t LowestSeq();
+};
+
+#endif // AUDIO_JITTER_BUFFER_H
@@ -0,0 +1,117 @@
+#include "audio_latency_tracer.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+
+#define TAG "AudioLatencyTracer"
+
+static const char* const kStageNames[kLatencyStageCount] = {
+    "afe", "encode_queue", "encode", "send_queue", "send",
+    "jitter", "decode", "playback_queue", "output",
+    "first_packet", "first_sample",
+};
+
+int AudioLatencyTracer::BucketIndex(uint32_t value) {
+    if (value < 2) {
+        return value;
+    }
+    int octave = 31 - __builtin_clz(value);
+    int sub = (value >> (octave - 1)) & 1;
+    int index = octave * 2 + sub;
+    return index < kBucketCount ? index : kBucketCount - 1;
+}
+
+uint32_t AudioLatencyTracer::BucketUpperBound(int index) {
+    if (index < 2) {
+        return index;
+    }
+    int octave = index / 2;
+    int sub = index % 2;
+    return ((uint32_t)(3 + sub) << (octave - 1)) - 1;
+}
+
+void AudioLatencyTracer::Record(LatencyStage stage, uint32_t start_us, uint32_t end_us) {
+    if (start_us == 0) {
+        return;
+    }
+    uint32_t value = end_us - start_us;
+    auto& histogram = histograms_[stage];
+    histogram.buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    uint32_t max_us = histogram.max_us.load(std::memory_order_relaxed);
+    while (value > max_us && !histogram.max_us.compare_exchange_weak(max_us, value, std::memory_order_relaxed)) {
+    }
+}
+
+void AudioLatencyTracer::MarkSpeechEnd() {
+    response_packet_seen_ = false;
+    speech_end_us_ = Now();
+}
+
+void AudioLatencyTracer::OnResponsePacket() {
+    uint32_t speech_end_us = speech_end_us_.load();
+    if (speech_end_us == 0 || response_packet_seen_.exchange(true)) {
+        return;
+    }
+    Record(kLatencyStageFirstPacket, speech_end_us);
+}
+
+void AudioLatencyTracer::OnResponseSample() {
+    if (!response_packet_seen_) {
+        return;
+    }
+    uint32_t speech_end_us = speech_end_us_.exchange(0);
+    if (speech_end_us == 0) {
+        return;
+    }
+    uint32_t now = Now();
+    Record(kLatencyStageFirstSample, speech_end_us, now);
+    ESP_LOGI(TAG, "Turn latency: %lu ms to first sample", (now - speech_end_us) / 1000);
+}
+
+uint32_t AudioLatencyTracer::Percentile(const Histogram& histogram, int percent) const {
+    uint32_t count = histogram.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t target = (count * (uint64_t)percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        seen += histogram.buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            uint32_t bound = BucketUpperBound(i);
+            uint32_t max_us = histogram.max_us.load(std::memory_order_relaxed);
+            return bound < max_us ? bound : max_us;
+        }
+    }
+    return histogram.max_us.load(std::memory_order_relaxed);
+}
+
+std::string AudioLatencyTracer::GetStatsJson() const {
+    cJSON* root = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto& histogram = histograms_[i];
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", histogram.count.load(std::memory_order_relaxed));
+        cJSON_AddNumberToObject(stage, "p50_ms", Percentile(histogram, 50) / 1000.0);
+        cJSON_AddNumberToObject(stage, "p95_ms", Percentile(histogram, 95) / 1000.0);
+        cJSON_AddNumberToObject(stage, "p99_ms", Percentile(histogram, 99) / 1000.0);
+        cJSON_AddNumberToObject(stage, "max_ms", histogram.max_us.load(std::memory_order_relaxed) / 1000.0);
+        cJSON_AddItemToObject(root, kStageNames[i], stage);
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void AudioLatencyTracer::Reset() {
+    for (auto& histogram : histograms_) {
+        for (auto& bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.max_us.store(0, std::memory_order_relaxed);
+    }
+}
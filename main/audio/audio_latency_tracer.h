@@ -0,0 +1,67 @@
+#ifndef AUDIO_LATENCY_TRACER_H
+#define AUDIO_LATENCY_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <esp_timer.h>
+
+enum LatencyStage {
+    /* Uplink */
+    kLatencyStageAfe = 0,       // Last feed -> processor output
+    kLatencyStageEncodeQueue,   // Processor output -> encoder
+    kLatencyStageEncode,        // Opus encode
+    kLatencyStageSendQueue,     // Encoder -> application send loop
+    kLatencyStageSend,          // Protocol::SendAudio()
+    /* Downlink */
+    kLatencyStageJitter,        // Packet arrival -> decoder (decode queue and jitter buffer)
+    kLatencyStageDecode,        // Opus decode and resample
+    kLatencyStagePlaybackQueue, // Decoder -> output task
+    kLatencyStageOutput,        // AudioCodec::OutputData()
+    /* Conversation turn, measured from the end of the user's speech */
+    kLatencyStageFirstPacket,   // -> first response packet received
+    kLatencyStageFirstSample,   // -> first response sample played
+    kLatencyStageCount,
+};
+
+/*
+ * Per-stage latency histograms for the voice pipeline.
+ *
+ * Frames carry 32-bit microsecond timestamps (esp_timer) through the pipeline and each stage
+ * records its duration into a log-scale histogram with two buckets per octave, so percentiles are
+ * accurate to about 25%. Record() is lock free and may be called from any task.
+ */
+class AudioLatencyTracer {
+public:
+    static uint32_t Now() { return (uint32_t)esp_timer_get_time(); }
+
+    void Record(LatencyStage stage, uint32_t start_us, uint32_t end_us = Now());
+
+    /* Conversation turn tracking */
+    void MarkSpeechEnd();
+    void OnResponsePacket();
+    void OnResponseSample();
+
+    std::string GetStatsJson() const;
+    void Reset();
+
+private:
+    static const int kBucketCount = 48;
+
+    struct Histogram {
+        std::atomic<uint32_t> buckets[kBucketCount] = {};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> max_us{0};
+    };
+
+    Histogram histograms_[kLatencyStageCount];
+    std::atomic<uint32_t> speech_end_us_{0};
+    std::atomic<bool> response_packet_seen_{false};
+
+    static int BucketIndex(uint32_t value);
+    static uint32_t BucketUpperBound(int index);
+    uint32_t Percentile(const Histogram& histogram, int percent) const;
+};
+
+#endif // AUDIO_LATENCY_TRACER_H
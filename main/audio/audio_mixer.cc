@@ -0,0 +1,134 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "sdkconfig.h"
+
+AudioMixer::AudioMixer() {
+    sources_[kAudioMixSourceVoice].priority = 1;
+    sources_[kAudioMixSourceMedia].duck_q12 = ToQ12(CONFIG_AUDIO_MIXER_DUCK_PERCENT / 100.0f);
+#if CONFIG_AUDIO_OUTPUT_LOUDNESS_NORMALIZATION
+    SetLoudnessTarget(kAudioMixSourceMedia, CONFIG_AUDIO_OUTPUT_LOUDNESS_TARGET_DBFS);
+#endif
+    SetSampleRate(16000);
+}
+
+void AudioMixer::SetSampleRate(int sample_rate) {
+    sample_rate_ = sample_rate;
+    hold_samples_ = sample_rate * AUDIO_MIXER_DUCK_HOLD_MS / 1000;
+    ramp_step_ = std::max<int32_t>(1, kUnity / (sample_rate * AUDIO_MIXER_RAMP_MS / 1000));
+}
+
+int32_t AudioMixer::ToQ12(float gain) {
+    /* Below 8.0 a sample times the gain always fits in 32 bits */
+    return std::clamp<int32_t>((int32_t)(gain * kUnity), 0, kMaxGain);
+}
+
+void AudioMixer::SetGain(AudioMixSource source, float gain) {
+    sources_[source].gain_q12 = ToQ12(gain);
+}
+
+void AudioMixer::SetDuckGain(AudioMixSource source, float gain) {
+    sources_[source].duck_q12 = ToQ12(gain);
+}
+
+void AudioMixer::SetPriority(AudioMixSource source, int priority) {
+    sources_[source].priority = priority;
+}
+
+void AudioMixer::SetLoudnessTarget(AudioMixSource source, float target_dbfs) {
+    float rms = target_dbfs < 0 ? 32768.0f * powf(10.0f, target_dbfs / 20.0f) : 0;
+    sources_[source].loudness_target = rms * rms;
+}
+
+/* Runs once per block, the per-sample work is a multiply-add over the input */
+void AudioMixer::UpdateLoudness(Source& source, const int16_t* input, size_t samples) {
+    float target = source.loudness_target;
+    if (target <= 0) {
+        source.normalize_q12 = kUnity;
+        return;
+    }
+    int64_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += (int32_t)input[i] * input[i];
+    }
+    float mean_square = (float)sum / samples;
+    static const float gate = powf(32768.0f * powf(10.0f, AUDIO_MIXER_LOUDNESS_GATE_DBFS / 20.0f), 2);
+    if (mean_square < gate) {
+        return;
+    }
+    if (source.loudness <= 0) {
+        source.loudness = mean_square;
+    } else {
+        float window = (float)sample_rate_ * AUDIO_MIXER_LOUDNESS_WINDOW_MS / 1000;
+        source.loudness += (mean_square - source.loudness) * std::min(1.0f, samples / window);
+    }
+    float gain = std::clamp(sqrtf(target / source.loudness), AUDIO_MIXER_LOUDNESS_MIN_GAIN, AUDIO_MIXER_LOUDNESS_MAX_GAIN);
+    source.normalize_q12 = ToQ12(gain);
+}
+
+void AudioMixer::Mix(const int16_t* const inputs[kAudioMixSourceCount], size_t samples, int32_t* output) {
+    int32_t start[kAudioMixSourceCount];
+    int32_t step_q8[kAudioMixSourceCount];
+    int active[kAudioMixSourceCount];
+    int active_count = 0;
+
+    for (int i = 0; i < kAudioMixSourceCount; i++) {
+        Source& source = sources_[i];
+        bool ducked = false;
+        for (int j = 0; j < kAudioMixSourceCount; j++) {
+            if (j != i && inputs[j] != nullptr && sources_[j].priority > source.priority) {
+                ducked = true;
+                break;
+            }
+        }
+        if (ducked) {
+            source.hold_samples = hold_samples_;
+        } else if (source.hold_samples > 0) {
+            ducked = true;
+            source.hold_samples -= std::min<uint32_t>(source.hold_samples, samples);
+        }
+        if (inputs[i] == nullptr) {
+            continue;
+        }
+
+        UpdateLoudness(source, inputs[i], samples);
+        int64_t target = source.gain_q12;
+        target = (target * source.normalize_q12) >> kShift;
+        if (ducked) {
+            target = (target * source.duck_q12) >> kShift;
+        }
+        int32_t max_change = (int32_t)std::min<int64_t>((int64_t)ramp_step_ * samples, kMaxGain);
+        int32_t end = (int32_t)std::clamp<int64_t>(target, source.level_q12 - max_change, source.level_q12 + max_change);
+        end = std::min(end, kMaxGain);
+        start[i] = source.level_q12;
+        step_q8[i] = samples > 0 ? (end - start[i]) * 256 / (int32_t)samples : 0;
+        source.level_q12 = end;
+        active[active_count++] = i;
+    }
+
+    if (active_count == 0) {
+        memset(output, 0, samples * sizeof(int32_t));
+        return;
+    }
+
+    /* The first source initializes the output, the others are added on top */
+    for (int k = 0; k < active_count; k++) {
+        int i = active[k];
+        const int16_t* input = inputs[i];
+        int32_t level_q8 = start[i] << 8;
+        int32_t step = step_q8[i];
+        if (step == 0 && start[i] == kUnity) {
+            for (size_t n = 0; n < samples; n++) {
+                output[n] = k == 0 ? input[n] : output[n] + input[n];
+            }
+            continue;
+        }
+        for (size_t n = 0; n < samples; n++) {
+            int32_t value = (input[n] * (level_q8 >> 8)) >> kShift;
+            output[n] = k == 0 ? value : output[n] + value;
+            level_q8 += step;
+        }
+    }
+}
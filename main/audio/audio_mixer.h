@@ -0,0 +1,78 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum AudioMixSource {
+    kAudioMixSourceVoice = 0,   // Decoded server audio and sounds played with PlaySound()
+    kAudioMixSourceMedia,       // PCM from the radio and music players
+    kAudioMixSourceCount,
+};
+
+/* Lower priority sources stay ducked this long after a higher priority source went quiet */
+#define AUDIO_MIXER_DUCK_HOLD_MS 500
+/* Time for a full scale gain change, short enough to follow speech and long enough not to click */
+#define AUDIO_MIXER_RAMP_MS 20
+/* Loudness normalization follows the programme level over this long */
+#define AUDIO_MIXER_LOUDNESS_WINDOW_MS 3000
+/* Blocks quieter than this (dBFS RMS) are treated as silence and do not change the level */
+#define AUDIO_MIXER_LOUDNESS_GATE_DBFS -50
+#define AUDIO_MIXER_LOUDNESS_MIN_GAIN 0.25f
+#define AUDIO_MIXER_LOUDNESS_MAX_GAIN 4.0f
+
+/*
+ * Mixes the playback sources into one 32-bit stream at the codec output rate.
+ *
+ * Each source has a gain and a priority. While a source plays, every source with a lower
+ * priority is ducked to its duck gain, and stays ducked for AUDIO_MIXER_DUCK_HOLD_MS after it
+ * stops, so the radio does not swell up between two TTS sentences. A source can also be
+ * loudness normalized: its gated RMS level, averaged over AUDIO_MIXER_LOUDNESS_WINDOW_MS, is
+ * brought to a target level. Gain changes are ramped sample by sample.
+ *
+ * The mix is not clipped, AudioOutputDsp limits it to 16 bits.
+ *
+ * Gains are set from any task, Mix() is only called by the audio output task.
+ */
+class AudioMixer {
+public:
+    AudioMixer();
+
+    void SetSampleRate(int sample_rate);
+    /* Gains are clamped to [0, 8) */
+    void SetGain(AudioMixSource source, float gain);
+    void SetDuckGain(AudioMixSource source, float gain);
+    void SetPriority(AudioMixSource source, int priority);
+    /* A target of 0 dBFS or above turns normalization off */
+    void SetLoudnessTarget(AudioMixSource source, float target_dbfs);
+
+    /* inputs[i] holds `samples` samples of source i, or is null when the source has nothing to play */
+    void Mix(const int16_t* const inputs[kAudioMixSourceCount], size_t samples, int32_t* output);
+
+private:
+    static constexpr int kShift = 12;
+    static constexpr int32_t kUnity = 1 << kShift;
+    static constexpr int32_t kMaxGain = 8 * kUnity - 1;
+
+    struct Source {
+        std::atomic<int32_t> gain_q12{kUnity};
+        std::atomic<int32_t> duck_q12{kUnity};
+        std::atomic<int> priority{0};
+        std::atomic<float> loudness_target{0};  // Mean square, 0 when not normalized
+        float loudness = 0;                     // Gated mean square
+        int32_t normalize_q12 = kUnity;
+        int32_t level_q12 = kUnity;             // Gain currently applied, ramps towards the target
+        uint32_t hold_samples = 0;              // Remaining duck hold
+    };
+
+    Source sources_[kAudioMixSourceCount];
+    int sample_rate_ = 16000;
+    uint32_t hold_samples_ = 0;
+    int32_t ramp_step_ = kUnity;                // Largest level change per sample
+
+    static int32_t ToQ12(float gain);
+    void UpdateLoudness(Source& source, const int16_t* input, size_t samples);
+};
+
+#endif // AUDIO_MIXER_H
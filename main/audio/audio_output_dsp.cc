@@ -0,0 +1,179 @@
+#include "audio_output_dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "sdkconfig.h"
+
+AudioOutputDsp::AudioOutputDsp() {
+#if CONFIG_AUDIO_OUTPUT_EQ_HIGHPASS_HZ > 0
+    bands_.push_back({AudioEqBand::kHighPass, CONFIG_AUDIO_OUTPUT_EQ_HIGHPASS_HZ, 0.707f, 0.0f});
+#endif
+#if CONFIG_AUDIO_OUTPUT_EQ_LOW_SHELF_HZ > 0
+    bands_.push_back({AudioEqBand::kLowShelf, CONFIG_AUDIO_OUTPUT_EQ_LOW_SHELF_HZ, 0.707f, (float)CONFIG_AUDIO_OUTPUT_EQ_LOW_SHELF_DB});
+#endif
+#if CONFIG_AUDIO_OUTPUT_EQ_PEAK_HZ > 0
+    bands_.push_back({AudioEqBand::kPeaking, CONFIG_AUDIO_OUTPUT_EQ_PEAK_HZ, CONFIG_AUDIO_OUTPUT_EQ_PEAK_Q_X10 / 10.0f, (float)CONFIG_AUDIO_OUTPUT_EQ_PEAK_DB});
+#endif
+#if CONFIG_AUDIO_OUTPUT_LIMITER
+    threshold_ = (int32_t)(32767 * powf(10.0f, CONFIG_AUDIO_OUTPUT_LIMITER_DBFS / 20.0f));
+#endif
+    Design();
+}
+
+void AudioOutputDsp::SetSampleRate(int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sample_rate_ = sample_rate;
+    Design();
+}
+
+void AudioOutputDsp::SetEq(const std::vector<AudioEqBand>& bands) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bands_ = bands;
+    Design();
+}
+
+void AudioOutputDsp::SetLimiter(float threshold_dbfs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threshold_ = threshold_dbfs < 0 ? (int32_t)(32767 * powf(10.0f, threshold_dbfs / 20.0f)) : 0;
+}
+
+void AudioOutputDsp::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < biquad_count_; i++) {
+        biquads_[i].x1 = biquads_[i].x2 = biquads_[i].y1 = biquads_[i].y2 = biquads_[i].error = 0;
+    }
+    std::fill(delay_.begin(), delay_.end(), 0);
+    position_ = 0;
+    peaks_[0] = peaks_[1] = 0;
+    gain_q23_ = kUnity << 8;
+    gain_step_ = 0;
+    gain_target_ = kUnity;
+}
+
+/* Audio EQ Cookbook (R. Bristow-Johnson) coefficients, quantized to Q28 */
+void AudioOutputDsp::Design() {
+    biquad_count_ = 0;
+    for (const auto& band : bands_) {
+        if (biquad_count_ >= AUDIO_OUTPUT_EQ_MAX_BANDS) {
+            break;
+        }
+        if (band.frequency <= 0 || band.frequency >= sample_rate_ / 2 || band.q <= 0) {
+            continue;
+        }
+        double a = pow(10.0, std::clamp(band.gain_db, -12.0f, 12.0f) / 40.0);
+        double w0 = 2 * M_PI * band.frequency / sample_rate_;
+        double cosw = cos(w0);
+        double alpha = sin(w0) / (2 * band.q);
+        double sq = 2 * sqrt(a) * alpha;
+        double b0, b1, b2, a0, a1, a2;
+        switch (band.type) {
+        case AudioEqBand::kHighPass:
+            b0 = (1 + cosw) / 2; b1 = -(1 + cosw); b2 = (1 + cosw) / 2;
+            a0 = 1 + alpha; a1 = -2 * cosw; a2 = 1 - alpha;
+            break;
+        case AudioEqBand::kLowShelf:
+            b0 = a * ((a + 1) - (a - 1) * cosw + sq);
+            b1 = 2 * a * ((a - 1) - (a + 1) * cosw);
+            b2 = a * ((a + 1) - (a - 1) * cosw - sq);
+            a0 = (a + 1) + (a - 1) * cosw + sq;
+            a1 = -2 * ((a - 1) + (a + 1) * cosw);
+            a2 = (a + 1) + (a - 1) * cosw - sq;
+            break;
+        case AudioEqBand::kHighShelf:
+            b0 = a * ((a + 1) + (a - 1) * cosw + sq);
+            b1 = -2 * a * ((a - 1) + (a + 1) * cosw);
+            b2 = a * ((a + 1) + (a - 1) * cosw - sq);
+            a0 = (a + 1) - (a - 1) * cosw + sq;
+            a1 = 2 * ((a - 1) - (a + 1) * cosw);
+            a2 = (a + 1) - (a - 1) * cosw - sq;
+            break;
+        default:
+            b0 = 1 + alpha * a; b1 = -2 * cosw; b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a; a1 = -2 * cosw; a2 = 1 - alpha / a;
+            break;
+        }
+        const double scale = (double)(1 << kCoefShift) / a0;
+        Biquad& biquad = biquads_[biquad_count_++];
+        biquad = Biquad();
+        biquad.b0 = (int32_t)lround(b0 * scale);
+        biquad.b1 = (int32_t)lround(b1 * scale);
+        biquad.b2 = (int32_t)lround(b2 * scale);
+        biquad.a1 = (int32_t)lround(a1 * scale);
+        biquad.a2 = (int32_t)lround(a2 * scale);
+    }
+
+    block_ = std::max(1, sample_rate_ * AUDIO_OUTPUT_LIMITER_BLOCK_MS / 1000);
+    delay_.assign(block_ * 2, 0);
+    position_ = 0;
+    peaks_[0] = peaks_[1] = 0;
+    release_step_ = std::max<int32_t>(1, (int32_t)((int64_t)kUnity * block_ * 1000 / (sample_rate_ * AUDIO_OUTPUT_LIMITER_RELEASE_MS)));
+}
+
+void AudioOutputDsp::Process(int32_t* data, size_t samples, int16_t* out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ProcessEq(data, samples);
+    if (threshold_ > 0) {
+        ProcessLimiter(data, samples, out);
+        return;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        out[i] = (int16_t)std::clamp<int32_t>(data[i], INT16_MIN, INT16_MAX);
+    }
+}
+
+void AudioOutputDsp::ProcessEq(int32_t* data, size_t samples) {
+    for (int k = 0; k < biquad_count_; k++) {
+        Biquad& bq = biquads_[k];
+        int32_t x1 = bq.x1, x2 = bq.x2, y1 = bq.y1, y2 = bq.y2, error = bq.error;
+        for (size_t i = 0; i < samples; i++) {
+            int32_t x = data[i];
+            int64_t acc = (int64_t)bq.b0 * x + (int64_t)bq.b1 * x1 + (int64_t)bq.b2 * x2
+                - (int64_t)bq.a1 * y1 - (int64_t)bq.a2 * y2 + error;
+            /* Carry the truncated bits into the next sample, or a high-pass settles on a DC offset */
+            error = (int32_t)(acc & ((1 << kCoefShift) - 1));
+            /* Bounded well inside 32 bits, the mix is at most a few times full scale */
+            int32_t y = (int32_t)std::clamp<int64_t>(acc >> kCoefShift, -(1 << 24), 1 << 24);
+            x2 = x1; x1 = x;
+            y2 = y1; y1 = y;
+            data[i] = y;
+        }
+        bq.x1 = x1; bq.x2 = x2; bq.y1 = y1; bq.y2 = y2; bq.error = error;
+    }
+}
+
+int32_t AudioOutputDsp::RequiredGain(int32_t peak) const {
+    return peak > threshold_ ? (int32_t)(((int64_t)threshold_ << 15) / peak) : kUnity;
+}
+
+void AudioOutputDsp::ProcessLimiter(const int32_t* data, size_t samples, int16_t* out) {
+    for (size_t i = 0; i < samples; i++) {
+        size_t half = position_ < block_ ? 0 : 1;
+        if (position_ == half * block_) {
+            /*
+             * The half about to be overwritten holds the oldest sub-block, which is played now, and the
+             * other half holds the next one. Ramp to a gain that suits both, so the gain is never too
+             * high for a sample when it is played.
+             */
+            gain_q23_ = gain_target_ << 8;
+            int32_t current = gain_target_;
+            gain_target_ = std::min({RequiredGain(peaks_[half]), RequiredGain(peaks_[half ^ 1]), current + release_step_});
+            gain_target_ = std::min(gain_target_, kUnity);
+            gain_step_ = (gain_target_ - current) * 256 / (int32_t)block_;
+            peaks_[half] = 0;
+        }
+
+        int32_t delayed = delay_[position_];
+        int32_t x = data[i];
+        delay_[position_] = x;
+        peaks_[half] = std::max(peaks_[half], std::abs(x));
+
+        int32_t y = (int32_t)(((int64_t)delayed * (gain_q23_ >> 8)) >> 15);
+        gain_q23_ += gain_step_;
+        out[i] = (int16_t)std::clamp<int32_t>(y, INT16_MIN, INT16_MAX);
+
+        if (++position_ == block_ * 2) {
+            position_ = 0;
+        }
+    }
+}
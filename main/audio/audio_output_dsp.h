@@ -0,0 +1,86 @@
+#ifndef AUDIO_OUTPUT_DSP_H
+#define AUDIO_OUTPUT_DSP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define AUDIO_OUTPUT_EQ_MAX_BANDS 4
+/* The limiter looks two sub-blocks ahead, so the output is delayed by twice this */
+#define AUDIO_OUTPUT_LIMITER_BLOCK_MS 1
+#define AUDIO_OUTPUT_LIMITER_RELEASE_MS 100
+
+struct AudioEqBand {
+    enum Type {
+        kHighPass,
+        kLowShelf,
+        kPeaking,
+        kHighShelf,
+    };
+    Type type;
+    int frequency;
+    float q;
+    float gain_db;
+};
+
+/*
+ * Output DSP stage between the mixer and the codec: speaker EQ and a look-ahead peak limiter.
+ *
+ * The mixer hands over an unclipped 32-bit mix. Each EQ band is a Direct Form I biquad with
+ * Q28 coefficients and a 64-bit accumulator, so high-pass corners far below the sample rate
+ * stay stable, and error feedback, so they settle at zero instead of a DC offset. The limiter
+ * splits the stream into short sub-blocks and ramps its gain linearly across each one, towards
+ * the lowest gain needed by that sub-block and the next one. Peaks above the threshold are
+ * therefore reduced before they arrive instead of being clipped.
+ *
+ * The bands and threshold default to the board's Kconfig values. Process() is only called by
+ * the audio output task, the setters may be called from any task.
+ */
+class AudioOutputDsp {
+public:
+    AudioOutputDsp();
+
+    void SetSampleRate(int sample_rate);
+    void SetEq(const std::vector<AudioEqBand>& bands);
+    /* A threshold of 0 dBFS or above disables the limiter */
+    void SetLimiter(float threshold_dbfs);
+    void Reset();
+
+    /* Processes data in place and narrows the result into out, which may not alias data */
+    void Process(int32_t* data, size_t samples, int16_t* out);
+
+private:
+    static constexpr int kCoefShift = 28;
+    static constexpr int32_t kUnity = 1 << 15;
+
+    struct Biquad {
+        int32_t b0, b1, b2, a1, a2;
+        int32_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+        int32_t error = 0;  // Bits truncated from the last output
+    };
+
+    std::mutex mutex_;
+    int sample_rate_ = 16000;
+    std::vector<AudioEqBand> bands_;
+    Biquad biquads_[AUDIO_OUTPUT_EQ_MAX_BANDS];
+    int biquad_count_ = 0;
+
+    /* Limiter */
+    int32_t threshold_ = 0;        // 0 when disabled
+    size_t block_ = 1;
+    std::vector<int32_t> delay_;   // Two sub-blocks
+    size_t position_ = 0;
+    int32_t peaks_[2] = {};
+    int32_t gain_q23_ = kUnity << 8;
+    int32_t gain_step_ = 0;
+    int32_t gain_target_ = kUnity;
+    int32_t release_step_ = kUnity;
+
+    void Design();
+    void ProcessEq(int32_t* data, size_t samples);
+    void ProcessLimiter(const int32_t* data, size_t samples, int16_t* out);
+    int32_t RequiredGain(int32_t peak) const;
+};
+
+#endif // AUDIO_OUTPUT_DSP_H
@@ -7,20 +7,26 @@
 
 #include <model_path.h>
 #include "audio_codec.h"
+#include "audio_frame_pool.h"
 
 class AudioProcessor {
 public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) = 0;
-    virtual void Feed(std::vector<int16_t>&& data) = 0;
+    virtual void Feed(AudioPcm&& data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual bool IsRunning() = 0;
-    virtual void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) = 0;
+    virtual void OnOutput(std::function<void(AudioPcm&& data)> callback) = 0;
     virtual void OnVadStateChange(std::function<void(bool speaking)> callback) = 0;
     virtual size_t GetFeedSize() = 0;
     virtual void EnableDeviceAec(bool enable) = 0;
+    /*
+     * False while another chunk could overflow the processor's input queue, for callers that
+     * feed faster than real time. Processors that work inside Feed() never queue.
+     */
+    virtual bool CanFeed() { return true; }
 };
 
 #endif
@@ -0,0 +1,213 @@
+#include "audio_processor_harness.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#define TAG "AudioProcessorHarness"
+
+#define HARNESS_SAMPLE_RATE 16000
+#define HARNESS_TAIL_MS 1000
+// Chunks fed ahead of the processor output, the AFE ring holds 16
+#define HARNESS_MAX_LAG_CHUNKS 8
+#define HARNESS_STALL_TIMEOUT_MS 2000
+
+static uint32_t Now() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+AudioProcessorHarness::AudioProcessorHarness(int channels, int speech_start_ms, int speech_end_ms)
+    : channels_(channels), speech_start_ms_(speech_start_ms), speech_end_ms_(speech_end_ms) {
+}
+
+void AudioProcessorHarness::OnOutput(size_t samples) {
+    uint32_t now = Now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    output_samples_ += samples;
+    while (!pending_chunks_.empty() && pending_chunks_.front().first <= output_samples_) {
+        uint32_t latency = now - pending_chunks_.front().second;
+        pending_chunks_.pop_front();
+        frames_++;
+        frame_latency_total_us_ += latency;
+        if (latency > frame_latency_max_us_) {
+            frame_latency_max_us_ = latency;
+        }
+    }
+}
+
+void AudioProcessorHarness::OnVadStateChange(bool speaking) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int position_ms = (int)(output_samples_ * 1000 / HARNESS_SAMPLE_RATE);
+    if (speaking) {
+        if (onset_ms_ < 0) {
+            onset_ms_ = position_ms;
+        }
+        vad_segments_++;
+    } else {
+        offset_ms_ = position_ms;
+    }
+}
+
+bool AudioProcessorHarness::Run(AudioProcessor& processor, const int16_t* pcm, size_t frames, const std::atomic<bool>* abort) {
+    size_t feed_size = processor.GetFeedSize();
+    if (feed_size == 0) {
+        ESP_LOGE(TAG, "Processor is not initialized");
+        return false;
+    }
+
+    processor.OnOutput([this](AudioPcm&& data) {
+        OnOutput(data.size());
+    });
+    processor.OnVadStateChange([this](bool speaking) {
+        OnVadStateChange(speaking);
+    });
+    processor.Start();
+
+    uint32_t start = Now();
+    size_t total = frames + HARNESS_TAIL_MS * HARNESS_SAMPLE_RATE / 1000;
+    bool ok = true;
+    for (size_t position = 0; position < total && ok; position += feed_size) {
+        if (abort != nullptr && abort->load()) {
+            ESP_LOGW(TAG, "Interrupted at %u ms", (unsigned)(position * 1000 / HARNESS_SAMPLE_RATE));
+            interrupted_ = true;
+            ok = false;
+            break;
+        }
+        AudioPcm chunk(feed_size * channels_, 0);
+        if (position < frames) {
+            size_t count = frames - position < feed_size ? frames - position : feed_size;
+            memcpy(chunk.data(), pcm + position * channels_, count * channels_ * sizeof(int16_t));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_chunks_.emplace_back(position + feed_size, Now());
+        }
+        processor.Feed(std::move(chunk));
+
+        /* Stay a few chunks ahead of the output, the processor drops input it has no room for */
+        uint32_t wait_start = Now();
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (position + feed_size - output_samples_ <= HARNESS_MAX_LAG_CHUNKS * feed_size) {
+                    break;
+                }
+            }
+            if (Now() - wait_start > HARNESS_STALL_TIMEOUT_MS * 1000) {
+                ESP_LOGE(TAG, "Processor output stalled at %u ms", (unsigned)(position * 1000 / HARNESS_SAMPLE_RATE));
+                ok = false;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /* Drain what is still in flight, the last partial output frame never comes out */
+    uint64_t last_output = 0;
+    uint32_t last_progress = Now();
+    while (ok) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_chunks_.empty()) {
+                break;
+            }
+            if (output_samples_ != last_output) {
+                last_output = output_samples_;
+                last_progress = Now();
+            }
+        }
+        if (Now() - last_progress > 200 * 1000) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    processor.Stop();
+
+    audio_ms_ = (int)(frames * 1000 / HARNESS_SAMPLE_RATE);
+    wall_ms_ = (int)((Now() - start) / 1000);
+    return ok;
+}
+
+std::string AudioProcessorHarness::GetResultJson() const {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "audio_ms", audio_ms_);
+    cJSON_AddNumberToObject(root, "wall_ms", wall_ms_);
+    if (wall_ms_ > 0) {
+        cJSON_AddNumberToObject(root, "realtime_factor", (double)audio_ms_ / wall_ms_);
+    }
+
+    cJSON* vad = cJSON_CreateObject();
+    cJSON_AddNumberToObject(vad, "speech_start_ms", speech_start_ms_);
+    cJSON_AddNumberToObject(vad, "speech_end_ms", speech_end_ms_);
+    cJSON_AddNumberToObject(vad, "segments", vad_segments_);
+    cJSON_AddBoolToObject(vad, "detected", onset_ms_ >= 0);
+    if (onset_ms_ >= 0) {
+        int onset_latency = onset_ms_ - speech_start_ms_;
+        cJSON_AddNumberToObject(vad, "onset_ms", onset_ms_);
+        cJSON_AddNumberToObject(vad, "onset_latency_ms", onset_latency);
+        /* Speech before the onset never reaches an auto-stop session */
+        cJSON_AddNumberToObject(vad, "clipped_head_ms", onset_latency > 0 ? onset_latency : 0);
+    }
+    if (offset_ms_ >= 0) {
+        int offset_latency = offset_ms_ - speech_end_ms_;
+        cJSON_AddNumberToObject(vad, "offset_ms", offset_ms_);
+        cJSON_AddNumberToObject(vad, "offset_latency_ms", offset_latency);
+        cJSON_AddNumberToObject(vad, "clipped_tail_ms", offset_latency < 0 ? -offset_latency : 0);
+    }
+    cJSON_AddItemToObject(root, "vad", vad);
+
+    cJSON* frame = cJSON_CreateObject();
+    cJSON_AddNumberToObject(frame, "count", frames_);
+    if (frames_ > 0) {
+        cJSON_AddNumberToObject(frame, "avg_ms", frame_latency_total_us_ / frames_ / 1000.0);
+    }
+    cJSON_AddNumberToObject(frame, "max_ms", frame_latency_max_us_ / 1000.0);
+    cJSON_AddItemToObject(root, "frame_latency", frame);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+bool AudioProcessorHarness::ParseWav(const uint8_t* data, size_t size, int& channels, int& sample_rate,
+                                     const int16_t*& pcm, size_t& frames) {
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    int bits = 0;
+    channels = 0;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const uint8_t* chunk = data + offset;
+        size_t chunk_size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((size_t)chunk[7] << 24);
+        const uint8_t* body = chunk + 8;
+        if (chunk_size > size - offset - 8) {
+            chunk_size = size - offset - 8;
+        }
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+            int format = body[0] | (body[1] << 8);
+            channels = body[2] | (body[3] << 8);
+            sample_rate = body[4] | (body[5] << 8) | (body[6] << 16) | (body[7] << 24);
+            bits = body[14] | (body[15] << 8);
+            if ((format != 1 && format != 0xFFFE) || bits != 16 || channels == 0) {
+                return false;
+            }
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (channels == 0) {
+                return false;
+            }
+            pcm = (const int16_t*)body;
+            frames = chunk_size / (channels * sizeof(int16_t));
+            return true;
+        }
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
@@ -0,0 +1,62 @@
+#ifndef AUDIO_PROCESSOR_HARNESS_H
+#define AUDIO_PROCESSOR_HARNESS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "audio_processor.h"
+
+/*
+ * Replays a recording through an AudioProcessor and scores its VAD against labelled speech.
+ *
+ * The recording is interleaved 16kHz PCM in the processor's input format: the microphone channels
+ * followed by the reference channel, as in the AFE "MMR" input_format string. It is fed in feed
+ * size chunks as fast as the processor keeps up, followed by a second of silence so the VAD can
+ * end the utterance. Positions are taken from the processor output, so onset and offset latency
+ * include the processor's own delay and have the resolution of one output frame.
+ *
+ * The harness only talks to the AudioProcessor interface, so the same measurement runs against the
+ * AFE on the device and against a stand-in processor in a host build.
+ */
+class AudioProcessorHarness {
+public:
+    AudioProcessorHarness(int channels, int speech_start_ms, int speech_end_ms);
+
+    /* Returns false if the processor stopped producing output or `abort` was set during the run */
+    bool Run(AudioProcessor& processor, const int16_t* pcm, size_t frames, const std::atomic<bool>* abort = nullptr);
+    std::string GetResultJson() const;
+    bool interrupted() const { return interrupted_; }
+
+    /* Finds the PCM data of a 16 bit WAV file, returns false if it is not one */
+    static bool ParseWav(const uint8_t* data, size_t size, int& channels, int& sample_rate,
+                         const int16_t*& pcm, size_t& frames);
+
+private:
+    int channels_;
+    int speech_start_ms_;
+    int speech_end_ms_;
+
+    std::mutex mutex_;
+    uint64_t output_samples_ = 0;
+    std::deque<std::pair<uint64_t, uint32_t>> pending_chunks_;  // End position and feed time of each chunk
+
+    bool interrupted_ = false;
+    int audio_ms_ = 0;
+    int wall_ms_ = 0;
+    int onset_ms_ = -1;   // First VAD speech start, in output audio time
+    int offset_ms_ = -1;  // Last VAD speech end
+    int vad_segments_ = 0;
+    int frames_ = 0;
+    uint64_t frame_latency_total_us_ = 0;
+    uint32_t frame_latency_max_us_ = 0;
+
+    void OnOutput(size_t samples);
+    void OnVadStateChange(bool speaking);
+};
+
+#endif // AUDIO_PROCESSOR_HARNESS_H
@@ -2,26 +2,9 @@
 #include <esp_log.h>
 #include <esp_heap_caps.h>
 #include <cstring>
+#include <algorithm>
 
-#define RATE_CVT_CFG(_src_rate, _dest_rate, _channel)        \
-    (esp_ae_rate_cvt_cfg_t)                                  \
-    {                                                        \
-        .src_rate        = (uint32_t)(_src_rate),            \
-        .dest_rate       = (uint32_t)(_dest_rate),           \
-        .channel         = (uint8_t)(_channel),              \
-        .bits_per_sample = ESP_AUDIO_BIT16,                  \
-        .complexity      = 2,                                \
-        .perf_type       = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,  \
-    }
-
-#define OPUS_DEC_CFG(_sample_rate, _frame_duration_ms)                                                    \
-    (esp_opus_dec_cfg_t)                                                                                  \
-    {                                                                                                     \
-        .sample_rate    = (uint32_t)(_sample_rate),                                                       \
-        .channel        = ESP_AUDIO_MONO,                                                                 \
-        .frame_duration = (esp_opus_dec_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(_frame_duration_ms),  \
-        .self_delimited = false,                                                                          \
-    }
+#include "task_topology.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -52,17 +35,13 @@ AudioService::~AudioService() {
     if (opus_decoder_ != nullptr) {
         esp_opus_dec_close(opus_decoder_);
     }
-    if (input_resampler_ != nullptr) {
-        esp_ae_rate_cvt_close(input_resampler_);
-    }
-    if (output_resampler_ != nullptr) {
-        esp_ae_rate_cvt_close(output_resampler_);
-    }
 }
 
 void AudioService::Initialize(AudioCodec* codec) {
     codec_ = codec;
     codec_->Start();
+    mixer_.SetSampleRate(codec->output_sample_rate());
+    output_dsp_.SetSampleRate(codec->output_sample_rate());
 
     esp_opus_dec_cfg_t opus_dec_cfg = OPUS_DEC_CFG(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
     auto ret = esp_opus_dec_open(&opus_dec_cfg, sizeof(esp_opus_dec_cfg_t), &opus_decoder_);
@@ -73,25 +52,16 @@ void AudioService::Initialize(AudioCodec* codec) {
         decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
         decoder_frame_size_ = decoder_sample_rate_ / 1000 * OPUS_FRAME_DURATION_MS;
     }
-    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG();
-    ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
-    if (opus_encoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
-    } else {
-        encoder_sample_rate_ = 16000;
-        encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-        esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
-        encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+    OpenEncoder();
+    encode_pcm_buffer_.reserve(2 * OPUS_FRAME_DURATION_MS * 16000 / 1000);
+#if CONFIG_AUDIO_PREROLL_MS > 0
+    if (!preroll_ring_.Allocate(CONFIG_AUDIO_PREROLL_MS * 16 * codec->input_channels())) {
+        ESP_LOGE(TAG, "Failed to allocate pre-roll ring");
     }
+#endif
 
-    if (codec->input_sample_rate() != 16000) {
-        esp_ae_rate_cvt_cfg_t input_resampler_cfg = RATE_CVT_CFG(
-            codec->input_sample_rate(), ESP_AUDIO_SAMPLE_RATE_16K, codec->input_channels());
-        auto resampler_ret = esp_ae_rate_cvt_open(&input_resampler_cfg, &input_resampler_);
-        if (input_resampler_ == nullptr) {
-            ESP_LOGE(TAG, "Failed to create input resampler, error code: %d", resampler_ret);
-        }
-    }
+    input_resampler_ = ResamplerManager::GetInstance().Acquire(
+        codec->input_sample_rate(), ESP_AUDIO_SAMPLE_RATE_16K, codec->input_channels());
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
@@ -99,16 +69,11 @@ void AudioService::Initialize(AudioCodec* codec) {
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
-    audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
-    });
+#if CONFIG_USE_AUDIO_DEBUGGER
+    audio_debugger_ = std::make_unique<AudioDebugger>();
+#endif
 
-    audio_processor_->OnVadStateChange([this](bool speaking) {
-        voice_detected_ = speaking;
-        if (callbacks_.on_vad_change) {
-            callbacks_.on_vad_change(speaking);
-        }
-    });
+    BindAudioProcessor();
 
     esp_timer_create_args_t audio_power_timer_args = {
         .callback = [](void* arg) {
@@ -123,64 +88,56 @@ void AudioService::Initialize(AudioCodec* codec) {
     esp_timer_create(&audio_power_timer_args, &audio_power_timer_);
 }
 
+void AudioService::BindAudioProcessor() {
+    audio_processor_->OnOutput([this](AudioPcm&& data) {
+        latency_tracer_.Record(kLatencyStageAfe, last_feed_us_.load());
+#if CONFIG_USE_AUDIO_DEBUGGER
+        audio_debugger_->Feed(kAudioDebugTapProcessed, data, 16000, 1);
+#endif
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+    });
+
+    audio_processor_->OnVadStateChange([this](bool speaking) {
+        voice_detected_ = speaking;
+        if (speaking) {
+            wake_word_unconfirmed_ = false;
+        }
+        if (callbacks_.on_vad_change) {
+            callbacks_.on_vad_change(speaking);
+        }
+    });
+}
+
 void AudioService::Start() {
     service_stopped_ = false;
     xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
     esp_timer_start_periodic(audio_power_timer_, 1000000);
 
-#if CONFIG_USE_AUDIO_PROCESSOR
-    /* Start the audio input task */
-    xTaskCreatePinnedToCore([](void* arg) {
+    auto& topology = TaskTopology::GetInstance();
+    topology.Create(kTaskAudioInput, [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioInputTask();
         vTaskDelete(NULL);
-    }, "audio_input", 2048 * 3, this, 8, &audio_input_task_handle_, 0);
+    }, this, &audio_input_task_handle_);
 
-    /* Start the audio output task */
-    xTaskCreate([](void* arg) {
+    topology.Create(kTaskAudioOutput, [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
         audio_service->AudioOutputTask();
         vTaskDelete(NULL);
-    }, "audio_output", 2048 * 2, this, 4, &audio_output_task_handle_);
-#else
-    /* Start the audio input task */
-    xTaskCreate([](void* arg) {
+    }, this, &audio_output_task_handle_);
+
+    /* Encoder and decoder run on separate tasks so a slow encode never delays playback and vice versa */
+    topology.Create(kTaskOpusEncode, [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->AudioInputTask();
+        audio_service->OpusEncodeTask();
         vTaskDelete(NULL);
-    }, "audio_input", 2048 * 2, this, 8, &audio_input_task_handle_);
-
-    /* Start the audio output task */
-    xTaskCreate([](void* arg) {
+    }, this, &opus_encode_task_handle_);
+    topology.Create(kTaskOpusDecode, [](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->AudioOutputTask();
+        audio_service->OpusDecodeTask();
         vTaskDelete(NULL);
-    }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
-#endif
-
-    /* Start the opus codec task (stack in PSRAM to save ~24KB SRAM) */
-    {
-        const size_t opus_stack_size = 2048 * 12;
-        StackType_t* opus_stack = (StackType_t*)heap_caps_malloc(opus_stack_size, MALLOC_CAP_SPIRAM);
-        StaticTask_t* opus_task_buf = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-        if (opus_stack && opus_task_buf) {
-            opus_codec_task_handle_ = xTaskCreateStaticPinnedToCore([](void* arg) {
-                AudioService* audio_service = (AudioService*)arg;
-                audio_service->OpusCodecTask();
-                vTaskDelete(NULL);
-            }, "opus_codec", opus_stack_size, this, 2, opus_stack, opus_task_buf, tskNO_AFFINITY);
-        } else {
-            ESP_LOGW(TAG, "Failed to alloc PSRAM for opus_codec, falling back to SRAM");
-            if (opus_stack) heap_caps_free(opus_stack);
-            if (opus_task_buf) heap_caps_free(opus_task_buf);
-            xTaskCreate([](void* arg) {
-                AudioService* audio_service = (AudioService*)arg;
-                audio_service->OpusCodecTask();
-                vTaskDelete(NULL);
-            }, "opus_codec", opus_stack_size, this, 2, &opus_codec_task_handle_);
-        }
-    }
+    }, this, &opus_decode_task_handle_);
 }
 
 void AudioService::Stop() {
@@ -188,17 +145,32 @@ void AudioService::Stop() {
     service_stopped_ = true;
     xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
         AS_EVENT_WAKE_WORD_RUNNING |
-        AS_EVENT_AUDIO_PROCESSOR_RUNNING);
-
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+        AS_EVENT_AUDIO_PROCESSOR_RUNNING |
+        AS_EVENT_ENCODE_QUEUE_SPACE |
+        AS_EVENT_DECODE_QUEUE_SPACE |
+        AS_EVENT_PLAYBACK_QUEUE_SPACE);
+
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_media_queue_.Clear();
+    audio_testing_queue_.Clear();
+    NotifyTask(audio_output_task_handle_);
+    NotifyTask(opus_encode_task_handle_);
+    NotifyTask(opus_decode_task_handle_);
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+    return ReadAudioInto(data, sample_rate, samples);
+}
+
+/* Frames headed for the encoder are read straight into pooled buffers and moved from there on */
+bool AudioService::ReadAudioData(AudioPcm& data, int sample_rate, int samples) {
+    return ReadAudioInto(data, sample_rate, samples);
+}
+
+template <typename Pcm>
+bool AudioService::ReadAudioInto(Pcm& data, int sample_rate, int samples) {
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
@@ -207,24 +179,18 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 
     if (codec_->input_sample_rate() != sample_rate) {
         data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        if (!codec_->InputData(data.data(), data.size())) {
             return false;
         }
-        if (input_resampler_ != nullptr) {
+        if (input_resampler_) {
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
-            uint32_t in_sample_num = data.size() / codec_->input_channels();
-            uint32_t output_samples = 0;
-            esp_ae_rate_cvt_get_max_out_sample_num(input_resampler_, in_sample_num, &output_samples);
-            auto resampled = std::vector<int16_t>(output_samples * codec_->input_channels());
-            uint32_t actual_output = output_samples;
-            esp_ae_rate_cvt_process(input_resampler_, (esp_ae_sample_t)data.data(), in_sample_num,
-                                   (esp_ae_sample_t)resampled.data(), &actual_output);
-            resampled.resize(actual_output * codec_->input_channels());
-            data = std::move(resampled);
+            /* Resample into a scratch buffer that keeps its capacity, data already holds enough room for the result */
+            input_resampler_.Process(data.data(), data.size() / codec_->input_channels(), input_resample_buffer_);
+            data.assign(input_resample_buffer_.begin(), input_resample_buffer_.end());
         }
     } else {
         data.resize(samples * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        if (!codec_->InputData(data.data(), data.size())) {
             return false;
         }
     }
@@ -235,10 +201,8 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 
 #if CONFIG_USE_AUDIO_DEBUGGER
     // 音频调试：发送原始音频数据
-    if (audio_debugger_ == nullptr) {
-        audio_debugger_ = std::make_unique<AudioDebugger>();
-    }
-    audio_debugger_->Feed(data);
+    audio_debugger_->Feed(kAudioDebugTapMic, data,
+        input_resampler_ ? sample_rate : codec_->input_sample_rate(), codec_->input_channels());
 #endif
 
     return true;
@@ -261,17 +225,17 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.Full()) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
+            AudioPcm data;
             int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
+                    AudioPcm mono_data(data.size() / 2);
                     for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
                         mono_data[i] = data[j];
                     }
@@ -288,6 +252,12 @@ void AudioService::AudioInputTask() {
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    preroll_ring_.Write(data.data(), data.size());
+#if CONFIG_SEND_WAKE_WORD_DATA
+                    if (wake_word_encoding_) {
+                        PushWakeWordInput(data);
+                    }
+#endif
                     wake_word_->Feed(data);
                     continue;
                 }
@@ -296,11 +266,23 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
+            AudioPcm data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
+                uint8_t request = preroll_request_.exchange(kPrerollRequestNone);
+                if (request != kPrerollRequestNone) {
+                    preroll_replaying_ = request == kPrerollRequestReplay;
+                    preroll_cursor_ = wake_word_position_;
+                    preroll_replayed_ = 0;
+                }
                 if (ReadAudioData(data, 16000, samples)) {
-                    audio_processor_->Feed(std::move(data));
+                    preroll_ring_.Write(data.data(), data.size());
+                    last_feed_us_ = AudioLatencyTracer::Now();
+                    if (preroll_replaying_) {
+                        ReplayPreRoll(data.size());
+                    } else {
+                        audio_processor_->Feed(std::move(data));
+                    }
                     continue;
                 }
             }
@@ -313,161 +295,371 @@ void AudioService::AudioInputTask() {
     ESP_LOGW(TAG, "Audio input task stopped");
 }
 
+/* Queues the first input channel for encoding, dropped rather than stalling the wake word when the encoder lags */
+void AudioService::PushWakeWordInput(const std::vector<int16_t>& data) {
+    if (audio_encode_queue_.Full()) {
+        return;
+    }
+    int channels = codec_->input_channels();
+    AudioPcm mono(data.size() / channels);
+    for (size_t i = 0; i < mono.size(); i++) {
+        mono[i] = data[i * channels];
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_word_packets_mutex_);
+        wake_word_tasks_pending_++;
+    }
+    PushTaskToEncodeQueue(kAudioTaskTypeEncodeToWakeWordQueue, std::move(mono));
+}
+
+void AudioService::FinishWakeWordTask() {
+    std::lock_guard<std::mutex> lock(wake_word_packets_mutex_);
+    wake_word_tasks_pending_--;
+    wake_word_packets_cv_.notify_all();
+}
+
+/*
+ * Feeds the audio processor with what was captured since the wake word, including the live input
+ * written to the ring meanwhile. Called once per live chunk, it feeds only as much as the
+ * processor can queue, so the replay catches up at the processor's own speed without overflowing
+ * its input ring. Once the replay has caught up, live input is fed directly again.
+ */
+void AudioService::ReplayPreRoll(size_t chunk) {
+    /* Writes since the processor started are whole chunks, the oldest partial chunk is skipped */
+    uint32_t backlog = preroll_ring_.position() - preroll_cursor_;
+    if (backlog > preroll_ring_.capacity()) {
+        ESP_LOGW(TAG, "Pre-roll replay fell behind by %lu ms, resuming live input", backlog / codec_->input_channels() / 16);
+        preroll_replaying_ = false;
+        return;
+    }
+    preroll_cursor_ += backlog % chunk;
+    backlog -= backlog % chunk;
+
+    while (backlog > 0 && audio_processor_->CanFeed()) {
+        AudioPcm data(chunk);
+        if (preroll_ring_.Read(preroll_cursor_, data.data(), chunk) < chunk) {
+            break;
+        }
+        audio_processor_->Feed(std::move(data));
+        preroll_replayed_ += chunk;
+        backlog -= chunk;
+    }
+    if (backlog == 0) {
+        preroll_replaying_ = false;
+        ESP_LOGI(TAG, "Replayed %lu ms of audio after the wake word", preroll_replayed_ / codec_->input_channels() / 16);
+    }
+}
+
 void AudioService::AudioOutputTask() {
+    SpscRing<std::unique_ptr<AudioTask>>* queues[kAudioMixSourceCount] = { &audio_playback_queue_, &audio_media_queue_ };
+    std::unique_ptr<AudioTask> tasks[kAudioMixSourceCount];
+    size_t offsets[kAudioMixSourceCount] = {};
+    std::vector<int32_t> mix_buffer;
+    std::vector<int16_t> output;
+
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        /* Every source keeps its current task until all of it has been played */
+        for (int i = 0; i < kAudioMixSourceCount; i++) {
+            if (mixer_flush_pending_[i].exchange(false)) {
+                tasks[i].reset();
+            }
+            while (tasks[i] == nullptr || offsets[i] >= tasks[i]->pcm.size()) {
+                tasks[i].reset();
+                bool was_full = false;
+                bool popped = queues[i]->Pop(tasks[i], &was_full);
+                if (was_full && i == kAudioMixSourceVoice) {
+                    NotifyTask(opus_decode_task_handle_);
+                }
+                if (!popped) {
+                    break;
+                }
+                offsets[i] = 0;
+                latency_tracer_.Record(kLatencyStagePlaybackQueue, tasks[i]->enqueue_us);
+            }
+        }
+        SignalQueueEvent(AS_EVENT_PLAYBACK_QUEUE_SPACE);
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        /* Mix up to the end of the shortest task, a single source is played a whole task at a time */
+        const int16_t* inputs[kAudioMixSourceCount] = {};
+        size_t samples = 0;
+        for (int i = 0; i < kAudioMixSourceCount; i++) {
+            if (tasks[i] != nullptr) {
+                size_t remaining = tasks[i]->pcm.size() - offsets[i];
+                samples = samples == 0 ? remaining : std::min(samples, remaining);
+                inputs[i] = tasks[i]->pcm.data() + offsets[i];
+            }
+        }
+        if (samples == 0) {
+            /* Start the next stream without the EQ and limiter history of this one */
+            output_dsp_.Reset();
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            debug_statistics_.output_wakeups++;
+            continue;
+        }
 
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
-        codec_->OutputData(task->pcm);
+        if (mix_buffer.size() < samples) {
+            mix_buffer.resize(samples);
+            output.resize(samples);
+        }
+        mixer_.Mix(inputs, samples, mix_buffer.data());
+        output_dsp_.Process(mix_buffer.data(), samples, output.data());
+        uint32_t output_start = AudioLatencyTracer::Now();
+        codec_->OutputData(output.data(), samples);
+        latency_tracer_.Record(kLatencyStageOutput, output_start);
+#if CONFIG_USE_AUDIO_DEBUGGER
+        audio_debugger_->Feed(kAudioDebugTapSpeaker, output.data(), samples, codec_->output_sample_rate(), 1);
+#endif
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
 
+        auto& voice = tasks[kAudioMixSourceVoice];
+        if (voice != nullptr) {
+            latency_tracer_.OnResponseSample();
 #if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
-        }
+            /* Record the timestamp for server AEC */
+            if (offsets[kAudioMixSourceVoice] == 0 && voice->timestamp > 0) {
+                std::lock_guard<std::mutex> lock(timestamp_mutex_);
+                timestamp_queue_.push_back(voice->timestamp);
+            }
 #endif
+        }
+        for (int i = 0; i < kAudioMixSourceCount; i++) {
+            if (inputs[i] != nullptr) {
+                offsets[i] += samples;
+            }
+        }
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
+void AudioService::OpusDecodeTask() {
+    while (!service_stopped_) {
+        if (decoder_reset_pending_.exchange(false)) {
+            jitter_buffer_.Reset();
         }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_ != nullptr) {
-                task->pcm.resize(decoder_frame_size_);
-                esp_audio_dec_in_raw_t raw = {
-                    .buffer = (uint8_t *)(packet->payload.data()),
-                    .len = (uint32_t)(packet->payload.size()),
-                    .consumed = 0,
-                    .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
-                };
-                esp_audio_dec_out_frame_t out_frame = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(task->pcm.size() * sizeof(int16_t)),
-                    .decoded_size = 0,
-                };
-                esp_audio_dec_info_t dec_info = {};
-                std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-                auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
-                decoder_lock.unlock();
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    task->pcm.resize(out_frame.decoded_size / sizeof(int16_t));
-                    if (decoder_sample_rate_ != codec_->output_sample_rate() && output_resampler_ != nullptr) {
-                        uint32_t target_size = 0;
-                        esp_ae_rate_cvt_get_max_out_sample_num(output_resampler_, task->pcm.size(), &target_size);
-                        std::vector<int16_t> resampled(target_size);
-                        uint32_t actual_output = target_size;
-                        esp_ae_rate_cvt_process(output_resampler_, (esp_ae_sample_t)task->pcm.data(), task->pcm.size(),
-                                                (esp_ae_sample_t)resampled.data(), &actual_output);
-                        resampled.resize(actual_output);
-                        task->pcm = std::move(resampled);
-                    }
-                    lock.lock();
-                    audio_playback_queue_.push_back(std::move(task));
-                    audio_queue_cv_.notify_all();
-                    debug_statistics_.decode_count++;
-                } else {
-                    ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
-                    lock.lock();
-                }
-            } else {
-                ESP_LOGE(TAG, "Audio decoder is not configured");
-                lock.lock();
+        /* Drop packets flushed by ResetDecoder() so that producers waiting for space can continue */
+        if (audio_decode_queue_.Compact()) {
+            SignalQueueEvent(AS_EVENT_DECODE_QUEUE_SPACE);
+        }
+
+        /* Move arrived packets into the jitter buffer while it has room, or replay the testing queue once testing stopped */
+        int64_t now_ms = esp_timer_get_time() / 1000;
+        std::unique_ptr<AudioStreamPacket> packet;
+        while (!jitter_buffer_.Full()) {
+            if (audio_decode_queue_.Pop(packet)) {
+                SignalQueueEvent(AS_EVENT_DECODE_QUEUE_SPACE);
+            } else if (!jitter_buffer_.Empty() || (xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_TESTING_RUNNING) ||
+                       !audio_testing_queue_.Pop(packet)) {
+                break;
+            }
+            jitter_buffer_.Push(std::move(packet), now_ms);
+        }
+
+        int wait_ms = -1;
+        if (!audio_playback_queue_.Full()) {
+            auto result = jitter_buffer_.Pop(now_ms, packet, wait_ms);
+            if (result == AudioJitterBuffer::kPopPacket) {
+                latency_tracer_.Record(kLatencyStageJitter, packet->enqueue_us);
+                DecodePacket(packet.get());
+                continue;
+            } else if (result == AudioJitterBuffer::kPopLost) {
+                DecodePacket(nullptr);
+                debug_statistics_.conceal_count++;
+                continue;
             }
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms) + 1);
+        debug_statistics_.decoder_wakeups++;
+    }
+
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+void AudioService::DecodePacket(AudioStreamPacket* packet) {
+    uint32_t decode_start = AudioLatencyTracer::Now();
+    auto task = std::make_unique<AudioTask>();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    if (packet != nullptr) {
+        task->timestamp = packet->timestamp;
+        SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+    } else {
+        task->timestamp = 0;
+    }
+    if (opus_decoder_ != nullptr) {
+        task->pcm.resize(decoder_frame_size_);
+        /* Without a packet the decoder conceals the lost frame from its internal state */
+        static uint8_t plc_dummy = 0;
+        esp_audio_dec_in_raw_t raw = {
+            .buffer = packet != nullptr ? (uint8_t *)(packet->payload.data()) : &plc_dummy,
+            .len = packet != nullptr ? (uint32_t)(packet->payload.size()) : 0,
+            .consumed = 0,
+            .frame_recover = packet != nullptr ? ESP_AUDIO_DEC_RECOVERY_NONE : ESP_AUDIO_DEC_RECOVERY_PLC,
+        };
+        esp_audio_dec_out_frame_t out_frame = {
+            .buffer = (uint8_t *)(task->pcm.data()),
+            .len = (uint32_t)(task->pcm.size() * sizeof(int16_t)),
+            .decoded_size = 0,
+        };
+        esp_audio_dec_info_t dec_info = {};
+        std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
+        auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
+        decoder_lock.unlock();
+        if (ret == ESP_AUDIO_ERR_OK) {
+            task->pcm.resize(out_frame.decoded_size / sizeof(int16_t));
+            if (output_resampler_) {
+                AudioPcm resampled;
+                output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled);
+                task->pcm = std::move(resampled);
+            }
+            latency_tracer_.Record(kLatencyStageDecode, decode_start);
+#if CONFIG_USE_AUDIO_DEBUGGER
+            audio_debugger_->Feed(kAudioDebugTapDecoded, task->pcm.data(), task->pcm.size(),
+                output_resampler_ ? output_resampler_.dst_rate() : decoder_sample_rate_, 1);
+#endif
+            PushTaskToMixerQueue(kAudioMixSourceVoice, std::move(task), true);
             debug_statistics_.decode_count++;
+        } else {
+            ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
         }
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-
-            if (opus_encoder_ != nullptr && task->pcm.size() == encoder_frame_size_) {
-                std::vector<uint8_t> buf(encoder_outbuf_size_);
-                esp_audio_enc_in_frame_t in = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
-                };
-                esp_audio_enc_out_frame_t out = {
-                    .buffer = buf.data(),
-                    .len = (uint32_t)encoder_outbuf_size_,
-                    .encoded_bytes = 0,
-                };
-                auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    packet->payload.assign(buf.data(), buf.data() + out.encoded_bytes);
-
-                    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                        {
-                            std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                            audio_send_queue_.push_back(std::move(packet));
-                        }
-                        if (callbacks_.on_send_queue_available) {
-                            callbacks_.on_send_queue_available();
-                        }
-                    } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                        std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                        audio_testing_queue_.push_back(std::move(packet));
-                    }
-                    debug_statistics_.encode_count++;
-                } else {
-                    ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
-                }
-            } else {
-                ESP_LOGE(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %u, expected %u)",
-                         task->pcm.size(), encoder_frame_size_);
+    } else {
+        ESP_LOGE(TAG, "Audio decoder is not configured");
+    }
+}
+
+void AudioService::OpusEncodeTask() {
+    while (!service_stopped_) {
+        /* One processor block may become several packets when the encoder runs shorter frames */
+        size_t max_packets = OPUS_FRAME_DURATION_MS / encoder_duration_ms_ + 1;
+        std::unique_ptr<AudioTask> task;
+        if (audio_send_queue_.capacity() - audio_send_queue_.Size() < max_packets || !audio_encode_queue_.Pop(task)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            debug_statistics_.encoder_wakeups++;
+            continue;
+        }
+        SignalQueueEvent(AS_EVENT_ENCODE_QUEUE_SPACE);
+        latency_tracer_.Record(kLatencyStageEncodeQueue, task->enqueue_us);
+
+        if (task->type == kAudioTaskTypeEncodeToSendQueue &&
+            encoder_controller_.Update(audio_send_queue_.Size(), audio_send_queue_.capacity())) {
+            OpenEncoder();
+            if (callbacks_.on_encoder_frame_duration_changed) {
+                callbacks_.on_encoder_frame_duration_changed(encoder_duration_ms_);
             }
-            lock.lock();
+        }
+        if (opus_encoder_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to encode audio: encoder not configured");
+            if (task->type == kAudioTaskTypeEncodeToWakeWordQueue) {
+                FinishWakeWordTask();
+            }
+            continue;
+        }
+
+        /* Processors deliver OPUS_FRAME_DURATION_MS blocks, re-frame them to the current encoder frame size */
+        if (task->type != encode_pcm_type_) {
+            encode_pcm_buffer_.clear();
+            encode_pcm_type_ = task->type;
+        }
+        encode_pcm_buffer_.insert(encode_pcm_buffer_.end(), task->pcm.begin(), task->pcm.end());
+        uint32_t timestamp = task->timestamp;
+        size_t offset = 0;
+        while (encode_pcm_buffer_.size() - offset >= (size_t)encoder_frame_size_) {
+            EncodeFrame(encode_pcm_buffer_.data() + offset, task->type, timestamp);
+            offset += encoder_frame_size_;
+            timestamp = 0;
+        }
+        encode_pcm_buffer_.erase(encode_pcm_buffer_.begin(), encode_pcm_buffer_.begin() + offset);
+        if (task->type == kAudioTaskTypeEncodeToWakeWordQueue) {
+            FinishWakeWordTask();
         }
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    ESP_LOGW(TAG, "Opus encode task stopped");
+}
+
+void AudioService::EncodeFrame(const int16_t* pcm, AudioTaskType type, uint32_t timestamp) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->frame_duration = encoder_duration_ms_;
+    packet->sample_rate = 16000;
+    packet->timestamp = timestamp;
+
+    /* Encode straight into the pooled payload */
+    packet->payload.resize(encoder_outbuf_size_);
+    esp_audio_enc_in_frame_t in = {
+        .buffer = (uint8_t *)pcm,
+        .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
+    };
+    esp_audio_enc_out_frame_t out = {
+        .buffer = packet->payload.data(),
+        .len = (uint32_t)encoder_outbuf_size_,
+        .encoded_bytes = 0,
+    };
+    uint32_t encode_start = AudioLatencyTracer::Now();
+    auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        return;
+    }
+    packet->payload.resize(out.encoded_bytes);
+    packet->enqueue_us = AudioLatencyTracer::Now();
+    latency_tracer_.Record(kLatencyStageEncode, encode_start, packet->enqueue_us);
+
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        audio_send_queue_.Push(std::move(packet));
+        if (callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
+    } else if (type == kAudioTaskTypeEncodeToTestingQueue) {
+        /* Frames still in flight when testing stops are replayed by the decode task */
+        bool was_empty = false;
+        if (audio_testing_queue_.Push(std::move(packet), &was_empty) && was_empty) {
+            NotifyTask(opus_decode_task_handle_);
+        }
+    } else if (type == kAudioTaskTypeEncodeToWakeWordQueue) {
+        std::lock_guard<std::mutex> lock(wake_word_packets_mutex_);
+        wake_word_packets_.push_back(std::move(packet));
+        while (wake_word_packets_.size() > (size_t)(WAKE_WORD_UPLOAD_MS / encoder_duration_ms_)) {
+            wake_word_packets_.pop_front();
+        }
+    }
+    debug_statistics_.encode_count++;
+}
+
+void AudioService::OpenEncoder() {
+    if (opus_encoder_ != nullptr) {
+        esp_opus_enc_close(opus_encoder_);
+        opus_encoder_ = nullptr;
+    }
+    esp_opus_enc_config_t opus_enc_cfg = encoder_controller_.GetEncoderConfig();
+    auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
+    if (opus_encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+        return;
+    }
+    encoder_sample_rate_ = 16000;
+    encoder_duration_ms_ = encoder_controller_.profile().frame_duration_ms;
+    esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
+    encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+}
+
+void AudioService::ResetEncoderProfile(int rtt_ms) {
+    encoder_controller_.Reset(rtt_ms);
+}
+
+void AudioService::UpdateLinkQuality(int rtt_ms, int loss_percent) {
+    encoder_controller_.UpdateLink(rtt_ms, loss_percent);
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
@@ -490,91 +682,108 @@ void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     decoder_duration_ms_ = frame_duration;
     decoder_frame_size_ = decoder_sample_rate_ / 1000 * frame_duration;
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (decoder_sample_rate_ != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", decoder_sample_rate_, codec->output_sample_rate());
-        if (output_resampler_ != nullptr) {
-            esp_ae_rate_cvt_close(output_resampler_);
-            output_resampler_ = nullptr;
-        }
-        esp_ae_rate_cvt_cfg_t output_resampler_cfg = RATE_CVT_CFG(
-            decoder_sample_rate_, codec->output_sample_rate(), ESP_AUDIO_MONO);
-        auto resampler_ret = esp_ae_rate_cvt_open(&output_resampler_cfg, &output_resampler_);
-        if (output_resampler_ == nullptr) {
-            ESP_LOGE(TAG, "Failed to create output resampler, error code: %d", resampler_ret);
-        }
-    }
+    /* Switching back to a recent rate reuses its cached converter instead of opening a new one */
+    output_resampler_.Release();
+    output_resampler_ = ResamplerManager::GetInstance().Acquire(
+        decoder_sample_rate_, codec_->output_sample_rate(), ESP_AUDIO_MONO);
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, AudioPcm&& pcm) {
     auto task = std::make_unique<AudioTask>();
     task->type = type;
     task->pcm = std::move(pcm);
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    task->timestamp = 0;
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        std::lock_guard<std::mutex> lock(timestamp_mutex_);
+        if (!timestamp_queue_.empty()) {
+            if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
+                task->timestamp = timestamp_queue_.front();
+            } else {
+                ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+            }
+            timestamp_queue_.pop_front();
         }
-        timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue */
+    std::lock_guard<std::mutex> lock(encode_producer_mutex_);
+    WaitForQueueEvent(AS_EVENT_ENCODE_QUEUE_SPACE, [this]() {
+        return service_stopped_ || !audio_encode_queue_.Full();
+    });
+    bool was_empty = false;
+    task->enqueue_us = AudioLatencyTracer::Now();
+    if (audio_encode_queue_.Push(std::move(task), &was_empty) && was_empty) {
+        NotifyTask(opus_encode_task_handle_);
+    }
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+    std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+    if (audio_decode_queue_.Full()) {
+        if (!wait) {
             return false;
         }
+        WaitForQueueEvent(AS_EVENT_DECODE_QUEUE_SPACE, [this]() {
+            return service_stopped_ || !audio_decode_queue_.Full();
+        });
+    }
+    bool was_empty = false;
+    packet->enqueue_us = AudioLatencyTracer::Now();
+    if (!audio_decode_queue_.Push(std::move(packet), &was_empty)) {
+        return false;
+    }
+    if (was_empty) {
+        NotifyTask(opus_decode_task_handle_);
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
     return true;
 }
 
-bool AudioService::PushPcmToPlaybackQueue(std::vector<int16_t>&& pcm, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_playback_queue_.size() >= MAX_PLAYBACK_TASKS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE; });
-        } else {
-            return false;
-        }
-    }
+bool AudioService::PushPcmToPlaybackQueue(AudioPcm&& pcm, bool wait) {
     auto task = std::make_unique<AudioTask>();
     task->type = kAudioTaskTypeDecodeToPlaybackQueue;
     task->pcm = std::move(pcm);
     task->timestamp = 0;
-    audio_playback_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    return PushTaskToMixerQueue(kAudioMixSourceMedia, std::move(task), wait);
+}
+
+bool AudioService::PushTaskToMixerQueue(AudioMixSource source, std::unique_ptr<AudioTask>&& task, bool wait) {
+    auto& queue = source == kAudioMixSourceVoice ? audio_playback_queue_ : audio_media_queue_;
+    std::lock_guard<std::mutex> lock(source == kAudioMixSourceVoice ? playback_producer_mutex_ : media_producer_mutex_);
+    if (queue.Full()) {
+        if (!wait) {
+            return false;
+        }
+        WaitForQueueEvent(AS_EVENT_PLAYBACK_QUEUE_SPACE, [this, &queue]() {
+            return service_stopped_ || !queue.Full();
+        });
+    }
+    bool was_empty = false;
+    task->enqueue_us = AudioLatencyTracer::Now();
+    if (!queue.Push(std::move(task), &was_empty)) {
+        return false;
+    }
+    if (was_empty) {
+        NotifyTask(audio_output_task_handle_);
+    }
     return true;
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+    std::unique_ptr<AudioStreamPacket> packet;
+    /* The encoder may be waiting for room for several packets, not only for a full queue to drain */
+    if (audio_send_queue_.Pop(packet)) {
+        latency_tracer_.Record(kLatencyStageSendQueue, packet->enqueue_us);
+        if (!audio_encode_queue_.Empty()) {
+            NotifyTask(opus_encode_task_handle_);
+        }
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
 void AudioService::EncodeWakeWord() {
-    if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
-    }
+    wake_word_encoding_ = false;
 }
 
 const std::string& AudioService::GetLastWakeWord() const {
@@ -582,14 +791,30 @@ const std::string& AudioService::GetLastWakeWord() const {
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
-    if (wake_word_->GetWakeWordOpus(packet->payload)) {
-        return packet;
+    std::unique_lock<std::mutex> lock(wake_word_packets_mutex_);
+    /* Input queued before the detection is at most a few frames away from being encoded */
+    wake_word_packets_cv_.wait_for(lock, std::chrono::milliseconds(500), [this]() {
+        return wake_word_tasks_pending_ <= 0;
+    });
+    if (wake_word_packets_.empty()) {
+        return nullptr;
     }
-    return nullptr;
+    auto packet = std::move(wake_word_packets_.front());
+    wake_word_packets_.pop_front();
+    return packet;
 }
 
 void AudioService::EnableWakeWordDetection(bool enable) {
+    std::lock_guard<std::mutex> lock(harness_mutex_);
+    if (harness_running_) {
+        /* Applied when the harness run ends */
+        harness_wake_word_ = enable;
+        return;
+    }
+    SetWakeWordDetection(enable);
+}
+
+void AudioService::SetWakeWordDetection(bool enable) {
     if (!wake_word_) {
         return;
     }
@@ -607,19 +832,44 @@ void AudioService::EnableWakeWordDetection(bool enable) {
         // This prevents buffer overflow when switching between different feed sizes
         {
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
-            if (input_resampler_ != nullptr) {
-                esp_ae_rate_cvt_reset(input_resampler_);
-            }
+            input_resampler_.Reset();
+        }
+        preroll_pending_ = false;
+#if CONFIG_USE_AUDIO_PROCESSOR && !CONFIG_USE_DEVICE_AEC
+        /* Only the AFE processor runs a VAD, without it there is nothing to confirm a detection */
+        if (wake_word_unconfirmed_.exchange(false)) {
+            wake_word_->profiler().RecordUnconfirmed(wake_word_->GetLastDetectedWakeWord());
+        }
+#endif
+#if CONFIG_SEND_WAKE_WORD_DATA
+        {
+            std::lock_guard<std::mutex> lock(wake_word_packets_mutex_);
+            wake_word_packets_.clear();
         }
+        wake_word_encoding_ = true;
+#endif
         wake_word_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     } else {
+        wake_word_encoding_ = false;
         wake_word_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     }
 }
 
 void AudioService::EnableVoiceProcessing(bool enable) {
+    std::unique_lock<std::mutex> lock(harness_mutex_);
+    if (harness_running_) {
+        if (!enable) {
+            /* The harness has the processor, voice processing is already off */
+            return;
+        }
+        /* Listening takes precedence, the harness stops within one feed chunk */
+        ESP_LOGW(TAG, "Interrupting the processor harness");
+        harness_abort_ = true;
+        harness_cv_.wait(lock, [this]() { return !harness_running_; });
+    }
+
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
@@ -629,14 +879,20 @@ void AudioService::EnableVoiceProcessing(bool enable) {
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        bool after_wake_word = preroll_pending_.exchange(false);
+        wake_word_unconfirmed_ = after_wake_word;
+        if (after_wake_word && preroll_ring_.capacity() > 0) {
+            /* Speech right after the wake word is replayed from the pre-roll ring instead of being lost to the warmup */
+            preroll_request_ = kPrerollRequestReplay;
+        } else {
+            preroll_request_ = kPrerollRequestCancel;
+            audio_input_need_warmup_ = true;
+        }
         // Reset input resampler to clear cached data from previous mode (e.g. WakeWord)
         // This prevents buffer overflow when switching between different feed sizes
         {
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
-            if (input_resampler_ != nullptr) {
-                esp_ae_rate_cvt_reset(input_resampler_);
-            }
+            input_resampler_.Reset();
         }
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
@@ -646,16 +902,48 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     }
 }
 
+bool AudioService::RunProcessorHarness(AudioProcessorHarness& harness, const int16_t* pcm, size_t frames) {
+    {
+        std::lock_guard<std::mutex> lock(harness_mutex_);
+        if (harness_running_ || IsAudioProcessorRunning()) {
+            ESP_LOGE(TAG, "Voice processing or another harness run is active");
+            return false;
+        }
+        if (!audio_processor_initialized_) {
+            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_initialized_ = true;
+        }
+        /* A detection would start listening on the borrowed processor, pause the wake word for the run */
+        harness_wake_word_ = IsWakeWordRunning();
+        if (harness_wake_word_) {
+            SetWakeWordDetection(false);
+        }
+        harness_abort_ = false;
+        harness_running_ = true;
+    }
+
+    bool ok = harness.Run(*audio_processor_, pcm, frames, &harness_abort_);
+    BindAudioProcessor();
+
+    {
+        std::lock_guard<std::mutex> lock(harness_mutex_);
+        harness_running_ = false;
+        if (harness_wake_word_) {
+            SetWakeWordDetection(true);
+        }
+    }
+    harness_cv_.notify_all();
+    return ok;
+}
+
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
     if (enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* The opus decode task plays back audio_testing_queue_ once the testing bit is cleared */
+        ResetDecoder();
     }
 }
 
@@ -680,120 +968,81 @@ void AudioService::PlaySound(const std::string_view& ogg) {
         codec_->EnableOutput(true);
     }
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
-
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
-        }
-        return static_cast<size_t>(-1);
-    };
-
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
-
-    while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) |
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d",
-                                   version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
-            }
-
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
+    /* Embedded and flash-mapped sounds outlive playback, so packets borrow them instead of copying */
+    OggDemuxer demuxer([this](const OggDemuxer::Packet& ogg_packet) {
+        auto packet = std::make_unique<AudioStreamPacket>();
+        packet->sample_rate = ogg_packet.sample_rate;
+        packet->frame_duration = ogg_packet.frame_duration;
+        if (ogg_packet.in_input) {
+            packet->payload = AudioPayload::View(ogg_packet.data, ogg_packet.size);
+        } else {
+            packet->payload.assign(ogg_packet.data, ogg_packet.data + ogg_packet.size);
         }
-
-        offset = body_off + body_size;
-    }
+        PushPacketToDecodeQueue(std::move(packet), true);
+    });
+    demuxer.Feed(reinterpret_cast<const uint8_t*>(ogg.data()), ogg.size());
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.Empty() && audio_decode_queue_.Empty() && jitter_buffer_.Empty() &&
+        audio_playback_queue_.Empty() && audio_media_queue_.Empty() && audio_testing_queue_.Empty();
 }
 
 void AudioService::WaitForPlaybackQueueEmpty() {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    audio_queue_cv_.wait(lock, [this]() { 
-        return service_stopped_ || (audio_decode_queue_.empty() && audio_playback_queue_.empty()); 
+    WaitForQueueEvent(AS_EVENT_PLAYBACK_QUEUE_SPACE, [this]() {
+        return service_stopped_ || (audio_decode_queue_.Empty() && jitter_buffer_.Empty() && audio_playback_queue_.Empty());
     });
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
     if (opus_decoder_ != nullptr) {
         esp_opus_dec_reset(opus_decoder_);
     }
     decoder_lock.unlock();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    decoder_reset_pending_ = true;
+    {
+        std::lock_guard<std::mutex> lock(timestamp_mutex_);
+        timestamp_queue_.clear();
+    }
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    mixer_flush_pending_[kAudioMixSourceVoice] = true;
+    if (xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_TESTING_RUNNING) {
+        audio_testing_queue_.Clear();
+    }
+    /* The consumers drop the flushed entries and wake up any producer waiting for space */
+    NotifyTask(audio_output_task_handle_);
+    NotifyTask(opus_decode_task_handle_);
+}
+
+void AudioService::ResetMedia() {
+    audio_media_queue_.Clear();
+    mixer_flush_pending_[kAudioMixSourceMedia] = true;
+    NotifyTask(audio_output_task_handle_);
+}
+
+void AudioService::WaitForQueueEvent(EventBits_t bit, const std::function<bool()>& ready) {
+    while (!ready()) {
+        queue_waiters_.fetch_add(1);
+        xEventGroupClearBits(event_group_, bit);
+        if (!ready()) {
+            xEventGroupWaitBits(event_group_, bit, pdTRUE, pdFALSE, pdMS_TO_TICKS(AS_QUEUE_WAIT_SLICE_MS));
+        }
+        queue_waiters_.fetch_sub(1);
+    }
+}
+
+void AudioService::SignalQueueEvent(EventBits_t bit) {
+    if (queue_waiters_.load() > 0) {
+        xEventGroupSetBits(event_group_, bit);
+    }
+}
+
+void AudioService::NotifyTask(TaskHandle_t task) {
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -832,6 +1081,9 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+            wake_word_position_ = preroll_ring_.position();
+            preroll_pending_ = true;
+            wake_word_encoding_ = false;
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
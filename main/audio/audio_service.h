@@ -3,9 +3,11 @@
 
 #include <memory>
 #include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -20,27 +22,49 @@
 
 #include "audio_codec.h"
 #include "audio_processor.h"
+#include "audio_processor_harness.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
+#include "spsc_ring.h"
+#include "audio_frame_pool.h"
+#include "audio_jitter_buffer.h"
+#include "audio_encoder_controller.h"
+#include "audio_latency_tracer.h"
+#include "ogg_demuxer.h"
+#include "pcm_ring_buffer.h"
+#include "resampler_manager.h"
+#include "audio_mixer.h"
+#include "audio_output_dsp.h"
 
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ *    While the wake word runs, its input also goes through the Opus Encoder into the wake word packets,
+ *    so the upload is already encoded when the wake word is detected.
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> [Mixer] -> [Output DSP] -> (Speaker)
+ *    Radio and music PCM goes through {Media Queue} into the same mixer, ducked while voice plays.
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Speaker / Processors, and separate tasks for the Opus Encoder and the Opus Decoder,
+ * so that in realtime mode a slow encode never delays playback and vice versa.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
- * 
+ *
+ * Every queue is a bounded SPSC ring. Consumers sleep on their own task notification and are only
+ * woken when a queue goes from empty to non-empty (or from full to non-full), so the tasks no
+ * longer wake each other up on every frame. Queues with more than one producer (decode, playback
+ * and media) serialize their producers with a producer-only mutex that consumers never touch.
  */
 
 #define OPUS_FRAME_DURATION_MS 60
 #define MAX_ENCODE_TASKS_IN_QUEUE 4
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
+#define MAX_MEDIA_TASKS_IN_QUEUE 4
 #define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+// Audio before the wake word detection that is uploaded for speaker recognition
+#define WAKE_WORD_UPLOAD_MS 2000
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
 
@@ -51,6 +75,12 @@
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_ENCODE_QUEUE_SPACE         (1 << 4)
+#define AS_EVENT_DECODE_QUEUE_SPACE         (1 << 5)
+#define AS_EVENT_PLAYBACK_QUEUE_SPACE       (1 << 6)
+
+// Upper bound for a producer waiting on a queue event, the wait is re-checked after each slice
+#define AS_QUEUE_WAIT_SLICE_MS 100
 
 #define AS_OPUS_GET_FRAME_DRU_ENUM(duration_ms)                   \
     ((duration_ms) == 5 ? ESP_OPUS_ENC_FRAME_DURATION_5_MS :      \
@@ -62,6 +92,26 @@
      (duration_ms) == 100 ? ESP_OPUS_ENC_FRAME_DURATION_100_MS :  \
      (duration_ms) == 120 ? ESP_OPUS_ENC_FRAME_DURATION_120_MS : -1)
 
+#define RATE_CVT_CFG(_src_rate, _dest_rate, _channel)        \
+    (esp_ae_rate_cvt_cfg_t)                                  \
+    {                                                        \
+        .src_rate        = (uint32_t)(_src_rate),            \
+        .dest_rate       = (uint32_t)(_dest_rate),           \
+        .channel         = (uint8_t)(_channel),              \
+        .bits_per_sample = ESP_AUDIO_BIT16,                  \
+        .complexity      = 2,                                \
+        .perf_type       = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,  \
+    }
+
+#define OPUS_DEC_CFG(_sample_rate, _frame_duration_ms)                                                    \
+    (esp_opus_dec_cfg_t)                                                                                  \
+    {                                                                                                     \
+        .sample_rate    = (uint32_t)(_sample_rate),                                                       \
+        .channel        = ESP_AUDIO_MONO,                                                                 \
+        .frame_duration = (esp_opus_dec_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(_frame_duration_ms),  \
+        .self_delimited = false,                                                                          \
+    }
+
 #define AS_OPUS_ENC_CONFIG() {                                                                                    \
         .sample_rate        = ESP_AUDIO_SAMPLE_RATE_16K,                                                          \
         .channel            = ESP_AUDIO_MONO,                                                                     \
@@ -80,19 +130,25 @@ struct AudioServiceCallbacks {
     std::function<void(const std::string&)> on_wake_word_detected;
     std::function<void(bool)> on_vad_change;
     std::function<void(void)> on_audio_testing_queue_full;
+    std::function<void(int)> on_encoder_frame_duration_changed;
 };
 
 
 enum AudioTaskType {
     kAudioTaskTypeEncodeToSendQueue,
     kAudioTaskTypeEncodeToTestingQueue,
+    kAudioTaskTypeEncodeToWakeWordQueue,
     kAudioTaskTypeDecodeToPlaybackQueue,
 };
 
 struct AudioTask {
     AudioTaskType type;
-    std::vector<int16_t> pcm;
+    AudioPcm pcm;
     uint32_t timestamp;
+    uint32_t enqueue_us = 0;  // Latency tracing, when the task entered its current queue
+
+    static void* operator new(size_t size) { return AudioFrameAllocator<uint8_t>().allocate(size); }
+    static void operator delete(void* ptr) { AudioFramePool::GetInstance().Free(ptr); }
 };
 
 struct DebugStatistics {
@@ -100,6 +156,10 @@ struct DebugStatistics {
     uint32_t decode_count = 0;
     uint32_t encode_count = 0;
     uint32_t playback_count = 0;
+    uint32_t output_wakeups = 0;
+    uint32_t encoder_wakeups = 0;
+    uint32_t decoder_wakeups = 0;
+    uint32_t conceal_count = 0;
 };
 
 class AudioService {
@@ -110,6 +170,7 @@ public:
     void Initialize(AudioCodec* codec);
     void Start();
     void Stop();
+    /* Stops encoding wake word input, PopWakeWordPacket() then returns the audio leading up to this call */
     void EncodeWakeWord();
     std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
@@ -124,15 +185,35 @@ public:
     void EnableVoiceProcessing(bool enable);
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
+    /*
+     * Replays a recording through the audio processor, only while voice processing is off. Wake
+     * word detection is paused for the run, EnableWakeWordDetection() calls made meanwhile are
+     * applied when it ends, and EnableVoiceProcessing(true) interrupts it.
+     */
+    bool RunProcessorHarness(AudioProcessorHarness& harness, const int16_t* pcm, size_t frames);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    bool PushPcmToPlaybackQueue(std::vector<int16_t>&& pcm, bool wait = false);
+    /* Plays PCM at the codec output rate on the media source, ducked while voice plays */
+    bool PushPcmToPlaybackQueue(AudioPcm&& pcm, bool wait = false);
+    /* Drops the queued media PCM, for players that stop before the end of their stream */
+    void ResetMedia();
+    AudioMixer& GetMixer() { return mixer_; }
+    AudioOutputDsp& GetOutputDsp() { return output_dsp_; }
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    size_t GetSendQueueSize() const { return audio_send_queue_.Size(); }
+    /* Frame duration of the current encoder profile, the duration of newly queued packets */
+    int GetEncoderFrameDuration() const { return encoder_duration_ms_; }
+    /* Plays an Ogg/Opus sound, the data must stay valid until it has been played */
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
+    bool ReadAudioData(AudioPcm& data, int sample_rate, int samples);
     void ResetDecoder();
+    void ResetEncoderProfile(int rtt_ms);
+    void UpdateLinkQuality(int rtt_ms, int loss_percent);
+    AudioLatencyTracer& GetLatencyTracer() { return latency_tracer_; }
+    WakeWordProfiler* GetWakeWordProfiler() { return wake_word_ ? &wake_word_->profiler() : nullptr; }
     void SetModelsList(srmodel_list_t* models_list);
 
 private:
@@ -145,13 +226,17 @@ private:
     void* opus_decoder_ = nullptr;
     std::mutex decoder_mutex_;
     std::mutex input_resampler_mutex_;
-    esp_ae_rate_cvt_handle_t input_resampler_ = nullptr;
-    esp_ae_rate_cvt_handle_t output_resampler_ = nullptr;
+    ResamplerManager::Resampler input_resampler_;
+    ResamplerManager::Resampler output_resampler_;
+    std::vector<int16_t> input_resample_buffer_;
     
     // Encoder/Decoder state
     int encoder_sample_rate_ = 16000;
-    int encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    std::atomic<int> encoder_duration_ms_{OPUS_FRAME_DURATION_MS};  // Written by the encode task
     int encoder_frame_size_ = 0;
+    AudioEncoderController encoder_controller_;
+    std::vector<int16_t> encode_pcm_buffer_;
+    AudioTaskType encode_pcm_type_ = kAudioTaskTypeEncodeToSendQueue;
     int encoder_outbuf_size_ = 0;
     int decoder_sample_rate_ = 0;
     int decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
@@ -164,15 +249,31 @@ private:
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    SpscRing<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_{MAX_DECODE_PACKETS_IN_QUEUE};
+    SpscRing<std::unique_ptr<AudioStreamPacket>> audio_send_queue_{MAX_SEND_PACKETS_IN_QUEUE};
+    SpscRing<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_{AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS};
+    SpscRing<std::unique_ptr<AudioTask>> audio_encode_queue_{MAX_ENCODE_TASKS_IN_QUEUE};
+    SpscRing<std::unique_ptr<AudioTask>> audio_playback_queue_{MAX_PLAYBACK_TASKS_IN_QUEUE};
+    SpscRing<std::unique_ptr<AudioTask>> audio_media_queue_{MAX_MEDIA_TASKS_IN_QUEUE};
+    std::mutex encode_producer_mutex_;
+    std::mutex decode_producer_mutex_;
+    std::mutex playback_producer_mutex_;
+    std::mutex media_producer_mutex_;
+    /* Owned by the audio output task, other tasks ask it to drop a source's current task */
+    AudioMixer mixer_;
+    AudioOutputDsp output_dsp_;
+    std::atomic<bool> mixer_flush_pending_[kAudioMixSourceCount] = {};
+    std::atomic<int> queue_waiters_{0};
+    AudioLatencyTracer latency_tracer_;
+    std::atomic<uint32_t> last_feed_us_{0};
+
+    /* Owned by the opus decode task, other tasks request a reset through decoder_reset_pending_ */
+    AudioJitterBuffer jitter_buffer_;
+    std::atomic<bool> decoder_reset_pending_{false};
     // For server AEC
+    std::mutex timestamp_mutex_;
     std::deque<uint32_t> timestamp_queue_;
 
     bool wake_word_initialized_ = false;
@@ -181,14 +282,59 @@ private:
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
 
+    /* Every input frame (16kHz, all input channels) passes through the pre-roll ring, so the
+     * audio spoken right after the wake word can be replayed to the audio processor */
+    PcmRingBuffer preroll_ring_;
+    std::atomic<uint32_t> wake_word_position_{0};
+    std::atomic<bool> preroll_pending_{false};
+    /* Set by EnableVoiceProcessing(), taken by the input task */
+    enum PrerollRequest : uint8_t { kPrerollRequestNone, kPrerollRequestReplay, kPrerollRequestCancel };
+    std::atomic<uint8_t> preroll_request_{kPrerollRequestNone};
+    /* Owned by the input task: live input queues in the ring behind the replay until it catches up */
+    bool preroll_replaying_ = false;
+    uint32_t preroll_cursor_ = 0;
+    uint32_t preroll_replayed_ = 0;
+    // Listening after a wake word, and the VAD has not heard speech yet
+    std::atomic<bool> wake_word_unconfirmed_{false};
+
+    /* The last WAKE_WORD_UPLOAD_MS of wake word input, encoded by the opus encode task as it is
+     * captured. Encoding stops on detection, which freezes the packets for PopWakeWordPacket() */
+    std::atomic<bool> wake_word_encoding_{false};
+    std::mutex wake_word_packets_mutex_;
+    std::condition_variable wake_word_packets_cv_;
+    std::deque<std::unique_ptr<AudioStreamPacket>> wake_word_packets_;
+    int wake_word_tasks_pending_ = 0;  // Wake word input still in the encode queue
+
+    /* Serializes the processor harness with EnableVoiceProcessing() / EnableWakeWordDetection() */
+    std::mutex harness_mutex_;
+    std::condition_variable harness_cv_;
+    bool harness_running_ = false;
+    bool harness_wake_word_ = false;  // Wake word state to restore after the run
+    std::atomic<bool> harness_abort_{false};
+
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void OpusEncodeTask();
+    void OpusDecodeTask();
+    void DecodePacket(AudioStreamPacket* packet);
+    void EncodeFrame(const int16_t* pcm, AudioTaskType type, uint32_t timestamp);
+    void OpenEncoder();
+    void BindAudioProcessor();
+    void SetWakeWordDetection(bool enable);
+    void ReplayPreRoll(size_t chunk);
+    void PushWakeWordInput(const std::vector<int16_t>& data);
+    void FinishWakeWordTask();
+    void PushTaskToEncodeQueue(AudioTaskType type, AudioPcm&& pcm);
+    template <typename Pcm>
+    bool ReadAudioInto(Pcm& data, int sample_rate, int samples);
+    bool PushTaskToMixerQueue(AudioMixSource source, std::unique_ptr<AudioTask>&& task, bool wait);
+    void WaitForQueueEvent(EventBits_t bit, const std::function<bool()>& ready);
+    void SignalQueueEvent(EventBits_t bit);
+    void NotifyTask(TaskHandle_t task);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
 };
@@ -0,0 +1,190 @@
+#include "ogg_demuxer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <esp_log.h>
+
+#define TAG "OggDemuxer"
+
+#define OGG_PAGE_HEADER_SIZE 27
+#define OGG_HEADER_TYPE_CONTINUED 0x01
+#define OPUS_GRANULE_RATE 48000
+
+OggDemuxer::OggDemuxer(std::function<void(const Packet& packet)> on_packet) : on_packet_(on_packet) {
+}
+
+void OggDemuxer::Reset() {
+    page_buffer_.clear();
+    packet_buffer_.clear();
+    seen_head_ = false;
+    seen_tags_ = false;
+    sample_rate_ = 16000;
+    frame_duration_ = 60;
+    last_granule_ = 0;
+}
+
+/* Size of the page at data, 0 if the header or segment table is not complete yet */
+size_t OggDemuxer::PageSize(const uint8_t* data, size_t size) {
+    if (size < OGG_PAGE_HEADER_SIZE) {
+        return 0;
+    }
+    size_t segments = data[26];
+    if (size < OGG_PAGE_HEADER_SIZE + segments) {
+        return 0;
+    }
+    size_t body_size = 0;
+    for (size_t i = 0; i < segments; i++) {
+        body_size += data[OGG_PAGE_HEADER_SIZE + i];
+    }
+    return OGG_PAGE_HEADER_SIZE + segments + body_size;
+}
+
+void OggDemuxer::Feed(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        if (!page_buffer_.empty()) {
+            /* Complete the page left over from the previous chunk, header first */
+            size_t buffered = page_buffer_.size();
+            if (memcmp(page_buffer_.data(), "OggS", buffered < 4 ? buffered : 4) != 0) {
+                /* A false capture pattern, the real one may start inside the buffered bytes */
+                page_buffer_.erase(page_buffer_.begin(), std::find(page_buffer_.begin() + 1, page_buffer_.end(), 'O'));
+                continue;
+            }
+            size_t page_size = PageSize(page_buffer_.data(), buffered);
+            size_t want;
+            if (buffered < 4) {
+                /* Check the capture pattern before taking more, so a false one cannot swallow the next page */
+                want = 4 - buffered;
+            } else if (page_size == 0) {
+                want = (buffered < OGG_PAGE_HEADER_SIZE ? OGG_PAGE_HEADER_SIZE : OGG_PAGE_HEADER_SIZE + page_buffer_[26]) - buffered;
+            } else {
+                want = page_size - buffered;
+            }
+            size_t take = want < size ? want : size;
+            page_buffer_.insert(page_buffer_.end(), data, data + take);
+            data += take;
+            size -= take;
+            if (page_size != 0 && page_buffer_.size() == page_size) {
+                ParsePage(page_buffer_.data(), false);
+                page_buffer_.clear();
+            }
+            continue;
+        }
+
+        /* Sync to the next capture pattern */
+        const uint8_t* page = nullptr;
+        const uint8_t* p = data;
+        const uint8_t* end = data + size;
+        while ((p = (const uint8_t*)memchr(p, 'O', end - p)) != nullptr) {
+            size_t left = end - p;
+            if (memcmp(p, "OggS", left < 4 ? left : 4) == 0) {
+                page = p;
+                break;
+            }
+            p++;
+        }
+        if (page == nullptr) {
+            return;
+        }
+        size -= page - data;
+        data = page;
+
+        size_t page_size = PageSize(data, size);
+        if (page_size == 0 || page_size > size) {
+            page_buffer_.assign(data, data + size);
+            return;
+        }
+        ParsePage(data, true);
+        data += page_size;
+        size -= page_size;
+    }
+}
+
+void OggDemuxer::ParsePage(const uint8_t* page, bool in_input) {
+    uint8_t header_type = page[5];
+    int64_t granule = 0;
+    for (int i = 7; i >= 0; i--) {
+        granule = (granule << 8) | page[6 + i];
+    }
+    size_t segments = page[26];
+    const uint8_t* lacing = page + OGG_PAGE_HEADER_SIZE;
+    const uint8_t* body = lacing + segments;
+
+    /* A continued packet whose start was lost (resync, seek) is dropped */
+    bool skip_first = (header_type & OGG_HEADER_TYPE_CONTINUED) && packet_buffer_.empty();
+    if (!(header_type & OGG_HEADER_TYPE_CONTINUED)) {
+        packet_buffer_.clear();
+    }
+
+    int completed = 0;
+    for (size_t i = 0; i < segments; i++) {
+        if (lacing[i] < 255) {
+            completed++;
+        }
+    }
+    if (completed > 0 && granule >= 0 && last_granule_ >= 0 && granule > last_granule_) {
+        int64_t delta = granule - last_granule_;
+        int64_t samples = delta / completed;
+        int duration = (int)(samples * 1000 / OPUS_GRANULE_RATE);
+        if (samples * completed == delta && samples * 1000 == (int64_t)duration * OPUS_GRANULE_RATE &&
+            (duration == 5 || duration == 10 || duration == 20 || duration == 40 || duration == 60 ||
+             duration == 80 || duration == 100 || duration == 120)) {
+            frame_duration_ = duration;
+        }
+    }
+    if (completed > 0) {
+        last_granule_ = granule;
+    }
+
+    size_t start = 0;
+    size_t length = 0;
+    for (size_t i = 0; i < segments; i++) {
+        length += lacing[i];
+        if (lacing[i] == 255) {
+            continue;
+        }
+        if (skip_first) {
+            skip_first = false;
+        } else if (!packet_buffer_.empty()) {
+            packet_buffer_.insert(packet_buffer_.end(), body + start, body + start + length);
+            OnPacket(packet_buffer_.data(), packet_buffer_.size(), false);
+            packet_buffer_.clear();
+        } else {
+            OnPacket(body + start, length, in_input);
+        }
+        start += length;
+        length = 0;
+    }
+    if (length > 0 && !skip_first) {
+        packet_buffer_.insert(packet_buffer_.end(), body + start, body + start + length);
+    }
+}
+
+void OggDemuxer::OnPacket(const uint8_t* data, size_t size, bool in_input) {
+    if (size == 0) {
+        return;
+    }
+    if (!seen_head_) {
+        // OpusHead: [0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip,
+        // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
+        if (size >= 19 && memcmp(data, "OpusHead", 8) == 0) {
+            seen_head_ = true;
+            sample_rate_ = data[12] | (data[13] << 8) | (data[14] << 16) | (data[15] << 24);
+            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", data[8], data[9], sample_rate_);
+        }
+        return;
+    }
+    if (!seen_tags_) {
+        if (size >= 8 && memcmp(data, "OpusTags", 8) == 0) {
+            seen_tags_ = true;
+        }
+        return;
+    }
+    on_packet_(Packet{
+        .data = data,
+        .size = size,
+        .sample_rate = sample_rate_,
+        .frame_duration = frame_duration_,
+        .in_input = in_input,
+    });
+}
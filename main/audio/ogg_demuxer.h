@@ -0,0 +1,60 @@
+#ifndef OGG_DEMUXER_H
+#define OGG_DEMUXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * Incremental Ogg/Opus demuxer.
+ *
+ * Feed() accepts the stream in chunks of any size (a whole flash-mapped asset, HTTP body pieces,
+ * file reads). Complete pages are parsed in place and their packets are handed out as views into
+ * the caller's chunk; only pages split across chunks and packets continued across pages are
+ * assembled in an internal buffer.
+ *
+ * Frame durations come from the granule positions: the samples a page adds are split over the
+ * packets completed in it. Pages that do not divide evenly (the trimmed last page) keep the
+ * previous duration.
+ */
+class OggDemuxer {
+public:
+    struct Packet {
+        const uint8_t* data;
+        size_t size;
+        int sample_rate;     // From OpusHead
+        int frame_duration;  // Milliseconds
+        bool in_input;       // data points into the chunk passed to Feed(), otherwise it is only valid during the callback
+    };
+
+    explicit OggDemuxer(std::function<void(const Packet& packet)> on_packet);
+
+    void Feed(const uint8_t* data, size_t size);
+    void Reset();
+
+    int sample_rate() const { return sample_rate_; }
+
+private:
+    struct PacketRef {
+        const uint8_t* data;
+        size_t size;
+        bool in_input;
+    };
+
+    std::function<void(const Packet& packet)> on_packet_;
+    std::vector<uint8_t> page_buffer_;    // Page split across Feed() calls
+    std::vector<uint8_t> packet_buffer_;  // Packet continued across pages
+    std::vector<PacketRef> page_packets_;
+    bool seen_head_ = false;
+    bool seen_tags_ = false;
+    int sample_rate_ = 16000;
+    int frame_duration_ = 60;
+    int64_t last_granule_ = 0;
+
+    static size_t PageSize(const uint8_t* data, size_t size);
+    void ParsePage(const uint8_t* page, bool in_input);
+    void OnPacket(const uint8_t* data, size_t size, bool in_input);
+};
+
+#endif // OGG_DEMUXER_H
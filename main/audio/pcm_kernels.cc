@@ -0,0 +1,56 @@
+#include "pcm_kernels.h"
+
+static inline int16_t Saturate16(int32_t value) {
+    value = value > INT16_MAX ? INT16_MAX : value;
+    value = value < -INT16_MAX ? -INT16_MAX : value;
+    return (int16_t)value;
+}
+
+int32_t PcmVolumeToGain(int volume) {
+    if (volume <= 0) {
+        return 0;
+    }
+    if (volume >= 100) {
+        return 65536;
+    }
+    return (int32_t)((int64_t)volume * volume * 65536 / 10000);
+}
+
+void PcmScaleWiden(const int16_t* __restrict src, int32_t* __restrict dst, size_t samples, int32_t gain_q16) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        dst[i] = src[i] * gain_q16;
+        dst[i + 1] = src[i + 1] * gain_q16;
+        dst[i + 2] = src[i + 2] * gain_q16;
+        dst[i + 3] = src[i + 3] * gain_q16;
+    }
+    for (; i < samples; i++) {
+        dst[i] = src[i] * gain_q16;
+    }
+}
+
+void PcmNarrow(const int32_t* __restrict src, int16_t* __restrict dst, size_t samples, int shift, int gain) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        dst[i] = Saturate16((src[i] >> shift) * gain);
+        dst[i + 1] = Saturate16((src[i + 1] >> shift) * gain);
+        dst[i + 2] = Saturate16((src[i + 2] >> shift) * gain);
+        dst[i + 3] = Saturate16((src[i + 3] >> shift) * gain);
+    }
+    for (; i < samples; i++) {
+        dst[i] = Saturate16((src[i] >> shift) * gain);
+    }
+}
+
+void PcmApplyGain(int16_t* data, size_t samples, int gain) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        data[i] = Saturate16(data[i] * gain);
+        data[i + 1] = Saturate16(data[i + 1] * gain);
+        data[i + 2] = Saturate16(data[i + 2] * gain);
+        data[i + 3] = Saturate16(data[i + 3] * gain);
+    }
+    for (; i < samples; i++) {
+        data[i] = Saturate16(data[i] * gain);
+    }
+}
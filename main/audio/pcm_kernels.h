@@ -0,0 +1,30 @@
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample format conversion loops for I2S codecs without a hardware codec chip.
+ *
+ * All kernels write into caller provided buffers and are plain scalar C++, branch free and
+ * unrolled by four samples, so they stay cheap at 48kHz on every target. There is no SIMD
+ * variant: esp-dsp has no widening or saturating narrowing kernel for these formats.
+ */
+
+/* Q16 gain for a 0-100 volume on a square law curve, 65536 is unity */
+int32_t PcmVolumeToGain(int volume);
+
+/*
+ * dst = src * gain_q16, gain_q16 must not exceed 65536 so the product always fits in 32 bits.
+ * dst must not overlap src.
+ */
+void PcmScaleWiden(const int16_t* __restrict src, int32_t* __restrict dst, size_t samples, int32_t gain_q16);
+
+/* dst = saturate((src >> shift) * gain) to +-INT16_MAX, dst must not overlap src */
+void PcmNarrow(const int32_t* __restrict src, int16_t* __restrict dst, size_t samples, int shift, int gain);
+
+/* data = saturate(data * gain) to +-INT16_MAX, in place */
+void PcmApplyGain(int16_t* data, size_t samples, int gain);
+
+#endif // PCM_KERNELS_H
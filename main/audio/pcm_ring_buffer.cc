@@ -0,0 +1,66 @@
+#include "pcm_ring_buffer.h"
+
+#include <cstring>
+
+#include <esp_heap_caps.h>
+
+PcmRingBuffer::~PcmRingBuffer() {
+    heap_caps_free(buffer_);
+}
+
+bool PcmRingBuffer::Allocate(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    heap_caps_free(buffer_);
+    buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer_ == nullptr) {
+        buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_8BIT);
+    }
+    capacity_ = buffer_ != nullptr ? capacity : 0;
+    position_ = 0;
+    head_ = 0;
+    return buffer_ != nullptr;
+}
+
+void PcmRingBuffer::Write(const int16_t* data, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) {
+        return;
+    }
+    if (samples > capacity_) {
+        position_ += samples - capacity_;
+        data += samples - capacity_;
+        samples = capacity_;
+    }
+    size_t first = capacity_ - head_ < samples ? capacity_ - head_ : samples;
+    memcpy(buffer_ + head_, data, first * sizeof(int16_t));
+    memcpy(buffer_, data + first, (samples - first) * sizeof(int16_t));
+    head_ = (head_ + samples) % capacity_;
+    position_ += samples;
+}
+
+size_t PcmRingBuffer::Read(uint32_t& from, int16_t* dest, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) {
+        return 0;
+    }
+    uint32_t available = position_ - from;
+    if (available > capacity_) {
+        from = position_ - capacity_;
+        available = capacity_;
+    }
+    if (samples > available) {
+        samples = available;
+    }
+    /* Positions wrap at 2^32, so the index is taken relative to the write head */
+    size_t index = (head_ + capacity_ - (position_ - from)) % capacity_;
+    size_t first = capacity_ - index < samples ? capacity_ - index : samples;
+    memcpy(dest, buffer_ + index, first * sizeof(int16_t));
+    memcpy(dest + first, buffer_, (samples - first) * sizeof(int16_t));
+    from += samples;
+    return samples;
+}
+
+uint32_t PcmRingBuffer::position() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return position_;
+}
@@ -0,0 +1,41 @@
+#ifndef PCM_RING_BUFFER_H
+#define PCM_RING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/*
+ * Fixed size ring of recent PCM samples, allocated once and overwritten continuously.
+ *
+ * Samples are addressed by their absolute stream position (total samples written, wrapping at
+ * 2^32), so readers can keep a cursor and pick up exactly where a previous read ended.
+ */
+class PcmRingBuffer {
+public:
+    PcmRingBuffer() = default;
+    ~PcmRingBuffer();
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+
+    /* Prefers PSRAM, returns false if the buffer could not be allocated */
+    bool Allocate(size_t capacity);
+    size_t capacity() const { return capacity_; }
+
+    void Write(const int16_t* data, size_t samples);
+    /*
+     * Copies up to `samples` samples starting at position `from` and advances `from` past them.
+     * A position that was already overwritten is moved forward to the oldest stored sample.
+     */
+    size_t Read(uint32_t& from, int16_t* dest, size_t samples);
+    uint32_t position();
+
+private:
+    std::mutex mutex_;
+    int16_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    size_t head_ = 0;         // Index of the next sample to write
+    uint32_t position_ = 0;   // Samples written so far
+};
+
+#endif // PCM_RING_BUFFER_H
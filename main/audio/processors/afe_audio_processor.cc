@@ -1,7 +1,11 @@
 #include "afe_audio_processor.h"
 #include <esp_log.h>
 
+#include "task_topology.h"
+
 #define PROCESSOR_RUNNING 0x01
+/* Feed chunks the esp-sr ring holds, esp-sr drops chunks fed into a full ring */
+#define AFE_RINGBUF_CHUNKS 16
 
 #define TAG "AfeAudioProcessor"
 
@@ -54,8 +58,12 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
     }
 
     afe_config->agc_init = false;
-    afe_config->afe_perferred_priority = 5;
-    afe_config->afe_ringbuf_size = 16;
+    auto& afe_task = TaskTopology::GetInstance().Get(kTaskAfe);
+    if (afe_task.core != TASK_CORE_DEFAULT) {
+        afe_config->afe_perferred_core = afe_task.core == tskNO_AFFINITY ? 0 : afe_task.core;
+    }
+    afe_config->afe_perferred_priority = afe_task.priority;
+    afe_config->afe_ringbuf_size = AFE_RINGBUF_CHUNKS;
     afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
 
 #ifdef CONFIG_USE_DEVICE_AEC
@@ -69,11 +77,11 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
     
-    xTaskCreate([](void* arg) {
+    TaskTopology::GetInstance().Create(kTaskAudioProcessor, [](void* arg) {
         auto this_ = (AfeAudioProcessor*)arg;
         this_->AudioProcessorTask();
         vTaskDelete(NULL);
-    }, "audio_communication", 4096, this, 3, NULL);
+    }, this);
 }
 
 AfeAudioProcessor::~AfeAudioProcessor() {
@@ -90,14 +98,25 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_);
 }
 
-void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
+void AfeAudioProcessor::Feed(AudioPcm&& data) {
     if (afe_data_ == nullptr) {
         return;
     }
+    fed_samples_ += afe_iface_->get_feed_chunksize(afe_data_);
     afe_iface_->feed(afe_data_, data.data());
 }
 
+/* Half of the ring, esp-sr queues chunks between its own feed and fetch stages as well */
+bool AfeAudioProcessor::CanFeed() {
+    if (afe_data_ == nullptr) {
+        return false;
+    }
+    uint32_t feed_size = afe_iface_->get_feed_chunksize(afe_data_);
+    return fed_samples_ - fetched_samples_ + feed_size <= AFE_RINGBUF_CHUNKS / 2 * feed_size;
+}
+
 void AfeAudioProcessor::Start() {
+    fetched_samples_ = fed_samples_.load();
     xEventGroupSetBits(event_group_, PROCESSOR_RUNNING);
 }
 
@@ -106,13 +125,14 @@ void AfeAudioProcessor::Stop() {
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
+    fetched_samples_ = fed_samples_.load();
 }
 
 bool AfeAudioProcessor::IsRunning() {
     return xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING;
 }
 
-void AfeAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+void AfeAudioProcessor::OnOutput(std::function<void(AudioPcm&& data)> callback) {
     output_callback_ = callback;
 }
 
@@ -130,6 +150,9 @@ void AfeAudioProcessor::AudioProcessorTask() {
         xEventGroupWaitBits(event_group_, PROCESSOR_RUNNING, pdFALSE, pdTRUE, portMAX_DELAY);
 
         auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
+        if (res != nullptr) {
+            fetched_samples_ += fetch_size;
+        }
         if ((xEventGroupGetBits(event_group_) & PROCESSOR_RUNNING) == 0) {
             continue;
         }
@@ -166,7 +189,7 @@ void AfeAudioProcessor::AudioProcessorTask() {
                     output_buffer_.reserve(frame_samples_);
                 } else {
                     // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
+                    output_callback_(AudioPcm(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
                     output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
                 }
             }
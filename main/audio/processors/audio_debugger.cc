@@ -3,15 +3,21 @@
 
 #if CONFIG_USE_AUDIO_DEBUGGER
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
 #include <cstring>
 #include <string>
+#include <algorithm>
+
+#include "task_topology.h"
 #endif
 
 #define TAG "AudioDebugger"
 
+#define AUDIO_DEBUG_DROP_LOG_INTERVAL_US 5000000
+
 
 AudioDebugger::AudioDebugger() {
 #if CONFIG_USE_AUDIO_DEBUGGER
@@ -20,16 +26,16 @@ AudioDebugger::AudioDebugger() {
         // 解析配置的服务器地址 "IP:PORT"
         std::string server_addr = CONFIG_AUDIO_DEBUG_UDP_SERVER;
         size_t colon_pos = server_addr.find(':');
-        
+
         if (colon_pos != std::string::npos) {
             std::string ip = server_addr.substr(0, colon_pos);
             int port = std::stoi(server_addr.substr(colon_pos + 1));
-            
+
             memset(&udp_server_addr_, 0, sizeof(udp_server_addr_));
             udp_server_addr_.sin_family = AF_INET;
             udp_server_addr_.sin_port = htons(port);
             inet_pton(AF_INET, ip.c_str(), &udp_server_addr_.sin_addr);
-            
+
             ESP_LOGI(TAG, "Initialized server address: %s", CONFIG_AUDIO_DEBUG_UDP_SERVER);
         } else {
             ESP_LOGW(TAG, "Invalid server address: %s, should be IP:PORT", CONFIG_AUDIO_DEBUG_UDP_SERVER);
@@ -39,11 +45,27 @@ AudioDebugger::AudioDebugger() {
     } else {
         ESP_LOGW(TAG, "Failed to create UDP socket: %d", errno);
     }
+
+    if (udp_sockfd_ >= 0) {
+        /* Below every audio task, so capturing never competes with the pipeline it observes */
+        TaskTopology::GetInstance().Create(kTaskAudioDebugger, [](void* arg) {
+            AudioDebugger* debugger = (AudioDebugger*)arg;
+            debugger->SenderTask();
+            vTaskDelete(NULL);
+        }, this, &sender_task_handle_);
+    }
 #endif
 }
 
 AudioDebugger::~AudioDebugger() {
 #if CONFIG_USE_AUDIO_DEBUGGER
+    if (sender_task_handle_ != nullptr) {
+        stopping_ = true;
+        xTaskNotifyGive(sender_task_handle_);
+        while (stopping_) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
     if (udp_sockfd_ >= 0) {
         close(udp_sockfd_);
         ESP_LOGI(TAG, "Closed UDP socket");
@@ -51,18 +73,96 @@ AudioDebugger::~AudioDebugger() {
 #endif
 }
 
-void AudioDebugger::Feed(const std::vector<int16_t>& data) {
+void AudioDebugger::Feed(AudioDebugTap tap, const int16_t* data, size_t samples, int sample_rate, int channels) {
 #if CONFIG_USE_AUDIO_DEBUGGER
-    if (udp_sockfd_ >= 0) {
-        ssize_t sent = sendto(udp_sockfd_, data.data(), data.size() * sizeof(int16_t), 0,
+    if (sender_task_handle_ == nullptr || channels <= 0 || samples == 0) {
+        return;
+    }
+    auto& t = taps_[tap];
+    uint32_t position = t.position.fetch_add(samples / channels);
+    std::unique_lock<std::mutex> lock(t.producer_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || t.ring.Full()) {
+        t.dropped++;
+        return;
+    }
+
+    Frame frame;
+    frame.channels = channels;
+    frame.sample_rate = sample_rate;
+    frame.position = position;
+    frame.timestamp_us = (uint32_t)esp_timer_get_time();
+    frame.pcm.assign(data, data + samples);
+    bool was_empty = false;
+    if (!t.ring.Push(std::move(frame), &was_empty)) {
+        t.dropped++;
+        return;
+    }
+    if (was_empty) {
+        xTaskNotifyGive(sender_task_handle_);
+    }
+#endif
+}
+
+void AudioDebugger::SenderTask() {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    int64_t last_drop_log_us = 0;
+    while (!stopping_) {
+        bool sent = false;
+        for (int i = 0; i < kAudioDebugTapCount; i++) {
+            Frame frame;
+            if (taps_[i].ring.Pop(frame)) {
+                SendFrame((AudioDebugTap)i, frame);
+                sent = true;
+            }
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (now - last_drop_log_us >= AUDIO_DEBUG_DROP_LOG_INTERVAL_US) {
+            last_drop_log_us = now;
+            for (int i = 0; i < kAudioDebugTapCount; i++) {
+                uint32_t dropped = taps_[i].dropped.exchange(0);
+                if (dropped > 0) {
+                    ESP_LOGW(TAG, "Tap %d dropped %lu frames", i, dropped);
+                }
+            }
+        }
+
+        if (!sent) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+    stopping_ = false;
+#endif
+}
+
+void AudioDebugger::SendFrame(AudioDebugTap tap, const Frame& frame) {
+#if CONFIG_USE_AUDIO_DEBUGGER
+    uint8_t packet[sizeof(AudioDebugHeader) + AUDIO_DEBUG_MAX_PAYLOAD];
+    auto header = (AudioDebugHeader*)packet;
+    memset(header, 0, sizeof(AudioDebugHeader));
+    header->magic = htons(AUDIO_DEBUG_MAGIC);
+    header->version = AUDIO_DEBUG_VERSION;
+    header->tap = tap;
+    header->channels = frame.channels;
+    header->sample_rate = htonl(frame.sample_rate);
+
+    auto& t = taps_[tap];
+    size_t frames = frame.pcm.size() / frame.channels;
+    size_t frames_per_packet = AUDIO_DEBUG_MAX_PAYLOAD / (frame.channels * sizeof(int16_t));
+    for (size_t offset = 0; offset < frames; offset += frames_per_packet) {
+        size_t count = std::min(frames_per_packet, frames - offset);
+        size_t payload_size = count * frame.channels * sizeof(int16_t);
+        header->sequence = htonl(t.sequence++);
+        header->position = htonl(frame.position + offset);
+        header->timestamp_us = htonl(frame.timestamp_us + (uint32_t)((uint64_t)offset * 1000000 / frame.sample_rate));
+        memcpy(packet + sizeof(AudioDebugHeader), frame.pcm.data() + offset * frame.channels, payload_size);
+
+        ssize_t sent = sendto(udp_sockfd_, packet, sizeof(AudioDebugHeader) + payload_size, 0,
                              (struct sockaddr*)&udp_server_addr_, sizeof(udp_server_addr_));
         if (sent < 0) {
             ESP_LOGW(TAG, "Failed to send audio data to %s: %d", CONFIG_AUDIO_DEBUG_UDP_SERVER, errno);
-        } else {
-            ESP_LOGD(TAG, "Sent %d bytes audio data to %s", sent, CONFIG_AUDIO_DEBUG_UDP_SERVER);
+            return;
         }
     }
 #endif
 }
-
- 
\ No newline at end of file
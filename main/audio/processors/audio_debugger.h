@@ -3,20 +3,94 @@
 
 #include <vector>
 #include <cstdint>
+#include <mutex>
+#include <atomic>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
+#include "spsc_ring.h"
+#include "audio_frame_pool.h"
+
+enum AudioDebugTap {
+    kAudioDebugTapMic = 0,      // ReadAudioData() output, all input channels including the hardware reference
+    kAudioDebugTapProcessed,    // Audio processor output, what gets encoded and sent
+    kAudioDebugTapDecoded,      // Opus decoder output, before the playback queue
+    kAudioDebugTapSpeaker,      // PCM written to the codec, the software reference for AEC
+    kAudioDebugTapCount,
+};
+
+#define AUDIO_DEBUG_MAGIC 0x4144    // "AD"
+#define AUDIO_DEBUG_VERSION 1
+#define AUDIO_DEBUG_RING_FRAMES 8
+// Keep datagrams below a typical MTU so a lost fragment never costs a whole frame
+#define AUDIO_DEBUG_MAX_PAYLOAD 1400
+
+/*
+ * Datagram header, fields in network byte order.
+ *
+ * sequence counts datagrams per tap, so a gap means the network lost packets. position counts
+ * samples per channel per tap, including frames the device dropped because the ring was full,
+ * so a position jump without a sequence gap means the device dropped audio. timestamp_us is the
+ * capture time of the frame (esp_timer), used to line the taps up against each other.
+ */
+struct AudioDebugHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t tap;
+    uint8_t channels;
+    uint8_t reserved[3];
+    uint32_t sample_rate;
+    uint32_t sequence;
+    uint32_t position;
+    uint32_t timestamp_us;
+} __attribute__((packed));
+
+/*
+ * Streams audio taps to the host over UDP.
+ *
+ * Feed() copies the frame into a per-tap SPSC ring and never blocks: a full ring, or another
+ * task already feeding the same tap, drops the frame and only advances the tap position. A
+ * low-priority task drains the rings and does the sendto() calls.
+ */
 class AudioDebugger {
 public:
     AudioDebugger();
     ~AudioDebugger();
 
-    void Feed(const std::vector<int16_t>& data);
+    void Feed(AudioDebugTap tap, const int16_t* data, size_t samples, int sample_rate, int channels);
+    template <typename Pcm>
+    void Feed(AudioDebugTap tap, const Pcm& data, int sample_rate, int channels) {
+        Feed(tap, data.data(), data.size(), sample_rate, channels);
+    }
 
 private:
+    struct Frame {
+        uint8_t channels = 0;
+        uint32_t sample_rate = 0;
+        uint32_t position = 0;
+        uint32_t timestamp_us = 0;
+        AudioPcm pcm;
+    };
+
+    struct Tap {
+        SpscRing<Frame> ring{AUDIO_DEBUG_RING_FRAMES};
+        std::mutex producer_mutex;
+        std::atomic<uint32_t> position{0};
+        uint32_t sequence = 0;    // Sender task only
+        std::atomic<uint32_t> dropped{0};
+    };
+
     int udp_sockfd_ = -1;
     struct sockaddr_in udp_server_addr_;
+    Tap taps_[kAudioDebugTapCount];
+    TaskHandle_t sender_task_handle_ = nullptr;
+    std::atomic<bool> stopping_{false};
+
+    void SenderTask();
+    void SendFrame(AudioDebugTap tap, const Frame& frame);
 };
 
-#endif 
\ No newline at end of file
+#endif
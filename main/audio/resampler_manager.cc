@@ -0,0 +1,112 @@
+#include "resampler_manager.h"
+
+#include <esp_log.h>
+
+#define TAG "ResamplerManager"
+
+ResamplerManager::~ResamplerManager() {
+    for (auto entry : entries_) {
+        esp_ae_rate_cvt_close(entry->handle);
+        delete entry;
+    }
+}
+
+ResamplerManager::Resampler ResamplerManager::Acquire(int src_rate, int dst_rate, int channels) {
+    if (src_rate == dst_rate || src_rate <= 0 || dst_rate <= 0) {
+        return Resampler();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto entry : entries_) {
+        if (!entry->in_use && entry->src_rate == src_rate && entry->dst_rate == dst_rate && entry->channels == channels) {
+            /* Drop the filter history of the previous stream */
+            esp_ae_rate_cvt_reset(entry->handle);
+            entry->in_use = true;
+            return Resampler(entry);
+        }
+    }
+
+    esp_ae_rate_cvt_cfg_t cfg = {
+        .src_rate        = (uint32_t)src_rate,
+        .dest_rate       = (uint32_t)dst_rate,
+        .channel         = (uint8_t)channels,
+        .bits_per_sample = ESP_AUDIO_BIT16,
+        .complexity      = 2,
+        .perf_type       = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,
+    };
+    esp_ae_rate_cvt_handle_t handle = nullptr;
+    auto ret = esp_ae_rate_cvt_open(&cfg, &handle);
+    if (handle == nullptr) {
+        ESP_LOGE(TAG, "Failed to create resampler %d -> %d Hz, error code: %d", src_rate, dst_rate, ret);
+        return Resampler();
+    }
+    ESP_LOGI(TAG, "Created resampler %d -> %d Hz, %d channels", src_rate, dst_rate, channels);
+
+    auto entry = new Entry();
+    entry->src_rate = src_rate;
+    entry->dst_rate = dst_rate;
+    entry->channels = channels;
+    entry->handle = handle;
+    entry->in_use = true;
+    entries_.push_back(entry);
+    return Resampler(entry);
+}
+
+void ResamplerManager::Release(Entry* entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->in_use = false;
+    entry->released_at = ++release_tick_;
+
+    /* Keep the most recently used idle converters, close the rest */
+    size_t idle = 0;
+    for (auto e : entries_) {
+        idle += e->in_use ? 0 : 1;
+    }
+    while (idle > kMaxIdle) {
+        auto oldest = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (!(*it)->in_use && (oldest == entries_.end() || (int32_t)((*it)->released_at - (*oldest)->released_at) < 0)) {
+                oldest = it;
+            }
+        }
+        ESP_LOGI(TAG, "Closing idle resampler %d -> %d Hz", (*oldest)->src_rate, (*oldest)->dst_rate);
+        esp_ae_rate_cvt_close((*oldest)->handle);
+        delete *oldest;
+        entries_.erase(oldest);
+        idle--;
+    }
+}
+
+ResamplerManager::Resampler& ResamplerManager::Resampler::operator=(Resampler&& other) noexcept {
+    if (this != &other) {
+        Release();
+        entry_ = other.entry_;
+        other.entry_ = nullptr;
+    }
+    return *this;
+}
+
+size_t ResamplerManager::Resampler::GetMaxOutputSamples(size_t in_samples) const {
+    uint32_t out_samples = 0;
+    esp_ae_rate_cvt_get_max_out_sample_num(entry_->handle, in_samples, &out_samples);
+    return out_samples;
+}
+
+size_t ResamplerManager::Resampler::Process(const int16_t* in, size_t in_samples, int16_t* out, size_t out_samples) {
+    uint32_t actual_output = out_samples;
+    esp_ae_rate_cvt_process(entry_->handle, (esp_ae_sample_t)in, in_samples, (esp_ae_sample_t)out, &actual_output);
+    return actual_output;
+}
+
+void ResamplerManager::Resampler::Reset() {
+    if (entry_ != nullptr) {
+        esp_ae_rate_cvt_reset(entry_->handle);
+    }
+}
+
+void ResamplerManager::Resampler::Release() {
+    if (entry_ != nullptr) {
+        ResamplerManager::GetInstance().Release(entry_);
+        entry_ = nullptr;
+    }
+}
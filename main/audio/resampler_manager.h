@@ -0,0 +1,90 @@
+#ifndef RESAMPLER_MANAGER_H
+#define RESAMPLER_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <esp_ae_rate_cvt.h>
+
+/*
+ * Shared cache of sample rate converters, keyed by (source rate, destination rate, channels).
+ *
+ * Acquire() hands out a converter as a Resampler lease. Releasing the lease returns the
+ * converter to the cache, and the next Acquire() for the same key resets it instead of opening
+ * a new one, so switching between TTS, radio and alert sounds no longer reallocates. A
+ * converter belongs to one lease at a time, so Process() takes no lock. At most kMaxIdle idle
+ * converters are kept, the least recently released one is closed first.
+ */
+class ResamplerManager {
+private:
+    struct Entry {
+        int src_rate = 0;
+        int dst_rate = 0;
+        int channels = 0;
+        esp_ae_rate_cvt_handle_t handle = nullptr;
+        bool in_use = false;
+        uint32_t released_at = 0;
+    };
+
+public:
+    class Resampler {
+    public:
+        Resampler() = default;
+        Resampler(Resampler&& other) noexcept : entry_(other.entry_) { other.entry_ = nullptr; }
+        Resampler& operator=(Resampler&& other) noexcept;
+        Resampler(const Resampler&) = delete;
+        Resampler& operator=(const Resampler&) = delete;
+        ~Resampler() { Release(); }
+
+        explicit operator bool() const { return entry_ != nullptr; }
+        int src_rate() const { return entry_->src_rate; }
+        int dst_rate() const { return entry_->dst_rate; }
+        int channels() const { return entry_->channels; }
+
+        /* Sample counts are per channel */
+        size_t GetMaxOutputSamples(size_t in_samples) const;
+        size_t Process(const int16_t* in, size_t in_samples, int16_t* out, size_t out_samples);
+        /* Resizes out to the converted length, in must not point into out */
+        template <typename Vector>
+        void Process(const int16_t* in, size_t in_samples, Vector& out) {
+            out.resize(GetMaxOutputSamples(in_samples) * entry_->channels);
+            out.resize(Process(in, in_samples, out.data(), out.size() / entry_->channels) * entry_->channels);
+        }
+        void Reset();
+        /* Returns the converter to the cache */
+        void Release();
+
+    private:
+        friend class ResamplerManager;
+        Entry* entry_ = nullptr;
+
+        explicit Resampler(Entry* entry) : entry_(entry) {}
+    };
+
+    static ResamplerManager& GetInstance() {
+        static ResamplerManager instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    ResamplerManager(const ResamplerManager&) = delete;
+    ResamplerManager& operator=(const ResamplerManager&) = delete;
+
+    /* Returns an empty lease if the rates are equal or the converter cannot be opened */
+    Resampler Acquire(int src_rate, int dst_rate, int channels);
+
+private:
+    static const size_t kMaxIdle = 4;
+
+    std::mutex mutex_;
+    std::vector<Entry*> entries_;
+    uint32_t release_tick_ = 0;
+
+    ResamplerManager() = default;
+    ~ResamplerManager();
+
+    void Release(Entry* entry);
+};
+
+#endif // RESAMPLER_MANAGER_H
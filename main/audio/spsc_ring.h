@@ -0,0 +1,131 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+ * Bounded single-producer / single-consumer ring.
+ *
+ * Push() is only called from the producer task and Pop() only from the consumer task, so
+ * neither side takes a lock. Clear() may be called from any task: it records a flush mark and
+ * the consumer drops everything below that mark the next time it pops, which keeps element
+ * destruction on the consumer side.
+ *
+ * Push() / Pop() report the empty->non-empty and full->non-full transitions so the caller only
+ * has to wake the other side when it may actually be sleeping.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : capacity_(capacity) {
+        size_t slots = 1;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        mask_ = slots - 1;
+        slots_.resize(slots);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side
+    bool Push(T&& item, bool* was_empty = nullptr) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        // seq_cst pairs with the tail load in Pop(): a full ring seen here is seen there too
+        if (tail - head_.load(std::memory_order_seq_cst) >= capacity_) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        if (was_empty != nullptr) {
+            // Either the consumer sees the new tail, or we see the head it published before sleeping
+            *was_empty = Live(head_.load(std::memory_order_seq_cst), tail) == 0;
+        }
+        return true;
+    }
+
+    // Consumer side
+    bool Pop(T& item, bool* was_full = nullptr) {
+        uint32_t start = head_.load(std::memory_order_relaxed);
+        uint32_t head = DropFlushed();
+        uint32_t tail = tail_.load(std::memory_order_seq_cst);
+        if (head == tail) {
+            if (was_full != nullptr) {
+                *was_full = head != start;
+            }
+            return false;
+        }
+        item = std::move(slots_[head & mask_]);
+        slots_[head & mask_] = T();
+        head_.store(head + 1, std::memory_order_seq_cst);
+        if (was_full != nullptr) {
+            // Reload the tail: the producer may have filled the ring and seen the old head since
+            // the load above, or it sees the new head before sleeping
+            *was_full = tail_.load(std::memory_order_seq_cst) - start >= capacity_;
+        }
+        return true;
+    }
+
+    // Consumer side, returns true if anything was dropped
+    bool Compact() {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        return DropFlushed() != head;
+    }
+
+    // Any task
+    void Clear() {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t flush = flush_.load(std::memory_order_relaxed);
+        while ((int32_t)(tail - flush) > 0 &&
+               !flush_.compare_exchange_weak(flush, tail, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    size_t Size() const {
+        return Live(head_.load(std::memory_order_acquire), tail_.load(std::memory_order_acquire));
+    }
+    bool Empty() const { return Size() == 0; }
+    // Flushed slots still occupy space until the consumer drops them
+    bool Full() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire) >= capacity_;
+    }
+    bool HasFlushed() const {
+        return (int32_t)(flush_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire)) > 0;
+    }
+    size_t capacity() const { return capacity_; }
+
+private:
+    const size_t capacity_;
+    uint32_t mask_ = 0;
+    std::vector<T> slots_;
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> flush_{0};
+
+    size_t Live(uint32_t head, uint32_t tail) const {
+        uint32_t flush = flush_.load(std::memory_order_acquire);
+        uint32_t start = (int32_t)(flush - head) > 0 ? flush : head;
+        return (int32_t)(tail - start) > 0 ? tail - start : 0;
+    }
+
+    uint32_t DropFlushed() {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t flush = flush_.load(std::memory_order_acquire);
+        if ((int32_t)(flush - head) <= 0) {
+            return head;
+        }
+        while (head != flush) {
+            slots_[head & mask_] = T();
+            head++;
+        }
+        head_.store(head, std::memory_order_seq_cst);
+        return head;
+    }
+};
+
+#endif // SPSC_RING_H
@@ -7,6 +7,7 @@
 
 #include <model_path.h>
 #include "audio_codec.h"
+#include "wake_word_profiler.h"
 
 class WakeWord {
 public:
@@ -18,9 +19,12 @@ public:
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
-    virtual void EncodeWakeWordData() = 0;
-    virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
+
+    WakeWordProfiler& profiler() { return profiler_; }
+
+protected:
+    WakeWordProfiler profiler_;
 };
 
 #endif
@@ -0,0 +1,90 @@
+#include "wake_word_profiler.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+
+#define TAG "WakeWordProfiler"
+
+void WakeWordProfiler::RecordChunk(uint32_t start_us, uint32_t end_us, size_t samples) {
+    uint32_t value = end_us - start_us;
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunks_++;
+    samples_ += samples;
+    busy_us_ += value;
+    if (value > max_chunk_us_) {
+        max_chunk_us_ = value;
+    }
+}
+
+void WakeWordProfiler::RecordDetection(const std::string& word, uint32_t audio_end_us) {
+    uint32_t latency_us = audio_end_us != 0 ? Now() - audio_end_us : 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    words_[word].detections++;
+    if (audio_end_us != 0) {
+        latency_count_++;
+        latency_total_us_ += latency_us;
+        if (latency_us > latency_max_us_) {
+            latency_max_us_ = latency_us;
+        }
+    }
+    ESP_LOGI(TAG, "Detected '%s', %lu ms after the audio", word.c_str(), latency_us / 1000);
+}
+
+void WakeWordProfiler::RecordUnconfirmed(const std::string& word) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    words_[word].unconfirmed++;
+    ESP_LOGW(TAG, "No speech followed '%s'", word.c_str());
+}
+
+std::string WakeWordProfiler::GetStatsJson() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+
+    cJSON* chunk = cJSON_CreateObject();
+    uint64_t audio_us = samples_ * 1000 / 16;
+    cJSON_AddNumberToObject(chunk, "count", chunks_);
+    cJSON_AddNumberToObject(chunk, "audio_ms", (double)(audio_us / 1000));
+    if (chunks_ > 0) {
+        cJSON_AddNumberToObject(chunk, "avg_us", (double)(busy_us_ / chunks_));
+    }
+    cJSON_AddNumberToObject(chunk, "max_us", max_chunk_us_);
+    if (audio_us > 0) {
+        cJSON_AddNumberToObject(chunk, "cpu_percent", busy_us_ * 100.0 / audio_us);
+    }
+    cJSON_AddItemToObject(root, "chunk", chunk);
+
+    cJSON* latency = cJSON_CreateObject();
+    cJSON_AddNumberToObject(latency, "count", latency_count_);
+    if (latency_count_ > 0) {
+        cJSON_AddNumberToObject(latency, "avg_ms", latency_total_us_ / latency_count_ / 1000.0);
+    }
+    cJSON_AddNumberToObject(latency, "max_ms", latency_max_us_ / 1000.0);
+    cJSON_AddItemToObject(root, "detection_latency", latency);
+
+    cJSON* words = cJSON_CreateObject();
+    for (auto& [word, stats] : words_) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "detections", stats.detections);
+        cJSON_AddNumberToObject(item, "unconfirmed", stats.unconfirmed);
+        cJSON_AddItemToObject(words, word.c_str(), item);
+    }
+    cJSON_AddItemToObject(root, "words", words);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void WakeWordProfiler::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunks_ = 0;
+    samples_ = 0;
+    busy_us_ = 0;
+    max_chunk_us_ = 0;
+    latency_count_ = 0;
+    latency_total_us_ = 0;
+    latency_max_us_ = 0;
+    words_.clear();
+}
@@ -0,0 +1,51 @@
+#ifndef WAKE_WORD_PROFILER_H
+#define WAKE_WORD_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <esp_timer.h>
+
+/*
+ * Cost and accuracy counters of a wake word / command engine.
+ *
+ * Every processed chunk records the time spent in the engine (wakenet or multinet detect, AFE
+ * fetch) against the audio it covered, which gives the CPU share of detection. Every detection
+ * records the time from the end of the triggering audio chunk to the callback, and is counted per
+ * wake word or command. Detections that were followed by a listening session in which the VAD
+ * never heard speech are counted as unconfirmed, the on-device proxy for false accepts.
+ */
+class WakeWordProfiler {
+public:
+    static uint32_t Now() { return (uint32_t)esp_timer_get_time(); }
+
+    /* Engine time spent on `samples` 16kHz samples */
+    void RecordChunk(uint32_t start_us, uint32_t end_us, size_t samples);
+    /* audio_end_us is when the chunk that triggered the detection had been captured, 0 if unknown */
+    void RecordDetection(const std::string& word, uint32_t audio_end_us);
+    void RecordUnconfirmed(const std::string& word);
+
+    std::string GetStatsJson() const;
+    void Reset();
+
+private:
+    struct WordStats {
+        uint32_t detections = 0;
+        uint32_t unconfirmed = 0;
+    };
+
+    mutable std::mutex mutex_;
+    uint32_t chunks_ = 0;
+    uint64_t samples_ = 0;
+    uint64_t busy_us_ = 0;
+    uint32_t max_chunk_us_ = 0;
+    uint32_t latency_count_ = 0;
+    uint64_t latency_total_us_ = 0;
+    uint32_t latency_max_us_ = 0;
+    std::map<std::string, WordStats> words_;
+};
+
+#endif // WAKE_WORD_PROFILER_H
@@ -61,10 +61,14 @@ void EspWakeWord::Feed(const std::vector<int16_t>& data) {
         return;
     }
 
+    /* The chunk was fully captured when it is fed */
+    uint32_t start = WakeWordProfiler::Now();
     int res = wakenet_iface_->detect(wakenet_data_, (int16_t *)data.data());
+    profiler_.RecordChunk(start, WakeWordProfiler::Now(), wakenet_iface_->get_samp_chunksize(wakenet_data_));
     if (res > 0) {
         last_detected_wake_word_ = wakenet_iface_->get_word_name(wakenet_data_, res);
         running_ = false;
+        profiler_.RecordDetection(last_detected_wake_word_, start);
 
         if (wake_word_detected_callback_) {
             wake_word_detected_callback_(last_detected_wake_word_);
@@ -78,10 +82,3 @@ size_t EspWakeWord::GetFeedSize() {
     }
     return wakenet_iface_->get_samp_chunksize(wakenet_data_);
 }
-
-void EspWakeWord::EncodeWakeWordData() {
-}
-
-bool EspWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
-    return false;
-}
@@ -2,6 +2,7 @@
 #include "display.h"
 #include "application.h"
 #include "audio_codec.h"
+#include "tls_session_network.h"
 #include <esp_log.h>
 #include <font_awesome.h>
 #include <cJSON.h>
@@ -135,7 +136,11 @@ void Nt26Board::SetNetworkEventCallback(NetworkEventCallback callback) {
 }
 
 NetworkInterface* Nt26Board::GetNetwork() {
+#if CONFIG_TLS_SESSION_CACHE
+    static TlsSessionNetwork network;
+#else
     static EspNetwork network;
+#endif
     return &network;
 }
 
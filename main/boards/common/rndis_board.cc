@@ -4,6 +4,7 @@
 #include "system_info.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "tls_session_network.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -171,7 +172,11 @@ void RndisBoard::install_rndis(uint16_t idVendor, uint16_t idProduct, const char
  
 
 NetworkInterface* RndisBoard::GetNetwork() {
+#if CONFIG_TLS_SESSION_CACHE
+    static TlsSessionNetwork network;
+#else
     static EspNetwork network;
+#endif
     return &network;
 }
 
@@ -0,0 +1,126 @@
+#include "tls_session_cache.h"
+#include "settings.h"
+
+#include <esp_log.h>
+#include <mbedtls/ssl.h>
+#include <cstdio>
+#include <cstdlib>
+
+#if CONFIG_TLS_SESSION_CACHE
+
+#define TAG "TlsSessionCache"
+
+TlsSession TlsSessionCache::Get(const std::string& host, int port) {
+    std::string key = host + ":" + std::to_string(port);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front().session;
+        }
+    }
+
+    auto session = Load(key);
+    if (session != nullptr) {
+        entries_.push_front({key, session});
+        if (entries_.size() > TLS_SESSION_CACHE_MAX_ENTRIES) {
+            entries_.pop_back();
+        }
+    }
+    return session;
+}
+
+void TlsSessionCache::Put(const std::string& host, int port, esp_tls_client_session_t* session) {
+    if (session == nullptr) {
+        return;
+    }
+    std::string key = host + ":" + std::to_string(port);
+    std::lock_guard<std::mutex> lock(mutex_);
+    Save(key, session);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->key == key) {
+            entries_.erase(it);
+            break;
+        }
+    }
+    /* Connections still holding the old session keep it alive until they are done with it */
+    entries_.push_front({key, Wrap(session)});
+    if (entries_.size() > TLS_SESSION_CACHE_MAX_ENTRIES) {
+        entries_.pop_back();
+    }
+}
+
+void TlsSessionCache::Remove(const std::string& host, int port) {
+    std::string key = host + ":" + std::to_string(port);
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.remove_if([&key](const Entry& entry) { return entry.key == key; });
+#if CONFIG_TLS_SESSION_CACHE_PERSIST
+    Settings settings("tls_session", true);
+    settings.EraseKey(NvsKey(key));
+#endif
+}
+
+TlsSession TlsSessionCache::Wrap(esp_tls_client_session_t* session) {
+    return TlsSession(session, [](esp_tls_client_session_t* s) { esp_tls_free_client_session(s); });
+}
+
+/* NVS keys are limited to 15 characters, so the server is stored under a hash of its name */
+std::string TlsSessionCache::NvsKey(const std::string& key) {
+    uint32_t hash = 2166136261u;
+    for (char c : key) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "s%08lx", (unsigned long)hash);
+    return name;
+}
+
+TlsSession TlsSessionCache::Load(const std::string& key) {
+#if CONFIG_TLS_SESSION_CACHE_PERSIST
+    Settings settings("tls_session", false);
+    std::string blob = settings.GetBlob(NvsKey(key));
+    if (blob.empty()) {
+        return nullptr;
+    }
+    /* Allocated the way esp_tls_get_client_session() does, so esp_tls_free_client_session() releases it */
+    auto session = (esp_tls_client_session_t*)calloc(1, sizeof(esp_tls_client_session_t));
+    if (session == nullptr) {
+        return nullptr;
+    }
+    mbedtls_ssl_session_init(&session->saved_session);
+    if (mbedtls_ssl_session_load(&session->saved_session, (const unsigned char*)blob.data(), blob.size()) != 0) {
+        ESP_LOGW(TAG, "Discarding stored session of %s", key.c_str());
+        esp_tls_free_client_session(session);
+        return nullptr;
+    }
+    ESP_LOGI(TAG, "Loaded session of %s", key.c_str());
+    return Wrap(session);
+#else
+    return nullptr;
+#endif
+}
+
+void TlsSessionCache::Save(const std::string& key, esp_tls_client_session_t* session) {
+#if CONFIG_TLS_SESSION_CACHE_PERSIST
+    size_t length = 0;
+    mbedtls_ssl_session_save(&session->saved_session, nullptr, 0, &length);
+    if (length == 0) {
+        return;
+    }
+    std::string blob(length, '\0');
+    if (mbedtls_ssl_session_save(&session->saved_session, (unsigned char*)blob.data(), blob.size(), &length) != 0) {
+        return;
+    }
+    blob.resize(length);
+    Settings settings("tls_session", true);
+    /* Servers that do not rotate tickets would otherwise cost a flash write per connection */
+    if (settings.GetBlob(NvsKey(key)) != blob) {
+        settings.SetBlob(NvsKey(key), blob);
+    }
+#else
+    (void)key;
+    (void)session;
+#endif
+}
+
+#endif // CONFIG_TLS_SESSION_CACHE
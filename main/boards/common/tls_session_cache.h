@@ -0,0 +1,63 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <esp_tls.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/* Servers the device talks to: OTA, assets, WebSocket, camera explain and a radio station or two */
+#define TLS_SESSION_CACHE_MAX_ENTRIES 8
+
+#if CONFIG_TLS_SESSION_CACHE
+typedef std::shared_ptr<esp_tls_client_session_t> TlsSession;
+
+/*
+ * Process-wide cache of TLS client sessions, keyed by host and port.
+ *
+ * A connection offers the cached session (a session ticket or a session id) and the server
+ * resumes it with an abbreviated handshake: no certificate chain to download and verify and no
+ * key exchange, which is most of the CPU time and heap of a handshake on the C3 and ESP32.
+ * With CONFIG_TLS_SESSION_CACHE_PERSIST the sessions are written to NVS, so the first
+ * connections after a reboot or deep sleep are resumed as well.
+ *
+ * A session the server does not accept costs nothing, the handshake falls back to a full one
+ * and its new session replaces the cached entry.
+ */
+class TlsSessionCache {
+public:
+    static TlsSessionCache& GetInstance() {
+        static TlsSessionCache instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    /* Returns null if there is no session for the server */
+    TlsSession Get(const std::string& host, int port);
+    /* Takes ownership of a session returned by esp_tls_get_client_session() */
+    void Put(const std::string& host, int port, esp_tls_client_session_t* session);
+    /* Forgets the server, e.g. after a resumed handshake failed */
+    void Remove(const std::string& host, int port);
+
+private:
+    struct Entry {
+        std::string key;
+        TlsSession session;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;  // Most recently used first
+
+    TlsSessionCache() = default;
+    static std::string NvsKey(const std::string& key);
+    static TlsSession Wrap(esp_tls_client_session_t* session);
+    TlsSession Load(const std::string& key);
+    void Save(const std::string& key, esp_tls_client_session_t* session);
+};
+#endif
+
+#endif // TLS_SESSION_CACHE_H
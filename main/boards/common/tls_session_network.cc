@@ -0,0 +1,156 @@
+#include "tls_session_network.h"
+#include "task_topology.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_crt_bundle.h>
+#include <sys/socket.h>
+
+#if CONFIG_TLS_SESSION_CACHE
+
+#define TAG "TlsSessionSsl"
+
+#define TLS_SESSION_SSL_RECEIVE_TASK_EXIT (1 << 0)
+
+TlsSessionSsl::TlsSessionSsl() {
+    event_group_ = xEventGroupCreate();
+    xEventGroupSetBits(event_group_, TLS_SESSION_SSL_RECEIVE_TASK_EXIT);
+}
+
+TlsSessionSsl::~TlsSessionSsl() {
+    Disconnect();
+    vEventGroupDelete(event_group_);
+}
+
+bool TlsSessionSsl::Handshake(const std::string& host, int port, esp_tls_client_session_t* session) {
+    tls_ = esp_tls_init();
+    if (tls_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create tls client");
+        return false;
+    }
+
+    esp_tls_cfg_t cfg = {};
+    cfg.crt_bundle_attach = esp_crt_bundle_attach;
+    cfg.timeout_ms = TLS_SESSION_SSL_TIMEOUT_MS;
+    cfg.client_session = session;
+    if (esp_tls_conn_new_sync(host.c_str(), host.length(), port, &cfg, tls_) != 1) {
+        esp_tls_conn_destroy(tls_);
+        tls_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool TlsSessionSsl::Connect(const std::string& host, int port) {
+    if (tls_ != nullptr) {
+        ESP_LOGE(TAG, "tls client has been initialized");
+        return false;
+    }
+
+    auto& cache = TlsSessionCache::GetInstance();
+    auto session = cache.Get(host, port);
+    auto start_time = esp_timer_get_time();
+    if (!Handshake(host, port, session.get())) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%d", host.c_str(), port);
+        /* The next attempt does a full handshake, in case the server chokes on the session */
+        if (session != nullptr) {
+            cache.Remove(host, port);
+        }
+        return false;
+    }
+    ESP_LOGI(TAG, "Connected to %s:%d in %d ms%s", host.c_str(), port, (int)((esp_timer_get_time() - start_time) / 1000),
+        session != nullptr ? ", session offered" : "");
+    cache.Put(host, port, esp_tls_get_client_session(tls_));
+
+    connected_ = true;
+    running_ = true;
+    xEventGroupClearBits(event_group_, TLS_SESSION_SSL_RECEIVE_TASK_EXIT);
+    bool created = TaskTopology::GetInstance().Create(kTaskTlsReceive, [](void* arg) {
+        auto ssl = (TlsSessionSsl*)arg;
+        ssl->ReceiveTask();
+        xEventGroupSetBits(ssl->event_group_, TLS_SESSION_SSL_RECEIVE_TASK_EXIT);
+        vTaskDelete(NULL);
+    }, this, &receive_task_);
+    if (!created) {
+        xEventGroupSetBits(event_group_, TLS_SESSION_SSL_RECEIVE_TASK_EXIT);
+        Disconnect();
+        return false;
+    }
+    return true;
+}
+
+void TlsSessionSsl::Disconnect() {
+    running_ = false;
+    connected_ = false;
+    if (tls_ == nullptr) {
+        return;
+    }
+
+    /* Wakes up the receive task blocked in a read */
+    int sockfd = -1;
+    if (esp_tls_get_conn_sockfd(tls_, &sockfd) == ESP_OK && sockfd >= 0) {
+        shutdown(sockfd, SHUT_RDWR);
+    }
+    if (xTaskGetCurrentTaskHandle() == receive_task_) {
+        /* Called from a receive callback, the connection is released by the destructor */
+        return;
+    }
+    xEventGroupWaitBits(event_group_, TLS_SESSION_SSL_RECEIVE_TASK_EXIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    receive_task_ = nullptr;
+    esp_tls_conn_destroy(tls_);
+    tls_ = nullptr;
+}
+
+int TlsSessionSsl::Send(const std::string& data) {
+    if (!connected_ || tls_ == nullptr) {
+        return -1;
+    }
+
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int ret = esp_tls_conn_write(tls_, data.data() + sent, data.size() - sent);
+        if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to send data: -0x%x", -ret);
+            return ret;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+
+void TlsSessionSsl::ReceiveTask() {
+    std::string data;
+    while (running_) {
+        data.resize(TLS_SESSION_SSL_RECEIVE_BUFFER_SIZE);
+        int ret = esp_tls_conn_read(tls_, data.data(), data.size());
+        if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret <= 0) {
+            if (ret < 0 && running_) {
+                ESP_LOGE(TAG, "Failed to receive data: -0x%x", -ret);
+            }
+            break;
+        }
+        data.resize(ret);
+        if (stream_callback_) {
+            stream_callback_(data);
+        }
+    }
+
+    connected_ = false;
+    /* Only a close by the peer or the network is reported, not our own Disconnect() */
+    if (running_.exchange(false) && disconnect_callback_) {
+        disconnect_callback_();
+    }
+}
+
+std::unique_ptr<Tcp> TlsSessionNetwork::CreateSsl(int connect_id) {
+    (void)connect_id;
+    return std::make_unique<TlsSessionSsl>();
+}
+
+#endif // CONFIG_TLS_SESSION_CACHE
@@ -0,0 +1,56 @@
+#ifndef TLS_SESSION_NETWORK_H
+#define TLS_SESSION_NETWORK_H
+
+#include <esp_network.h>
+#include <tcp.h>
+#include <esp_tls.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "tls_session_cache.h"
+
+#if CONFIG_TLS_SESSION_CACHE
+/* Bounds a connect and lets the receive task notice a disconnect */
+#define TLS_SESSION_SSL_TIMEOUT_MS 10000
+#define TLS_SESSION_SSL_RECEIVE_BUFFER_SIZE 1500
+
+/*
+ * TLS over esp-tls that offers the cached session of the server and stores the session it
+ * negotiated, see TlsSessionCache.
+ */
+class TlsSessionSsl : public Tcp {
+public:
+    TlsSessionSsl();
+    ~TlsSessionSsl();
+
+    bool Connect(const std::string& host, int port) override;
+    void Disconnect() override;
+    int Send(const std::string& data) override;
+
+private:
+    esp_tls_t* tls_ = nullptr;
+    std::atomic<bool> running_ = false;
+    EventGroupHandle_t event_group_ = nullptr;
+    TaskHandle_t receive_task_ = nullptr;
+
+    bool Handshake(const std::string& host, int port, esp_tls_client_session_t* session);
+    void ReceiveTask();
+};
+
+/*
+ * EspNetwork whose HTTP, WebSocket and plain TLS clients all resume TLS sessions, the clients
+ * are created by EspNetwork and get their TLS transport from CreateSsl().
+ */
+class TlsSessionNetwork : public EspNetwork {
+public:
+    std::unique_ptr<Tcp> CreateSsl(int connect_id = -1) override;
+};
+#endif
+
+#endif // TLS_SESSION_NETWORK_H
@@ -5,6 +5,7 @@
 #include "system_info.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "tls_session_network.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -243,7 +244,11 @@ bool WifiBoard::IsInWifiConfigMode() const {
 }
 
 NetworkInterface* WifiBoard::GetNetwork() {
+#if CONFIG_TLS_SESSION_CACHE
+    static TlsSessionNetwork network;
+#else
     static EspNetwork network;
+#endif
     return &network;
 }
 
@@ -16,6 +16,7 @@
 
 #include "mp3_player.h"
 #include "../../audio/audio_codec.h"
+#include "application.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -594,9 +595,10 @@ void Mp3Player::DecodeAndPlay(const std::string& filepath) {
             }
             
             // Output when buffer is full enough
-            // The I2S write is blocking (portMAX_DELAY), providing natural pacing
+            // The mixer media queue blocks while full, providing natural pacing
             if (output_buffer.size() >= 1024) {
-                codec_->OutputData(output_buffer);
+                /* Copied into a pooled frame, output_buffer keeps its capacity for the next frames */
+                Application::GetInstance().GetAudioService().PushPcmToPlaybackQueue(AudioPcm(output_buffer.begin(), output_buffer.end()), true);
                 output_buffer.clear();
             }
         } else if (info.frame_bytes == 0) {
@@ -606,13 +608,16 @@ void Mp3Player::DecodeAndPlay(const std::string& filepath) {
             bytes_left--;
         }
         
-        // Yield to other tasks (I2S write already provides pacing)
+        // Yield to other tasks (the media queue already provides pacing)
         taskYIELD();
     }
     
-    // Output remaining samples
+    // Output remaining samples, or drop what is still queued when stopped
     if (!output_buffer.empty() && !stop_requested_) {
-        codec_->OutputData(output_buffer);
+        Application::GetInstance().GetAudioService().PushPcmToPlaybackQueue(AudioPcm(output_buffer.begin(), output_buffer.end()), true);
+    }
+    if (stop_requested_) {
+        Application::GetInstance().GetAudioService().ResetMedia();
     }
     
     // Reset LED audio energy when playback ends
@@ -1050,14 +1050,16 @@ void StreamPlayer::StreamAndDecode() {
                 codec_->EnableOutput(true);
             }
             
-            // Output to I2S when buffer is full enough
-            // Threshold 70ms = target_sr * 7 / 100 (1680 samples @ 24kHz)
-            // Balances latency vs overhead - copied from esp32_music
-            int threshold_samples = target_sr * 7 / 100;
-            if (threshold_samples < 500) threshold_samples = 500; // Minimum batch size
-            if ((int)output_buffer.size() >= threshold_samples) {
-                codec_->OutputData(output_buffer);
-                output_buffer.clear();
+            // Output to the mixer in 60ms chunks (1440 samples @ 24kHz), up to 48kHz a chunk
+            // fits one PCM block of the audio frame pool, output_buffer keeps its capacity
+            int chunk_samples = target_sr * 6 / 100;
+            if (chunk_samples < 500) chunk_samples = 500; // Minimum batch size
+            if ((int)output_buffer.size() >= chunk_samples) {
+                while ((int)output_buffer.size() >= chunk_samples) {
+                    AudioPcm pcm(output_buffer.begin(), output_buffer.begin() + chunk_samples);
+                    output_buffer.erase(output_buffer.begin(), output_buffer.begin() + chunk_samples);
+                    Application::GetInstance().GetAudioService().PushPcmToPlaybackQueue(std::move(pcm), true);
+                }
                 
                 // Yield CPU to prevent watchdog timeout during intensive decode
                 taskYIELD();
@@ -1074,10 +1076,12 @@ void StreamPlayer::StreamAndDecode() {
         taskYIELD();
     }
     
-    // Flush remaining audio
+    // Flush remaining audio, or drop what is still queued when stopped
     if (!output_buffer.empty() && !stop_requested_) {
-        if (!codec_->output_enabled()) codec_->EnableOutput(true);
-        codec_->OutputData(output_buffer);
+        Application::GetInstance().GetAudioService().PushPcmToPlaybackQueue(AudioPcm(output_buffer.begin(), output_buffer.end()), true);
+    }
+    if (stop_requested_) {
+        Application::GetInstance().GetAudioService().ResetMedia();
     }
     
     // Cleanup
@@ -26,6 +26,7 @@
 #include "assets/lang_config.h"
 #include "assets.h"
 #include "board.h"
+#include "task_topology.h"
 #include "gfx.h"
 #include "expression_emote.h"
 
@@ -92,16 +93,16 @@ static emote_handle_t InitializeEmote(const esp_lcd_panel_handle_t panel, const
         .buffers = {
             .buf_pixels = static_cast<size_t>(width * 16),
         },
-        .task = {
-            .task_priority = 5,
-            .task_stack = 6 * 1024,
-            .task_affinity = 0,
-            .task_stack_in_ext = false,
-        },
         .flush_cb = OnFlushCallback,
         .user_data = (void*)panel,
     };
 
+    auto& task = TaskTopology::GetInstance().Get(kTaskEmote);
+    emote_cfg.task.task_priority = task.priority;
+    emote_cfg.task.task_stack = task.stack_size;
+    emote_cfg.task.task_affinity = task.core;
+    emote_cfg.task.task_stack_in_ext = task.psram_stack;
+
     emote_handle_t emote_handle = emote_init(&emote_cfg);
     if (!emote_handle) {
         ESP_LOGE(TAG, "Failed to initialize emote");
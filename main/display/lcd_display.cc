@@ -2,6 +2,7 @@
 #include "gif/lvgl_gif.h"
 #include "settings.h"
 #include "lvgl_theme.h"
+#include "task_topology.h"
 #include "assets/lang_config.h"
 
 #include <vector>
@@ -89,6 +90,20 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
     esp_timer_create(&preview_timer_args, &preview_timer_);
 }
 
+/* Applies the topology on top of the display type's own defaults already in port_cfg */
+static void ApplyTaskTopology(lvgl_port_cfg_t& port_cfg) {
+    auto& task = TaskTopology::GetInstance().Get(kTaskDisplay);
+    if (task.priority > 0) {
+        port_cfg.task_priority = task.priority;
+    }
+    if (task.core != TASK_CORE_DEFAULT) {
+        port_cfg.task_affinity = task.core;
+    }
+    if (task.stack_size > 0) {
+        port_cfg.task_stack = task.stack_size;
+    }
+}
+
 SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                            int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy)
     : LcdDisplay(panel_io, panel, width, height) {
@@ -131,6 +146,7 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 #if CONFIG_SOC_CPU_CORES_NUM > 1
     port_cfg.task_affinity = 1;
 #endif
+    ApplyTaskTopology(port_cfg);
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding LCD display");
@@ -193,6 +209,7 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
     port_cfg.task_priority = 1;
     port_cfg.timer_period_ms = 50;
+    ApplyTaskTopology(port_cfg);
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding LCD display");
@@ -246,6 +263,7 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
 
     ESP_LOGI(TAG, "Initialize LVGL port");
     lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
+    ApplyTaskTopology(port_cfg);
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding LCD display");
@@ -2,6 +2,7 @@
 #include "assets/lang_config.h"
 #include "lvgl_theme.h"
 #include "lvgl_font.h"
+#include "task_topology.h"
 
 #include <string>
 #include <algorithm>
@@ -43,6 +44,16 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
 #if CONFIG_SOC_CPU_CORES_NUM > 1
     port_cfg.task_affinity = 1;
 #endif
+    auto& task = TaskTopology::GetInstance().Get(kTaskDisplay);
+    if (task.priority > 0) {
+        port_cfg.task_priority = task.priority;
+    }
+    if (task.core != TASK_CORE_DEFAULT) {
+        port_cfg.task_affinity = task.core;
+    }
+    if (task.stack_size > 0) {
+        port_cfg.task_stack = task.stack_size;
+    }
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding OLED display");
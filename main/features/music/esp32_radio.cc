@@ -1,8 +1,10 @@
 #include "esp32_radio.h"
 #include "board.h"
 #include "system_info.h"
+#include "task_topology.h"
 #include "audio/audio_codec.h"
 #include "audio/audio_service.h"
+#include "audio/resampler_manager.h"
 #include "application.h"
 #include "protocols/protocol.h"
 #include "display/display.h"
@@ -20,7 +22,6 @@
 #include <thread>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <esp_ae_rate_cvt.h>
 
 #define TAG "Esp32Radio"
 
@@ -209,15 +210,23 @@ bool Esp32Radio::PlayUrl(const std::string& radio_url, const std::string& statio
     if (current_station_volume_ <= 0.0f) {
         current_station_volume_ = 4.5f;  // Default volume for custom URLs
     }
+#if CONFIG_AUDIO_OUTPUT_LOUDNESS_NORMALIZATION
+    // The mixer brings every station to the same loudness, the per-station volume is not needed
+    Application::GetInstance().GetAudioService().GetMixer().SetGain(kAudioMixSourceMedia, 1.0f);
+#else
+    Application::GetInstance().GetAudioService().GetMixer().SetGain(kAudioMixSourceMedia, current_station_volume_);
+#endif
     
     // Clear the buffer
     ClearAudioBuffer();
     
-    // Configure thread stack size
+    // Configure thread stack size, priority and core from the task topology
+    auto& task = TaskTopology::GetInstance().Get(kTaskRadio);
     esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
-    cfg.stack_size = 1024 * 3 + 512;  // 3.5KB stack size
-    cfg.prio = 5;           // Medium priority
-    cfg.thread_name = "radio_stream";
+    cfg.stack_size = task.stack_size;
+    cfg.prio = task.priority;
+    cfg.pin_to_core = task.core;
+    cfg.thread_name = task.name;
     esp_pthread_set_cfg(&cfg);
     
     // Start download thread
@@ -272,6 +281,10 @@ bool Esp32Radio::Stop() {
         play_thread_.join();
         ESP_LOGI(TAG, "Play thread joined in Stop");
     }
+
+    // Drop the PCM still queued in the mixer so playback stops right away
+    Application::GetInstance().GetAudioService().ResetMedia();
+    Application::GetInstance().GetAudioService().GetMixer().SetGain(kAudioMixSourceMedia, 1.0f);
     
     // FFT display not implemented in this Display class
     
@@ -482,9 +495,8 @@ void Esp32Radio::PlayRadioStream() {
     uint8_t* read_ptr = nullptr;
     
     // Resampler for converting AAC sample rate to codec output rate
-    esp_ae_rate_cvt_handle_t radio_resampler = nullptr;
+    ResamplerManager::Resampler radio_resampler;
     int codec_output_rate = codec->output_sample_rate();
-    bool resampler_initialized = false;
     
     // Allocate input buffer (for both MP3 and AAC)
     input_buffer = (uint8_t*)heap_caps_malloc(4096, MALLOC_CAP_SPIRAM);
@@ -634,21 +646,10 @@ void Esp32Radio::PlayRadioStream() {
 
 					// Initialize resampler if AAC rate != codec rate
 					if (aac_info_.sample_rate != codec_output_rate && aac_info_.sample_rate > 0) {
-						ESP_LOGI(TAG, "Creating resampler: %d -> %d Hz", aac_info_.sample_rate, codec_output_rate);
-						esp_ae_rate_cvt_cfg_t cvt_cfg = {
-							.src_rate = (uint32_t)aac_info_.sample_rate,
-							.dest_rate = (uint32_t)codec_output_rate,
-							.channel = 1,
-						.bits_per_sample = ESP_AUDIO_BIT16,
-							.complexity = 2,
-							.perf_type = ESP_AE_RATE_CVT_PERF_TYPE_SPEED,
-						};
-						esp_err_t cvt_ret = esp_ae_rate_cvt_open(&cvt_cfg, &radio_resampler);
-						if (cvt_ret == ESP_OK && radio_resampler) {
-							resampler_initialized = true;
-							ESP_LOGI(TAG, "Radio resampler created successfully");
-						} else {
-							ESP_LOGW(TAG, "Failed to create resampler: %d, will use direct output", cvt_ret);
+						ESP_LOGI(TAG, "Using resampler: %d -> %d Hz", aac_info_.sample_rate, codec_output_rate);
+						radio_resampler = ResamplerManager::GetInstance().Acquire(aac_info_.sample_rate, codec_output_rate, 1);
+						if (!radio_resampler) {
+							ESP_LOGW(TAG, "Failed to create resampler, will use direct output");
 						}
 					} else {
 						ESP_LOGI(TAG, "No resampling needed (AAC rate matches codec rate)");
@@ -686,37 +687,14 @@ void Esp32Radio::PlayRadioStream() {
                     final_sample_count = total_samples;
                 }
                 
-                // Amplify audio using station-specific volume setting
-                std::vector<int16_t> amplified_buffer(final_sample_count);
-                const float amplification_factor = current_station_volume_; // Station-specific volume
-                
-                for (int i = 0; i < final_sample_count; ++i) {
-                    int32_t amplified_sample = (int32_t)(final_pcm_data[i] * amplification_factor);
-                    // Clamp to prevent overflow
-                    if (amplified_sample > INT16_MAX) {
-                        amplified_sample = INT16_MAX;
-                    } else if (amplified_sample < INT16_MIN) {
-                        amplified_sample = INT16_MIN;
-                    }
-                    amplified_buffer[i] = (int16_t)amplified_sample;
-                }
-                
-                // Resample if needed, then push raw PCM to playback queue
-                if (resampler_initialized && radio_resampler) {
-                    uint32_t max_out_samples = 0;
-                    esp_ae_rate_cvt_get_max_out_sample_num(radio_resampler, final_sample_count, &max_out_samples);
-                    std::vector<int16_t> resampled(max_out_samples);
-                    uint32_t actual_out = max_out_samples;
-                    esp_ae_rate_cvt_process(radio_resampler, 
-                        (esp_ae_sample_t)amplified_buffer.data(), final_sample_count,
-                        (esp_ae_sample_t)resampled.data(), &actual_out);
-                    resampled.resize(actual_out);
-                    app.GetAudioService().PushPcmToPlaybackQueue(
-                        std::move(resampled), true);
+                // Station volume is applied by the mixer, the output limiter keeps peaks from clipping
+                AudioPcm pcm;
+                if (radio_resampler) {
+                    radio_resampler.Process(final_pcm_data, final_sample_count, pcm);
                 } else {
-                    app.GetAudioService().PushPcmToPlaybackQueue(
-                        std::move(amplified_buffer), true);
+                    pcm.assign(final_pcm_data, final_pcm_data + final_sample_count);
                 }
+                app.GetAudioService().PushPcmToPlaybackQueue(std::move(pcm), true);
                 
                 if (total_print_bytes >= (128 * 1024)) {
                     total_print_bytes = 0;
@@ -741,10 +719,7 @@ void Esp32Radio::PlayRadioStream() {
     }
     
     // Cleanup
-    if (radio_resampler) {
-        esp_ae_rate_cvt_close(radio_resampler);
-        radio_resampler = nullptr;
-    }
+    radio_resampler.Release();
     if (input_buffer) {
         heap_caps_free(input_buffer);
     }
@@ -18,9 +18,13 @@
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
 #include "esp32_radio.h"
+#include "audio_benchmark.h"
 
 #define TAG "MCP"
 
+/* 60 seconds of 16kHz stereo (one microphone and the reference), the recording is held in memory */
+#define PROCESSOR_HARNESS_MAX_BYTES (60 * 16000 * 2 * sizeof(int16_t) + 1024)
+
 McpServer::McpServer() {
 }
 
@@ -225,6 +229,125 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.audio.get_latency_stats",
+        "Get the voice pipeline latency percentiles (p50/p95/p99 in ms) for every stage, from capture to playback",
+        PropertyList({
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto& tracer = Application::GetInstance().GetAudioService().GetLatencyTracer();
+            auto json = tracer.GetStatsJson();
+            if (properties["reset"].value<bool>()) {
+                tracer.Reset();
+            }
+            return json;
+        });
+
+    AddUserOnlyTool("self.audio.get_wake_word_stats",
+        "Get the wake word engine statistics: CPU time per audio chunk, detection latency, and detections / unconfirmed detections (no speech followed) per wake word or command",
+        PropertyList({
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto profiler = Application::GetInstance().GetAudioService().GetWakeWordProfiler();
+            if (profiler == nullptr) {
+                throw std::runtime_error("No wake word engine");
+            }
+            auto json = profiler->GetStatsJson();
+            if (properties["reset"].value<bool>()) {
+                profiler->Reset();
+            }
+            return json;
+        });
+
+    AddUserOnlyTool("self.audio.run_processor_harness",
+        "Replay a 16kHz 16-bit WAV recording (microphone channels, then the reference channel) through the audio processor and report VAD onset/offset latency against the labelled speech, clipped speech and per frame processing latency. Only while not listening.",
+        PropertyList({
+            Property("url", kPropertyTypeString),
+            Property("speech_start_ms", kPropertyTypeInteger, 0, 600000),
+            Property("speech_end_ms", kPropertyTypeInteger, 0, 600000)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto url = properties["url"].value<std::string>();
+            auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
+            if (!http->Open("GET", url)) {
+                throw std::runtime_error("Failed to open URL: " + url);
+            }
+            if (http->GetStatusCode() != 200) {
+                throw std::runtime_error("Unexpected status code: " + std::to_string(http->GetStatusCode()));
+            }
+            size_t content_length = http->GetBodyLength();
+            if (content_length == 0 || content_length > PROCESSOR_HARNESS_MAX_BYTES) {
+                throw std::runtime_error("Recording must have a Content-Length of 1 to " +
+                    std::to_string(PROCESSOR_HARNESS_MAX_BYTES) + " bytes, got " + std::to_string(content_length));
+            }
+            uint8_t* data = (uint8_t*)heap_caps_malloc(content_length, MALLOC_CAP_8BIT);
+            if (data == nullptr) {
+                throw std::runtime_error("Failed to allocate memory for the recording");
+            }
+            size_t total_read = 0;
+            while (total_read < content_length) {
+                int ret = http->Read((char*)data + total_read, content_length - total_read);
+                if (ret <= 0) {
+                    break;
+                }
+                total_read += ret;
+            }
+            http->Close();
+            if (total_read < content_length) {
+                heap_caps_free(data);
+                throw std::runtime_error("Download stopped after " + std::to_string(total_read) + " of " +
+                    std::to_string(content_length) + " bytes");
+            }
+
+            int channels = 0;
+            int sample_rate = 0;
+            const int16_t* pcm = nullptr;
+            size_t frames = 0;
+            std::string error;
+            auto codec = Board::GetInstance().GetAudioCodec();
+            if (!AudioProcessorHarness::ParseWav(data, total_read, channels, sample_rate, pcm, frames)) {
+                error = "Not a 16-bit PCM WAV file";
+            } else if (sample_rate != 16000 || channels != codec->input_channels()) {
+                error = "Expected 16000Hz with " + std::to_string(codec->input_channels()) + " channels";
+            }
+            if (!error.empty()) {
+                heap_caps_free(data);
+                throw std::runtime_error(error);
+            }
+
+            AudioProcessorHarness harness(channels, properties["speech_start_ms"].value<int>(),
+                properties["speech_end_ms"].value<int>());
+            bool ok = Application::GetInstance().GetAudioService().RunProcessorHarness(harness, pcm, frames);
+            heap_caps_free(data);
+            if (harness.interrupted()) {
+                throw std::runtime_error("Audio processor harness was interrupted by listening");
+            }
+            if (!ok) {
+                throw std::runtime_error("Audio processor harness failed");
+            }
+            return harness.GetResultJson();
+        });
+
+    AddUserOnlyTool("self.audio.run_benchmark",
+        "Benchmark Opus encode, Opus decode and output resampling on a generated signal, reporting frames/s, latency and pool misses per stage",
+        PropertyList({
+            Property("seconds", kPropertyTypeInteger, 5, 1, 30),
+            Property("frame_duration", kPropertyTypeInteger, OPUS_FRAME_DURATION_MS, 20, 60)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            int frame_duration = properties["frame_duration"].value<int>();
+            if (frame_duration != 20 && frame_duration != 40 && frame_duration != 60) {
+                throw std::runtime_error("frame_duration must be 20, 40 or 60");
+            }
+            auto codec = Board::GetInstance().GetAudioCodec();
+            AudioBenchmark benchmark(frame_duration, codec->output_sample_rate());
+            if (!benchmark.Run(properties["seconds"].value<int>())) {
+                throw std::runtime_error("Audio benchmark failed");
+            }
+            return benchmark.GetResultJson();
+        });
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -185,6 +185,27 @@ esp_err_t Ota::CheckVersion() {
         ESP_LOGI(TAG, "No websocket section found!");
     }
 
+    has_udp_config_ = false;
+    cJSON *udp = cJSON_GetObjectItem(root, "udp");
+    if (cJSON_IsObject(udp)) {
+        Settings settings("udp", true);
+        cJSON *item = NULL;
+        cJSON_ArrayForEach(item, udp) {
+            if (cJSON_IsString(item)) {
+                if (settings.GetString(item->string) != item->valuestring) {
+                    settings.SetString(item->string, item->valuestring);
+                }
+            } else if (cJSON_IsNumber(item)) {
+                if (settings.GetInt(item->string) != item->valueint) {
+                    settings.SetInt(item->string, item->valueint);
+                }
+            }
+        }
+        has_udp_config_ = true;
+    } else {
+        ESP_LOGI(TAG, "No udp section found");
+    }
+
     has_server_time_ = false;
     cJSON *server_time = cJSON_GetObjectItem(root, "server_time");
     if (cJSON_IsObject(server_time)) {
@@ -0,0 +1,68 @@
+#include "audio_cipher.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+#include <cstring>
+
+#define TAG "AudioCipher"
+
+AudioCipher::AudioCipher() {
+    mbedtls_aes_init(&ctx_);
+}
+
+AudioCipher::~AudioCipher() {
+    mbedtls_aes_free(&ctx_);
+}
+
+bool AudioCipher::SetKey(const std::string& key, const std::string& nonce) {
+    has_key_ = false;
+    if (key.size() != 16 || nonce.size() != kHeaderSize) {
+        ESP_LOGE(TAG, "Invalid key or nonce size: %u, %u", key.size(), nonce.size());
+        return false;
+    }
+    /* Frees the previous key schedule, the context is reused across sessions */
+    mbedtls_aes_free(&ctx_);
+    mbedtls_aes_init(&ctx_);
+    if (mbedtls_aes_setkey_enc(&ctx_, (const unsigned char*)key.data(), 128) != 0) {
+        ESP_LOGE(TAG, "Failed to set key");
+        return false;
+    }
+    memcpy(nonce_, nonce.data(), kHeaderSize);
+    has_key_ = true;
+    return true;
+}
+
+bool AudioCipher::Seal(const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence, std::string& datagram) {
+    if (!has_key_ || size > UINT16_MAX) {
+        return false;
+    }
+    /* Keeps the capacity, only the first packets of a session grow the buffer */
+    datagram.resize(kHeaderSize + size);
+    auto header = (uint8_t*)datagram.data();
+    memcpy(header, nonce_, kHeaderSize);
+    *(uint16_t*)&header[2] = htons(size);
+    *(uint32_t*)&header[8] = htonl(timestamp);
+    *(uint32_t*)&header[12] = htonl(sequence);
+    return Crypt(header, payload, size, header + kHeaderSize);
+}
+
+bool AudioCipher::Open(const uint8_t* datagram, size_t size, uint8_t* output) {
+    if (!has_key_ || size < kHeaderSize) {
+        return false;
+    }
+    return Crypt(datagram, datagram + kHeaderSize, size - kHeaderSize, output);
+}
+
+bool AudioCipher::Crypt(const uint8_t* counter, const uint8_t* input, size_t size, uint8_t* output) {
+    /* The cipher advances the counter block, so it works on a copy of the header */
+    uint8_t counter_block[kHeaderSize];
+    uint8_t stream_block[kHeaderSize];
+    memcpy(counter_block, counter, kHeaderSize);
+    size_t nc_off = 0;
+    int ret = mbedtls_aes_crypt_ctr(&ctx_, size, &nc_off, counter_block, stream_block, input, output);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "AES-CTR failed, ret: %d", ret);
+        return false;
+    }
+    return true;
+}
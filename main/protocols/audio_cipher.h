@@ -0,0 +1,54 @@
+#ifndef AUDIO_CIPHER_H
+#define AUDIO_CIPHER_H
+
+#include <mbedtls/aes.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * AES-128-CTR of the MQTT+UDP audio datagrams:
+ *
+ * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
+ * |payload payload_len|
+ *
+ * The 16-byte header is the initial counter block. It is the server nonce with the length,
+ * timestamp and sequence of the packet filled in, so it goes out in the clear and the payload
+ * is the only encrypted part.
+ *
+ * Seal() writes the header and the ciphertext straight into a datagram buffer the caller keeps
+ * between packets, so sending allocates and copies nothing once the buffer has grown to the
+ * largest packet. The keystream of a packet is generated in one call, which the hardware AES
+ * of ESP-IDF's mbedtls (CONFIG_MBEDTLS_HARDWARE_AES) runs as a single DMA transfer on chips
+ * with AES-DMA instead of one block at a time.
+ *
+ * Seal() and Open() may run on different tasks, SetKey() must not run concurrently with them.
+ */
+class AudioCipher {
+public:
+    static const size_t kHeaderSize = 16;
+
+    AudioCipher();
+    ~AudioCipher();
+    AudioCipher(const AudioCipher&) = delete;
+    AudioCipher& operator=(const AudioCipher&) = delete;
+
+    /* The key and nonce are the decoded hex strings of the server hello, 16 bytes each */
+    bool SetKey(const std::string& key, const std::string& nonce);
+    bool has_key() const { return has_key_; }
+
+    /* Replaces the contents of datagram with the encrypted packet */
+    bool Seal(const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence, std::string& datagram);
+    /* Decrypts the payload of a datagram into output, which holds size - kHeaderSize bytes */
+    bool Open(const uint8_t* datagram, size_t size, uint8_t* output);
+
+private:
+    mbedtls_aes_context ctx_;
+    uint8_t nonce_[kHeaderSize] = {0};
+    bool has_key_ = false;
+
+    bool Crypt(const uint8_t* counter, const uint8_t* input, size_t size, uint8_t* output);
+};
+
+#endif // AUDIO_CIPHER_H
@@ -32,6 +32,10 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+void Protocol::OnLinkReport(std::function<void(int rtt_ms, int loss_percent)> callback) {
+    on_link_report_ = callback;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -73,6 +77,21 @@ void Protocol::SendStopListening() {
     SendText(message);
 }
 
+bool Protocol::SendAudioBatch(std::vector<std::unique_ptr<AudioStreamPacket>>& packets) {
+    for (auto& packet : packets) {
+        if (!SendAudio(std::move(packet))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Protocol::SendAudioParams(int frame_duration) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"audio_params\",\"audio_params\":{";
+    message += "\"format\":\"opus\",\"sample_rate\":16000,\"channels\":1,\"frame_duration\":" + std::to_string(frame_duration) + "}}";
+    SendText(message);
+}
+
 void Protocol::SendMcpMessage(const std::string& payload) {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
     SendText(message);
@@ -5,13 +5,21 @@
 #include <string>
 #include <functional>
 #include <chrono>
+#include <memory>
 #include <vector>
 
+#include "audio_frame_pool.h"
+
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
-    std::vector<uint8_t> payload;
+    uint32_t sequence = 0;  // 0 if the transport does not number its packets
+    uint32_t enqueue_us = 0;  // Latency tracing, when the packet entered its current queue
+    AudioPayload payload;
+
+    static void* operator new(size_t size) { return AudioFrameAllocator<uint8_t>().allocate(size); }
+    static void operator delete(void* ptr) { AudioFramePool::GetInstance().Free(ptr); }
 };
 
 struct BinaryProtocol2 {
@@ -30,6 +38,14 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+struct BinaryProtocol4 {
+    uint8_t type;           // Message type (0: OPUS)
+    uint8_t frame_count;    // Number of Opus frames in the message
+    uint16_t payload_size;  // Payload size in bytes, including the frame size table
+    uint32_t timestamp;     // Timestamp of the first frame in milliseconds
+    uint8_t payload[];      // frame_count uint16_t frame sizes, followed by the frames
+} __attribute__((packed));
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -54,6 +70,13 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    inline int link_rtt_ms() const {
+        return link_rtt_ms_;
+    }
+    /* Upper bound of Opus frames SendAudioBatch() packs into one message, 1 if it cannot coalesce */
+    virtual int audio_batch_frames() const {
+        return 1;
+    }
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
@@ -62,18 +85,24 @@ public:
     void OnNetworkError(std::function<void(const std::string& message)> callback);
     void OnConnected(std::function<void()> callback);
     void OnDisconnected(std::function<void()> callback);
+    /* Loss and RTT of the audio sent, for transports whose server reports them */
+    void OnLinkReport(std::function<void(int rtt_ms, int loss_percent)> callback);
 
     virtual bool Start() = 0;
+    /* Starts connecting in the background so a following OpenAudioChannel() returns sooner */
+    virtual void PreConnect() {}
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel(bool send_goodbye = true) = 0;
     virtual bool IsAudioChannelOpened() const = 0;
     virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    virtual bool SendAudioBatch(std::vector<std::unique_ptr<AudioStreamPacket>>& packets);
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
     virtual void SendChatText(const std::string& text);  // Send text chat to AI server
+    virtual void SendAudioParams(int frame_duration);
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
@@ -83,9 +112,11 @@ protected:
     std::function<void(const std::string& message)> on_network_error_;
     std::function<void()> on_connected_;
     std::function<void()> on_disconnected_;
+    std::function<void(int rtt_ms, int loss_percent)> on_link_report_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int link_rtt_ms_ = 0;  // Measured from the hello exchange, or from acknowledgements if the transport has them
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
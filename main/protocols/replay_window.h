@@ -0,0 +1,81 @@
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <cstdint>
+
+/*
+ * Sliding replay window over 32-bit packet sequence numbers.
+ *
+ * Packets newer than the highest sequence seen so far move the window forward. Older packets
+ * are accepted once if they fall within the last kSize sequences, so datagrams reordered by the
+ * network reach the jitter buffer instead of being dropped, while duplicates and replays are
+ * rejected. A peer that restarts its numbering would otherwise look like a stream of stale
+ * packets, so kResyncCount consecutive stale packets restart the window at the new sequence.
+ */
+class ReplayWindow {
+public:
+    static const uint32_t kSize = 64;
+    static const int kResyncCount = 8;
+
+    enum Result {
+        kAccepted,
+        kDuplicate,
+        kTooOld,
+    };
+
+    void Reset() {
+        highest_ = 0;
+        bitmap_ = 0;
+        stale_count_ = 0;
+        started_ = false;
+    }
+
+    Result Check(uint32_t sequence) {
+        if (!started_) {
+            Restart(sequence);
+            return kAccepted;
+        }
+
+        int32_t ahead = (int32_t)(sequence - highest_);
+        if (ahead > 0) {
+            bitmap_ = (uint32_t)ahead >= kSize ? 0 : bitmap_ << ahead;
+            bitmap_ |= 1;
+            highest_ = sequence;
+            stale_count_ = 0;
+            return kAccepted;
+        }
+
+        uint32_t behind = (uint32_t)-ahead;
+        if (behind >= kSize) {
+            if (++stale_count_ >= kResyncCount) {
+                Restart(sequence);
+                return kAccepted;
+            }
+            return kTooOld;
+        }
+        stale_count_ = 0;
+        uint64_t bit = 1ULL << behind;
+        if (bitmap_ & bit) {
+            return kDuplicate;
+        }
+        bitmap_ |= bit;
+        return kAccepted;
+    }
+
+    uint32_t highest() const { return highest_; }
+
+private:
+    uint32_t highest_ = 0;
+    uint64_t bitmap_ = 0;   // Bit n is set if highest_ - n has been received
+    int stale_count_ = 0;
+    bool started_ = false;
+
+    void Restart(uint32_t sequence) {
+        highest_ = sequence;
+        bitmap_ = 1;
+        stale_count_ = 0;
+        started_ = true;
+    }
+};
+
+#endif // REPLAY_WINDOW_H
@@ -0,0 +1,330 @@
+#include "udp_protocol.h"
+#include "board.h"
+#include "application.h"
+#include "settings.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include "assets/lang_config.h"
+
+#define TAG "UDP"
+
+static std::string DecodeHexString(const std::string& hex_string) {
+    auto hex_value = [](char c) -> uint8_t {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return 0;
+    };
+    std::string decoded;
+    decoded.reserve(hex_string.size() / 2);
+    for (size_t i = 0; i + 1 < hex_string.size(); i += 2) {
+        decoded.push_back((char)((hex_value(hex_string[i]) << 4) | hex_value(hex_string[i + 1])));
+    }
+    return decoded;
+}
+
+UdpProtocol::UdpProtocol() {
+    event_group_handle_ = xEventGroupCreate();
+
+    esp_timer_create_args_t poll_timer_args = {
+        .callback = [](void* arg) {
+            ((UdpProtocol*)arg)->Poll();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "udp_poll",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&poll_timer_args, &poll_timer_);
+}
+
+UdpProtocol::~UdpProtocol() {
+    ESP_LOGI(TAG, "UdpProtocol deinit");
+    *alive_ = false;
+    if (poll_timer_ != nullptr) {
+        esp_timer_stop(poll_timer_);
+        esp_timer_delete(poll_timer_);
+    }
+    Disconnect();
+    vEventGroupDelete(event_group_handle_);
+}
+
+bool UdpProtocol::Start() {
+    // Only connect to server when audio channel is needed
+    return true;
+}
+
+void UdpProtocol::Poll() {
+    bool failed = false;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (session_ == nullptr || !session_->established()) {
+            return;
+        }
+        failed = !session_->Poll();
+        int64_t now_ms = esp_timer_get_time() / 1000;
+        if (!failed && now_ms - last_ping_ms_ >= UDP_PROTOCOL_PING_INTERVAL_MS) {
+            last_ping_ms_ = now_ms;
+            session_->SendPing();
+        }
+    }
+    if (failed) {
+        esp_timer_stop(poll_timer_);
+        SetError(Lang::Strings::SERVER_TIMEOUT);
+    }
+}
+
+bool UdpProtocol::SendMessage(UdpStream stream, const std::string& message) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (session_ == nullptr || !session_->established()) {
+        return false;
+    }
+    if (!session_->SendMessage(stream, message)) {
+        ESP_LOGE(TAG, "Failed to send message of %u bytes on stream %d", message.size(), (int)stream);
+        return false;
+    }
+    return true;
+}
+
+bool UdpProtocol::SendText(const std::string& text) {
+    return SendMessage(kUdpStreamControl, text);
+}
+
+void UdpProtocol::SendMcpMessage(const std::string& payload) {
+    /* MCP replies can be large, on their own stream they do not hold up listen and abort messages */
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
+    SendMessage(kUdpStreamMcp, message);
+}
+
+bool UdpProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (session_ == nullptr) {
+        return false;
+    }
+    return session_->SendAudio(packet->timestamp, packet->payload.data(), packet->payload.size());
+}
+
+bool UdpProtocol::IsAudioChannelOpened() const {
+    return session_ != nullptr && session_->established() && !error_occurred_ && !IsTimeout();
+}
+
+void UdpProtocol::Disconnect() {
+    std::unique_ptr<Udp> udp;
+    std::unique_ptr<UdpSession> session;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        udp = std::move(udp_);
+        session = std::move(session_);
+    }
+    /* The receive task may still be in the session, it is stopped before the session goes away */
+    udp.reset();
+    session.reset();
+}
+
+void UdpProtocol::CloseAudioChannel(bool send_goodbye) {
+    ESP_LOGI(TAG, "Closing audio channel, send_goodbye: %d", send_goodbye);
+    esp_timer_stop(poll_timer_);
+
+    // Only send goodbye when client initiates the close
+    // Don't send if server already sent goodbye (to avoid ping-pong)
+    if (send_goodbye) {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (session_ != nullptr) {
+            session_->SendClose();
+        }
+    }
+    Disconnect();
+
+    if (on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
+}
+
+bool UdpProtocol::OpenAudioChannel() {
+    Settings settings("udp", false);
+    auto server = settings.GetString("server");
+    int port = settings.GetInt("port", 8884);
+    auto key = DecodeHexString(settings.GetString("key"));
+    if (server.empty() || key.size() != 16) {
+        ESP_LOGE(TAG, "UDP server or key is not specified");
+        SetError(Lang::Strings::SERVER_NOT_FOUND);
+        return false;
+    }
+
+    esp_timer_stop(poll_timer_);
+    Disconnect();
+    error_occurred_ = false;
+    session_id_ = "";
+    xEventGroupClearBits(event_group_handle_, UDP_PROTOCOL_SERVER_HELLO_EVENT);
+
+    auto network = Board::GetInstance().GetNetwork();
+    auto udp = network->CreateUdp(2);
+    auto udp_ptr = udp.get();
+    auto session = std::make_unique<UdpSession>([udp_ptr](const std::string& datagram) {
+        return udp_ptr->Send(datagram) > 0;
+    });
+    auto session_ptr = session.get();
+
+    session->OnAudio([this](uint32_t sequence, uint32_t timestamp, const uint8_t* data, size_t size) {
+        if (on_incoming_audio_ == nullptr) {
+            return;
+        }
+        auto packet = std::make_unique<AudioStreamPacket>();
+        packet->sample_rate = server_sample_rate_;
+        packet->frame_duration = server_frame_duration_;
+        packet->timestamp = timestamp;
+        packet->sequence = sequence;
+        packet->payload.assign(data, data + size);
+        on_incoming_audio_(std::move(packet));
+    });
+    session->OnMessage([this](UdpStream stream, const std::string& message) {
+        cJSON* root = cJSON_Parse(message.c_str());
+        if (root == nullptr) {
+            ESP_LOGE(TAG, "Failed to parse json message %s", message.c_str());
+            return;
+        }
+        cJSON* type = cJSON_GetObjectItem(root, "type");
+        if (!cJSON_IsString(type)) {
+            ESP_LOGE(TAG, "Message type is invalid");
+        } else if (strcmp(type->valuestring, "goodbye") == 0) {
+            auto alive = alive_;  // Capture alive flag
+            Application::GetInstance().Schedule([this, alive]() {
+                if (*alive) {
+                    CloseAudioChannel(false);
+                }
+            });
+        } else if (on_incoming_json_ != nullptr) {
+            on_incoming_json_(root);
+        }
+        cJSON_Delete(root);
+    });
+    session->OnReport([this](const UdpLinkReport& report) {
+        ESP_LOGD(TAG, "Link report: rtt %dms, loss %d%%, jitter %dms", report.rtt_ms, report.loss_percent, report.jitter_ms);
+        if (report.rtt_ms > 0) {
+            link_rtt_ms_ = report.rtt_ms;
+        }
+        if (on_link_report_ != nullptr) {
+            on_link_report_(link_rtt_ms_, report.loss_percent);
+        }
+    });
+    session->OnClose([this]() {
+        ESP_LOGI(TAG, "Connection closed by the server");
+        auto alive = alive_;  // Capture alive flag
+        Application::GetInstance().Schedule([this, alive]() {
+            if (*alive) {
+                // Server initiated close, don't send close back
+                CloseAudioChannel(false);
+            }
+        });
+    });
+
+    udp->OnMessage([this, session_ptr](const std::string& data) {
+        if (!session_ptr->established()) {
+            if (session_ptr->Accept(data, server_hello_)) {
+                xEventGroupSetBits(event_group_handle_, UDP_PROTOCOL_SERVER_HELLO_EVENT);
+            }
+            return;
+        }
+        if (session_ptr->Receive(data)) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
+        }
+    });
+    if (!udp->Connect(server, port)) {
+        ESP_LOGE(TAG, "Failed to connect to %s:%d", server.c_str(), port);
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        return false;
+    }
+
+    auto hello = session->Hello(key, GetHelloMessage());
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        udp_ = std::move(udp);
+        session_ = std::move(session);
+    }
+
+    /* Nothing retransmits the hello but this loop, the RTT is taken from the answered one */
+    auto hello_time = std::chrono::steady_clock::now();
+    EventBits_t bits = 0;
+    for (int waited_ms = 0; waited_ms < UDP_PROTOCOL_SERVER_HELLO_TIMEOUT_MS; waited_ms += UDP_PROTOCOL_HELLO_RETRY_MS) {
+        hello_time = std::chrono::steady_clock::now();
+        udp_ptr->Send(hello);
+        bits = xEventGroupWaitBits(event_group_handle_, UDP_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE,
+            pdMS_TO_TICKS(UDP_PROTOCOL_HELLO_RETRY_MS));
+        if (bits & UDP_PROTOCOL_SERVER_HELLO_EVENT) {
+            break;
+        }
+    }
+    if (!(bits & UDP_PROTOCOL_SERVER_HELLO_EVENT)) {
+        ESP_LOGE(TAG, "Failed to receive server hello");
+        Disconnect();
+        SetError(Lang::Strings::SERVER_TIMEOUT);
+        return false;
+    }
+    link_rtt_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hello_time).count();
+
+    cJSON* root = cJSON_Parse(server_hello_.c_str());
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Failed to parse server hello: %s", server_hello_.c_str());
+        Disconnect();
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    ParseServerHello(root);
+    cJSON_Delete(root);
+    ESP_LOGI(TAG, "Connected to %s:%d, connection id %08lx, rtt %dms", server.c_str(), port,
+        session_ptr->connection_id(), link_rtt_ms_);
+
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    last_ping_ms_ = esp_timer_get_time() / 1000;
+    esp_timer_start_periodic(poll_timer_, UDP_PROTOCOL_POLL_INTERVAL_MS * 1000);
+
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+std::string UdpProtocol::GetHelloMessage() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", "hello");
+    cJSON_AddNumberToObject(root, "version", 1);
+    cJSON_AddStringToObject(root, "transport", "udp");
+    cJSON* features = cJSON_CreateObject();
+#if CONFIG_USE_SERVER_AEC
+    cJSON_AddBoolToObject(features, "aec", true);
+#endif
+    cJSON_AddBoolToObject(features, "mcp", true);
+    cJSON_AddItemToObject(root, "features", features);
+    cJSON* audio_params = cJSON_CreateObject();
+    cJSON_AddStringToObject(audio_params, "format", "opus");
+    cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
+    cJSON_AddNumberToObject(audio_params, "channels", 1);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddItemToObject(root, "audio_params", audio_params);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string message(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return message;
+}
+
+void UdpProtocol::ParseServerHello(const cJSON* root) {
+    auto session_id = cJSON_GetObjectItem(root, "session_id");
+    if (cJSON_IsString(session_id)) {
+        session_id_ = session_id->valuestring;
+        ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
+    }
+
+    auto audio_params = cJSON_GetObjectItem(root, "audio_params");
+    if (cJSON_IsObject(audio_params)) {
+        auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
+        if (cJSON_IsNumber(sample_rate)) {
+            server_sample_rate_ = sample_rate->valueint;
+        }
+        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
+        if (cJSON_IsNumber(frame_duration)) {
+            server_frame_duration_ = frame_duration->valueint;
+        }
+    }
+}
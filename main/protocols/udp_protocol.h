@@ -0,0 +1,70 @@
+#ifndef UDP_PROTOCOL_H
+#define UDP_PROTOCOL_H
+
+
+#include "protocol.h"
+#include "udp_session.h"
+
+#include <udp.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#define UDP_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define UDP_PROTOCOL_SERVER_HELLO_TIMEOUT_MS 10000
+/* The hello is sent again until it is answered, a lost one costs this much */
+#define UDP_PROTOCOL_HELLO_RETRY_MS 500
+#define UDP_PROTOCOL_POLL_INTERVAL_MS 50
+/* Keeps the NAT binding open and the RTT estimate fresh while nothing else is sent */
+#define UDP_PROTOCOL_PING_INTERVAL_MS 15000
+
+/*
+ * Audio, control JSON and MCP over one encrypted UDP flow, see docs/udp.md.
+ *
+ * Audio frames are sent once, JSON goes over two reliable streams that are ordered on their
+ * own, so a lost datagram holds up neither the audio nor the other stream. Receiver reports of
+ * the server are passed on through OnLinkReport() for the encoder to adapt to the loss.
+ *
+ * The server and the 16-byte key come from the udp section of the OTA config.
+ */
+class UdpProtocol : public Protocol {
+public:
+    UdpProtocol();
+    ~UdpProtocol();
+
+    bool Start() override;
+    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool OpenAudioChannel() override;
+    void CloseAudioChannel(bool send_goodbye = true) override;
+    bool IsAudioChannelOpened() const override;
+    void SendMcpMessage(const std::string& message) override;
+
+private:
+    // Alive flag for safe scheduled callbacks - set to false in destructor
+    std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
+
+    EventGroupHandle_t event_group_handle_;
+    esp_timer_handle_t poll_timer_ = nullptr;
+    int64_t last_ping_ms_ = 0;
+
+    /* udp_ and session_ are replaced under channel_mutex_, the receive task uses them without it */
+    std::mutex channel_mutex_;
+    std::unique_ptr<Udp> udp_;
+    std::unique_ptr<UdpSession> session_;
+    std::string server_hello_;
+
+    void Poll();
+    void Disconnect();
+    void ParseServerHello(const cJSON* root);
+    bool SendMessage(UdpStream stream, const std::string& message);
+    bool SendText(const std::string& text) override;
+    std::string GetHelloMessage();
+};
+
+
+#endif // UDP_PROTOCOL_H
@@ -0,0 +1,569 @@
+#include "udp_session.h"
+
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <mbedtls/md.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#define TAG "UdpSession"
+
+#define UDP_SESSION_TAG_SIZE 16
+#define UDP_SESSION_IV_SIZE 12
+#define UDP_SESSION_FLAG_SERVER 0x01
+/* Mixed into the session key so it cannot collide with keys derived for other purposes */
+#define UDP_SESSION_KEY_LABEL "xiaozhi-udp"
+
+static void PutU16(std::string& out, uint16_t value) {
+    out.push_back((char)(value >> 8));
+    out.push_back((char)value);
+}
+
+static void PutU32(std::string& out, uint32_t value) {
+    PutU16(out, value >> 16);
+    PutU16(out, value);
+}
+
+static uint16_t GetU16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t GetU32(const uint8_t* p) {
+    return ((uint32_t)GetU16(p) << 16) | GetU16(p + 2);
+}
+
+static int64_t NowMs() {
+    return esp_timer_get_time() / 1000;
+}
+
+UdpSession::UdpSession(SendFunction send) : send_(send) {
+    mbedtls_gcm_init(&gcm_);
+}
+
+UdpSession::~UdpSession() {
+    mbedtls_gcm_free(&gcm_);
+}
+
+void UdpSession::OnAudio(std::function<void(uint32_t sequence, uint32_t timestamp, const uint8_t* data, size_t size)> callback) {
+    on_audio_ = callback;
+}
+
+void UdpSession::OnMessage(std::function<void(UdpStream stream, const std::string& message)> callback) {
+    on_message_ = callback;
+}
+
+void UdpSession::OnReport(std::function<void(const UdpLinkReport& report)> callback) {
+    on_report_ = callback;
+}
+
+void UdpSession::OnClose(std::function<void()> callback) {
+    on_close_ = callback;
+}
+
+bool UdpSession::SetKey(const uint8_t* key) {
+    mbedtls_gcm_free(&gcm_);
+    mbedtls_gcm_init(&gcm_);
+    if (mbedtls_gcm_setkey(&gcm_, MBEDTLS_CIPHER_ID_AES, key, 128) != 0) {
+        ESP_LOGE(TAG, "Failed to set key");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Data packets use the direction, connection id and packet number of the header as the nonce,
+ * which never repeats under a session key. The pre-shared key outlives every connection and the
+ * connection id has only 32 random bits, so handshake packets carry a random nonce in the clear
+ * after the header instead.
+ */
+static void MakeIv(const UdpPacketHeader& header, uint8_t iv[UDP_SESSION_IV_SIZE]) {
+    memset(iv, 0, UDP_SESSION_IV_SIZE);
+    iv[0] = header.flags & UDP_SESSION_FLAG_SERVER;
+    memcpy(iv + 4, &header.connection_id, 4);
+    memcpy(iv + 8, &header.packet_number, 4);
+}
+
+bool UdpSession::Seal(uint8_t type, uint32_t packet_number, const std::string& plaintext, std::string& datagram) {
+    size_t nonce_size = type == kUdpPacketData ? 0 : UDP_SESSION_IV_SIZE;
+    size_t length = nonce_size + plaintext.size() + UDP_SESSION_TAG_SIZE;
+    if (sizeof(UdpPacketHeader) + length > UDP_SESSION_MAX_DATAGRAM) {
+        ESP_LOGE(TAG, "Packet too large: %u", plaintext.size());
+        return false;
+    }
+    /* Keeps the capacity, sending allocates nothing once the buffer has grown */
+    datagram.resize(sizeof(UdpPacketHeader) + length);
+    auto header = (UdpPacketHeader*)datagram.data();
+    header->type = type;
+    header->flags = 0;
+    header->length = htons(length);
+    header->connection_id = htonl(connection_id_);
+    header->packet_number = htonl(packet_number);
+
+    uint8_t iv[UDP_SESSION_IV_SIZE];
+    auto nonce = (uint8_t*)datagram.data() + sizeof(UdpPacketHeader);
+    if (nonce_size > 0) {
+        esp_fill_random(nonce, nonce_size);
+        memcpy(iv, nonce, sizeof(iv));
+    } else {
+        MakeIv(*header, iv);
+    }
+    /* The clear nonce is authenticated along with the header */
+    auto output = nonce + nonce_size;
+    int ret = mbedtls_gcm_crypt_and_tag(&gcm_, MBEDTLS_GCM_ENCRYPT, plaintext.size(), iv, sizeof(iv),
+        (const uint8_t*)header, sizeof(UdpPacketHeader) + nonce_size, (const uint8_t*)plaintext.data(), output,
+        UDP_SESSION_TAG_SIZE, output + plaintext.size());
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to seal packet, ret: %d", ret);
+        return false;
+    }
+    return true;
+}
+
+bool UdpSession::Open(const std::string& datagram, uint8_t expected_type, uint32_t& packet_number, std::string& plaintext) {
+    size_t nonce_size = expected_type == kUdpPacketData ? 0 : UDP_SESSION_IV_SIZE;
+    if (datagram.size() < sizeof(UdpPacketHeader) + nonce_size + UDP_SESSION_TAG_SIZE) {
+        return false;
+    }
+    UdpPacketHeader header;
+    memcpy(&header, datagram.data(), sizeof(header));
+    if (header.type != expected_type || !(header.flags & UDP_SESSION_FLAG_SERVER) ||
+        ntohl(header.connection_id) != connection_id_ || ntohs(header.length) != datagram.size() - sizeof(header)) {
+        return false;
+    }
+    packet_number = ntohl(header.packet_number);
+
+    uint8_t iv[UDP_SESSION_IV_SIZE];
+    auto nonce = (const uint8_t*)datagram.data() + sizeof(header);
+    if (nonce_size > 0) {
+        memcpy(iv, nonce, sizeof(iv));
+    } else {
+        MakeIv(header, iv);
+    }
+    size_t size = datagram.size() - sizeof(header) - nonce_size - UDP_SESSION_TAG_SIZE;
+    auto input = nonce + nonce_size;
+    plaintext.resize(size);
+    int ret = mbedtls_gcm_auth_decrypt(&gcm_, size, iv, sizeof(iv), (const uint8_t*)datagram.data(),
+        sizeof(header) + nonce_size, input + size, UDP_SESSION_TAG_SIZE, input, (uint8_t*)plaintext.data());
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Dropped packet %lu that failed authentication", packet_number);
+        return false;
+    }
+    return true;
+}
+
+std::string UdpSession::Hello(const std::string& key, const std::string& json) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    established_ = false;
+    key_ = key;
+    connection_id_ = esp_random();
+    esp_fill_random(client_random_, sizeof(client_random_));
+
+    std::string datagram;
+    if (key_.size() != 16 || !SetKey((const uint8_t*)key_.data())) {
+        ESP_LOGE(TAG, "Invalid key");
+        return datagram;
+    }
+    std::string plaintext((const char*)client_random_, sizeof(client_random_));
+    plaintext += json;
+    Seal(kUdpPacketHello, 0, plaintext, datagram);
+    return datagram;
+}
+
+bool UdpSession::Accept(const std::string& datagram, std::string& json) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (established_ || key_.empty()) {
+        return false;
+    }
+    uint32_t packet_number;
+    if (!Open(datagram, kUdpPacketHelloAck, packet_number, plaintext_) || packet_number != 0 || plaintext_.size() < 16) {
+        return false;
+    }
+
+    /* session key = HMAC-SHA256(key, label | client random | server random), first 16 bytes */
+    std::string input = UDP_SESSION_KEY_LABEL;
+    input.append((const char*)client_random_, sizeof(client_random_));
+    input.append(plaintext_, 0, 16);
+    uint8_t session_key[32];
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t*)key_.data(), key_.size(),
+        (const uint8_t*)input.data(), input.size(), session_key) != 0 || !SetKey(session_key)) {
+        ESP_LOGE(TAG, "Failed to derive session key");
+        return false;
+    }
+    json = plaintext_.substr(16);
+
+    next_packet_number_ = 1;
+    next_audio_sequence_ = 1;
+    std::fill(std::begin(next_message_id_), std::end(next_message_id_), 1);
+    std::fill(std::begin(next_delivery_id_), std::end(next_delivery_id_), 1);
+    for (auto& pending : pending_) {
+        pending.clear();
+    }
+    unacked_.clear();
+    sent_times_.clear();
+    replay_window_.Reset();
+    ack_started_ = false;
+    srtt_ms_ = 0;
+    rttvar_ms_ = 0;
+    audio_started_ = false;
+    audio_received_ = 0;
+    audio_last_arrival_ms_ = 0;
+    jitter_q4_ = 0;
+    established_ = true;
+    return true;
+}
+
+bool UdpSession::SendFrames(bool ack_eliciting, uint32_t* packet_number) {
+    uint32_t number = next_packet_number_++;
+    if (!Seal(kUdpPacketData, number, frames_, datagram_)) {
+        return false;
+    }
+    if (ack_eliciting) {
+        sent_times_[number] = NowMs();
+        /* Packets that are never acknowledged must not pile up */
+        while (sent_times_.size() > 64) {
+            sent_times_.erase(sent_times_.begin());
+        }
+    }
+    if (packet_number != nullptr) {
+        *packet_number = number;
+    }
+    return send_(datagram_);
+}
+
+bool UdpSession::SendAudio(uint32_t timestamp, const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!established_) {
+        return false;
+    }
+    frames_.clear();
+    frames_.push_back(kUdpFrameAudio);
+    PutU32(frames_, next_audio_sequence_++);
+    PutU32(frames_, timestamp);
+    PutU16(frames_, size);
+    frames_.append((const char*)data, size);
+    return SendFrames(false);
+}
+
+bool UdpSession::SendFragment(Fragment& fragment) {
+    frames_.clear();
+    frames_.push_back(kUdpFrameStream);
+    frames_.push_back(fragment.stream);
+    PutU32(frames_, fragment.message_id);
+    frames_.push_back(fragment.index);
+    frames_.push_back(fragment.count);
+    PutU16(frames_, fragment.data.size());
+    frames_.append(fragment.data);
+    fragment.sent_ms = NowMs();
+    return SendFrames(true, &fragment.packet_number);
+}
+
+bool UdpSession::SendMessage(UdpStream stream, const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!established_) {
+        return false;
+    }
+    size_t count = std::max<size_t>(1, (message.size() + UDP_SESSION_MAX_FRAGMENT - 1) / UDP_SESSION_MAX_FRAGMENT);
+    if (count > UDP_SESSION_MAX_FRAGMENTS) {
+        ESP_LOGE(TAG, "Message too large: %u", message.size());
+        return false;
+    }
+    uint32_t message_id = next_message_id_[stream]++;
+    for (size_t i = 0; i < count; i++) {
+        Fragment fragment = {
+            .stream = stream,
+            .message_id = message_id,
+            .index = (uint8_t)i,
+            .count = (uint8_t)count,
+            .data = message.substr(i * UDP_SESSION_MAX_FRAGMENT, UDP_SESSION_MAX_FRAGMENT),
+        };
+        /* A fragment that fails to go out now is retransmitted by Poll() like a lost one */
+        if (!SendFragment(fragment)) {
+            ESP_LOGW(TAG, "Fragment %u of message %lu not sent, it is retransmitted", i, message_id);
+        }
+        unacked_.push_back(std::move(fragment));
+    }
+    return true;
+}
+
+void UdpSession::SendPing() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!established_) {
+        return;
+    }
+    frames_.assign(1, (char)kUdpFramePing);
+    SendFrames(true);
+}
+
+void UdpSession::SendClose() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!established_) {
+        return;
+    }
+    frames_.assign(1, (char)kUdpFrameClose);
+    SendFrames(false);
+    established_ = false;
+}
+
+void UdpSession::SendAck(uint32_t ack_delay_ms) {
+    frames_.assign(1, (char)kUdpFrameAck);
+    PutU32(frames_, ack_largest_);
+    PutU32(frames_, (uint32_t)(ack_bitmap_ >> 1));
+    PutU16(frames_, std::min<uint32_t>(ack_delay_ms, UINT16_MAX));
+    SendFrames(false);
+}
+
+void UdpSession::SendReport() {
+    uint32_t expected = audio_highest_ - audio_report_base_;
+    uint32_t lost = expected > audio_received_ ? expected - audio_received_ : 0;
+    frames_.assign(1, (char)kUdpFrameReport);
+    PutU16(frames_, std::min<uint32_t>(expected, UINT16_MAX));
+    PutU16(frames_, std::min<uint32_t>(lost, UINT16_MAX));
+    PutU16(frames_, jitter_q4_ / 16);
+    SendFrames(false);
+    audio_report_base_ = audio_highest_;
+    audio_received_ = 0;
+}
+
+void UdpSession::RecordAck(uint32_t packet_number) {
+    int32_t ahead = (int32_t)(packet_number - ack_largest_);
+    if (!ack_started_ || ahead > 0) {
+        ack_bitmap_ = !ack_started_ || ahead >= 64 ? 0 : ack_bitmap_ << ahead;
+        ack_bitmap_ |= 1;
+        ack_largest_ = packet_number;
+        ack_started_ = true;
+    } else if (-ahead < 64) {
+        ack_bitmap_ |= 1ULL << -ahead;
+    }
+}
+
+/* RFC 6298 */
+void UdpSession::UpdateRtt(int sample_ms) {
+    sample_ms = std::max(sample_ms, 1);
+    if (srtt_ms_ == 0) {
+        srtt_ms_ = sample_ms;
+        rttvar_ms_ = sample_ms / 2;
+    } else {
+        rttvar_ms_ = (3 * rttvar_ms_ + std::abs(srtt_ms_ - sample_ms)) / 4;
+        srtt_ms_ = (7 * srtt_ms_ + sample_ms) / 8;
+    }
+}
+
+int UdpSession::Rto() const {
+    if (srtt_ms_ == 0) {
+        return UDP_SESSION_MAX_RTO_MS / 2;
+    }
+    return std::clamp(srtt_ms_ + 4 * rttvar_ms_, UDP_SESSION_MIN_RTO_MS, UDP_SESSION_MAX_RTO_MS);
+}
+
+void UdpSession::ReceiveAck(uint32_t largest, uint32_t bitmap, uint32_t ack_delay_ms) {
+    auto acked = [largest, bitmap](uint32_t number) {
+        uint32_t behind = largest - number;
+        return behind == 0 || (behind <= 32 && (bitmap & (1u << (behind - 1))));
+    };
+
+    auto sent = sent_times_.find(largest);
+    if (sent != sent_times_.end()) {
+        UpdateRtt((int)(NowMs() - sent->second) - (int)ack_delay_ms);
+    }
+    for (auto it = sent_times_.begin(); it != sent_times_.end();) {
+        it = acked(it->first) ? sent_times_.erase(it) : std::next(it);
+    }
+    unacked_.erase(std::remove_if(unacked_.begin(), unacked_.end(), [&acked](const Fragment& fragment) {
+        return acked(fragment.packet_number);
+    }), unacked_.end());
+}
+
+bool UdpSession::ReceiveFragment(UdpStream stream, uint32_t message_id, uint8_t index, uint8_t count,
+    const uint8_t* data, size_t size, Delivery& delivery) {
+    uint32_t& next = next_delivery_id_[stream];
+    if ((int32_t)(message_id - next) < 0) {
+        return true;  // Delivered already, the acknowledgement was lost
+    }
+    auto& pending = pending_[stream];
+    auto it = pending.find(message_id);
+    if (it == pending.end()) {
+        if (pending.size() >= UDP_SESSION_MAX_PENDING_MESSAGES) {
+            return false;  // Not acknowledged, the peer sends it again
+        }
+        it = pending.emplace(message_id, PendingMessage()).first;
+        it->second.parts.resize(count);
+        it->second.have.resize(count);
+    }
+    auto& message = it->second;
+    if (count != message.parts.size() || index >= count) {
+        return true;  // Malformed, retransmitting it would not help
+    }
+    if (!message.have[index]) {
+        message.have[index] = true;
+        message.parts[index].assign((const char*)data, size);
+        message.received++;
+    }
+
+    /* Messages are delivered in order, a completed one may release the ones queued behind it */
+    while (!pending.empty() && pending.begin()->first == next && pending.begin()->second.received == pending.begin()->second.parts.size()) {
+        std::string text;
+        for (auto& part : pending.begin()->second.parts) {
+            text += part;
+        }
+        delivery.messages.emplace_back(stream, std::move(text));
+        pending.erase(pending.begin());
+        next++;
+    }
+    return true;
+}
+
+bool UdpSession::ParseFrames(const uint8_t* data, size_t size, Delivery& delivery) {
+    bool ack_eliciting = false;
+    bool accepted = true;
+    size_t pos = 0;
+    while (pos < size) {
+        uint8_t type = data[pos++];
+        const uint8_t* p = data + pos;
+        size_t left = size - pos;
+        switch (type) {
+        case kUdpFrameAudio: {
+            if (left < 10 || left < 10u + GetU16(p + 8)) {
+                return false;
+            }
+            uint32_t sequence = GetU32(p);
+            uint32_t timestamp = GetU32(p + 4);
+            size_t length = GetU16(p + 8);
+            delivery.audio.push_back({sequence, timestamp, (size_t)(p + 10 - (const uint8_t*)plaintext_.data()), length});
+
+            /* Loss and jitter of the incoming audio, reported back to the sender */
+            if (!audio_started_) {
+                audio_started_ = true;
+                audio_report_base_ = sequence - 1;
+                audio_highest_ = sequence - 1;
+            }
+            if ((int32_t)(sequence - audio_highest_) > 0) {
+                audio_highest_ = sequence;
+            }
+            audio_received_++;
+            if (audio_last_arrival_ms_ != 0) {
+                int transit = (int)(NowMs() - audio_last_arrival_ms_) - (int)(timestamp - audio_last_timestamp_);
+                jitter_q4_ += std::abs(transit) - (jitter_q4_ + 8) / 16;
+            }
+            audio_last_arrival_ms_ = NowMs();
+            audio_last_timestamp_ = timestamp;
+            pos += 10 + length;
+            break;
+        }
+        case kUdpFrameStream: {
+            if (left < 9 || left < 9u + GetU16(p + 7)) {
+                return false;
+            }
+            uint8_t stream = p[0];
+            size_t length = GetU16(p + 7);
+            if (stream < kUdpStreamCount && p[6] > 0 && p[6] <= UDP_SESSION_MAX_FRAGMENTS) {
+                accepted = ReceiveFragment((UdpStream)stream, GetU32(p + 1), p[5], p[6], p + 9, length, delivery) && accepted;
+            }
+            ack_eliciting = true;
+            pos += 9 + length;
+            break;
+        }
+        case kUdpFrameAck:
+            if (left < 10) {
+                return false;
+            }
+            ReceiveAck(GetU32(p), GetU32(p + 4), GetU16(p + 8));
+            pos += 10;
+            break;
+        case kUdpFrameReport: {
+            if (left < 6) {
+                return false;
+            }
+            uint16_t expected = GetU16(p);
+            uint16_t lost = std::min(GetU16(p + 2), expected);
+            delivery.report = true;
+            delivery.link_report.rtt_ms = srtt_ms_;
+            delivery.link_report.loss_percent = expected > 0 ? lost * 100 / expected : 0;
+            delivery.link_report.jitter_ms = GetU16(p + 4);
+            pos += 6;
+            break;
+        }
+        case kUdpFramePing:
+            ack_eliciting = true;
+            break;
+        case kUdpFrameClose:
+            delivery.close = true;
+            break;
+        default:
+            /* Frame lengths are implicit, the rest of an unknown packet cannot be parsed */
+            ESP_LOGW(TAG, "Unknown frame type: %u", type);
+            return false;
+        }
+    }
+    return ack_eliciting && accepted;
+}
+
+bool UdpSession::Receive(const std::string& datagram) {
+    Delivery delivery;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t packet_number;
+        if (!established_ || !Open(datagram, kUdpPacketData, packet_number, plaintext_)) {
+            return false;
+        }
+        /* Authenticated, so a replayed packet can only be a copy of a real one */
+        if (replay_window_.Check(packet_number) != ReplayWindow::kAccepted) {
+            return true;
+        }
+        if (ParseFrames((const uint8_t*)plaintext_.data(), plaintext_.size(), delivery)) {
+            RecordAck(packet_number);
+            SendAck(0);
+        }
+    }
+
+    for (auto& frame : delivery.audio) {
+        if (on_audio_) {
+            on_audio_(frame.sequence, frame.timestamp, (const uint8_t*)plaintext_.data() + frame.offset, frame.size);
+        }
+    }
+    for (auto& message : delivery.messages) {
+        if (on_message_) {
+            on_message_(message.first, message.second);
+        }
+    }
+    if (delivery.report && on_report_) {
+        on_report_(delivery.link_report);
+    }
+    if (delivery.close && on_close_) {
+        on_close_();
+    }
+    return true;
+}
+
+bool UdpSession::Poll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now_ms = NowMs();
+    if (!established_) {
+        return true;
+    }
+
+    int rto = Rto();
+    for (auto& fragment : unacked_) {
+        if (now_ms - fragment.sent_ms < (int64_t)rto << std::min(fragment.retries, 4)) {
+            continue;
+        }
+        if (++fragment.retries > UDP_SESSION_MAX_RETRIES) {
+            ESP_LOGE(TAG, "Message %lu on stream %d was not acknowledged", fragment.message_id, fragment.stream);
+            return false;
+        }
+        /* A retransmission goes out in a new packet, its number tells late acks from fresh ones */
+        sent_times_.erase(fragment.packet_number);
+        SendFragment(fragment);
+    }
+
+    if (now_ms - last_report_ms_ >= UDP_SESSION_REPORT_INTERVAL_MS) {
+        last_report_ms_ = now_ms;
+        if (audio_received_ > 0) {
+            SendReport();
+        }
+    }
+    return true;
+}
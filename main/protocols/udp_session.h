@@ -0,0 +1,211 @@
+#ifndef UDP_SESSION_H
+#define UDP_SESSION_H
+
+#include "replay_window.h"
+
+#include <mbedtls/gcm.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Datagrams stay below the smallest common path MTU, so they are never fragmented by IP */
+#define UDP_SESSION_MAX_DATAGRAM 1200
+#define UDP_SESSION_MAX_FRAGMENT 1100
+/* Retransmission timeout bounds and the number of retransmissions before the session fails */
+#define UDP_SESSION_MIN_RTO_MS 100
+#define UDP_SESSION_MAX_RTO_MS 2000
+#define UDP_SESSION_MAX_RETRIES 8
+/* Receiver reports are sent this often while audio arrives */
+#define UDP_SESSION_REPORT_INTERVAL_MS 1000
+/* Messages reassembled out of order per stream, a peer running further ahead is dropped */
+#define UDP_SESSION_MAX_PENDING_MESSAGES 16
+/* Largest message is UDP_SESSION_MAX_FRAGMENTS * UDP_SESSION_MAX_FRAGMENT bytes */
+#define UDP_SESSION_MAX_FRAGMENTS 64
+
+enum UdpPacketType {
+    kUdpPacketHello = 1,        // Device to server, sealed with the configured key and a random nonce
+    kUdpPacketHelloAck = 2,     // Server to device, sealed with the configured key and a random nonce
+    kUdpPacketData = 3,         // Frames, sealed with the session key
+};
+
+enum UdpFrameType {
+    kUdpFrameAudio = 1,         // Unreliable Opus frame
+    kUdpFrameStream = 2,        // Fragment of a reliable, ordered JSON message
+    kUdpFrameAck = 3,
+    kUdpFrameReport = 4,        // Receiver report of the audio in the other direction
+    kUdpFramePing = 5,
+    kUdpFrameClose = 6,
+};
+
+/* Each reliable stream is ordered on its own, a large MCP reply does not hold up control messages */
+enum UdpStream {
+    kUdpStreamControl = 0,
+    kUdpStreamMcp = 1,
+    kUdpStreamCount,
+};
+
+struct UdpPacketHeader {
+    uint8_t type;
+    uint8_t flags;              // Bit 0 is set on packets from the server
+    uint16_t length;            // Bytes after the header, including the nonce and tag
+    uint32_t connection_id;     // Chosen by the device for every connection
+    uint32_t packet_number;     // Per direction, 0 for the handshake and counting up from 1 after it
+} __attribute__((packed));
+
+struct UdpLinkReport {
+    int rtt_ms;                 // Smoothed RTT measured from acknowledgements
+    int loss_percent;           // Audio loss the peer saw in the last report interval
+    int jitter_ms;              // Audio interarrival jitter the peer saw
+};
+
+/*
+ * Transport state of one UDP connection, without any I/O: the caller passes received datagrams
+ * to Receive(), calls Poll() periodically, and the send function puts datagrams on the wire.
+ *
+ * Every packet is AES-128-GCM sealed, the header is authenticated and its direction, connection
+ * id and packet number form the nonce. The handshake uses the configured key, data packets a
+ * session key derived from it and the random values of both sides, so nonces never repeat under
+ * one key. A data packet carries frames: audio frames are sent once, stream frames are
+ * acknowledged and retransmitted until acknowledged, and receiver reports feed the audio
+ * loss and jitter back to the sender.
+ *
+ * Receive() is called from one task. Handlers run on that task outside the session lock, so
+ * they may send.
+ */
+class UdpSession {
+public:
+    using SendFunction = std::function<bool(const std::string& datagram)>;
+
+    explicit UdpSession(SendFunction send);
+    ~UdpSession();
+    UdpSession(const UdpSession&) = delete;
+    UdpSession& operator=(const UdpSession&) = delete;
+
+    void OnAudio(std::function<void(uint32_t sequence, uint32_t timestamp, const uint8_t* data, size_t size)> callback);
+    void OnMessage(std::function<void(UdpStream stream, const std::string& message)> callback);
+    void OnReport(std::function<void(const UdpLinkReport& report)> callback);
+    void OnClose(std::function<void()> callback);
+
+    /* Starts a handshake with the 16-byte key, returns the hello datagram to send until it is answered */
+    std::string Hello(const std::string& key, const std::string& json);
+    /* Completes the handshake with the server hello, its JSON part is returned in json */
+    bool Accept(const std::string& datagram, std::string& json);
+    bool established() const { return established_; }
+    uint32_t connection_id() const { return connection_id_; }
+
+    bool SendAudio(uint32_t timestamp, const uint8_t* data, size_t size);
+    /*
+     * Queues a reliable message, returns false only if it was rejected: the session is not
+     * established or the message needs more than UDP_SESSION_MAX_FRAGMENTS fragments. Fragments
+     * that fail to go out are retransmitted like lost ones.
+     */
+    bool SendMessage(UdpStream stream, const std::string& message);
+    void SendPing();
+    void SendClose();
+
+    /* Returns true if the datagram was an authentic packet of this connection */
+    bool Receive(const std::string& datagram);
+    /* Retransmits and sends reports, returns false once a message could not be delivered */
+    bool Poll();
+
+    int rtt_ms() const { return srtt_ms_; }
+
+private:
+    struct Fragment {
+        UdpStream stream;
+        uint32_t message_id;
+        uint8_t index;
+        uint8_t count;
+        std::string data;
+        uint32_t packet_number = 0;
+        int64_t sent_ms = 0;
+        int retries = 0;
+    };
+
+    struct PendingMessage {
+        size_t received = 0;
+        std::vector<std::string> parts;
+        std::vector<bool> have;
+    };
+
+    struct AudioFrame {
+        uint32_t sequence;
+        uint32_t timestamp;
+        size_t offset;          // Into plaintext_
+        size_t size;
+    };
+
+    struct Delivery {
+        std::vector<AudioFrame> audio;
+        std::vector<std::pair<UdpStream, std::string>> messages;
+        bool report = false;
+        UdpLinkReport link_report = {};
+        bool close = false;
+    };
+
+    std::mutex mutex_;
+    SendFunction send_;
+    std::function<void(uint32_t, uint32_t, const uint8_t*, size_t)> on_audio_;
+    std::function<void(UdpStream, const std::string&)> on_message_;
+    std::function<void(const UdpLinkReport&)> on_report_;
+    std::function<void()> on_close_;
+
+    mbedtls_gcm_context gcm_;
+    std::string key_;
+    uint8_t client_random_[16] = {0};
+    std::atomic<bool> established_{false};
+    uint32_t connection_id_ = 0;
+
+    /* Sending */
+    uint32_t next_packet_number_ = 1;
+    uint32_t next_audio_sequence_ = 1;
+    uint32_t next_message_id_[kUdpStreamCount] = {1, 1};
+    std::deque<Fragment> unacked_;
+    std::map<uint32_t, int64_t> sent_times_;    // Unacknowledged ack-eliciting packets, for RTT samples
+    int srtt_ms_ = 0;
+    int rttvar_ms_ = 0;
+    std::string frames_;
+    std::string datagram_;
+
+    /* Receiving */
+    ReplayWindow replay_window_;
+    bool ack_started_ = false;
+    uint32_t ack_largest_ = 0;          // Largest accepted ack-eliciting packet
+    uint64_t ack_bitmap_ = 0;           // Bit n is set if ack_largest_ - n was accepted
+    uint32_t next_delivery_id_[kUdpStreamCount] = {1, 1};
+    std::map<uint32_t, PendingMessage> pending_[kUdpStreamCount];
+    std::string plaintext_;
+    bool audio_started_ = false;
+    uint32_t audio_highest_ = 0;
+    uint32_t audio_report_base_ = 0;
+    uint32_t audio_received_ = 0;
+    int64_t audio_last_arrival_ms_ = 0;
+    uint32_t audio_last_timestamp_ = 0;
+    int jitter_q4_ = 0;                 // RFC 3550 interarrival jitter, in 1/16 ms
+    int64_t last_report_ms_ = 0;
+
+    bool SetKey(const uint8_t* key);
+    bool Seal(uint8_t type, uint32_t packet_number, const std::string& plaintext, std::string& datagram);
+    bool Open(const std::string& datagram, uint8_t expected_type, uint32_t& packet_number, std::string& plaintext);
+    bool SendFrames(bool ack_eliciting, uint32_t* packet_number = nullptr);
+    bool SendFragment(Fragment& fragment);
+    void SendAck(uint32_t ack_delay_ms);
+    void SendReport();
+    void RecordAck(uint32_t packet_number);
+    void ReceiveAck(uint32_t largest, uint32_t bitmap, uint32_t ack_delay_ms);
+    void UpdateRtt(int sample_ms);
+    int Rto() const;
+    /* Returns true if the packet is to be acknowledged: it needs an ack and all its frames were taken */
+    bool ParseFrames(const uint8_t* data, size_t size, Delivery& delivery);
+    bool ReceiveFragment(UdpStream stream, uint32_t message_id, uint8_t index, uint8_t count,
+        const uint8_t* data, size_t size, Delivery& delivery);
+};
+
+#endif // UDP_SESSION_H
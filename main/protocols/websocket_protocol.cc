@@ -3,6 +3,7 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "task_topology.h"
 
 #include <cstring>
 #include <cJSON.h>
@@ -14,9 +15,44 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+
+    // Closes a parked or unclaimed pre-connected connection once it has been idle for too long
+    esp_timer_create_args_t idle_timer_args = {
+        .callback = [](void* arg) {
+            WebsocketProtocol* protocol = (WebsocketProtocol*)arg;
+            auto alive = protocol->alive_;  // Capture alive flag
+            Application::GetInstance().Schedule([protocol, alive]() {
+                if (!*alive) {
+                    return;
+                }
+                if (protocol->parked_) {
+                    ESP_LOGI(TAG, "Closing idle websocket connection");
+                    protocol->websocket_.reset();
+                    protocol->parked_ = false;
+                }
+                /* The wake word was followed by no conversation, e.g. the state changed before it opened */
+                if (protocol->connecting_ &&
+                    (xEventGroupGetBits(protocol->event_group_handle_) & WEBSOCKET_PROTOCOL_CONNECT_DONE_EVENT)) {
+                    ESP_LOGI(TAG, "Dropping unused pre-connect result");
+                    protocol->connecting_ = false;
+                    protocol->preconnected_.reset();
+                }
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_idle",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&idle_timer_args, &idle_timer_);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    *alive_ = false;
+    if (idle_timer_ != nullptr) {
+        esp_timer_stop(idle_timer_);
+        esp_timer_delete(idle_timer_);
+    }
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -30,31 +66,76 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
+    /* The header is written into the payload headroom, so the packet goes out without a copy */
+    auto& payload = packet->payload;
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        size_t payload_size = payload.size();
+        auto bp2 = (BinaryProtocol2*)payload.Prepend(sizeof(BinaryProtocol2));
         bp2->version = htons(version_);
         bp2->type = 0;
         bp2->reserved = 0;
         bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        bp2->payload_size = htonl(payload_size);
     } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        size_t payload_size = payload.size();
+        auto bp3 = (BinaryProtocol3*)payload.Prepend(sizeof(BinaryProtocol3));
         bp3->type = 0;
         bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+        bp3->payload_size = htons(payload_size);
+    } else if (version_ == 4) {
+        std::vector<std::unique_ptr<AudioStreamPacket>> packets;
+        packets.push_back(std::move(packet));
+        return SendAudioBatch(packets);
+    }
+    return websocket_->Send(payload.data(), payload.size(), true);
+}
+
+int WebsocketProtocol::audio_batch_frames() const {
+    return version_ == 4 ? CONFIG_AUDIO_BATCH_SEND_MAX_FRAMES : 1;
+}
+
+bool WebsocketProtocol::SendAudioBatch(std::vector<std::unique_ptr<AudioStreamPacket>>& packets) {
+    if (version_ != 4) {
+        return Protocol::SendAudioBatch(packets);
+    }
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+    if (packets.empty()) {
+        return true;
+    }
+
+    /* Frames are appended to the first payload, the size table and header go into its headroom */
+    size_t frame_count = packets.size();
+    uint16_t frame_sizes[CONFIG_AUDIO_BATCH_SEND_MAX_FRAMES];
+    if (frame_count > CONFIG_AUDIO_BATCH_SEND_MAX_FRAMES) {
+        ESP_LOGE(TAG, "Too many frames in audio batch: %u", frame_count);
+        return false;
+    }
+    size_t payload_size = 0;
+    for (size_t i = 0; i < frame_count; i++) {
+        frame_sizes[i] = packets[i]->payload.size();
+        payload_size += frame_sizes[i];
+    }
+
+    auto& payload = packets[0]->payload;
+    size_t offset = payload.size();
+    payload.resize(payload_size);
+    for (size_t i = 1; i < frame_count; i++) {
+        memcpy(payload.data() + offset, packets[i]->payload.data(), frame_sizes[i]);
+        offset += frame_sizes[i];
+    }
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+    auto sizes = (uint16_t*)payload.Prepend(frame_count * sizeof(uint16_t));
+    for (size_t i = 0; i < frame_count; i++) {
+        sizes[i] = htons(frame_sizes[i]);
     }
+    auto bp4 = (BinaryProtocol4*)payload.Prepend(sizeof(BinaryProtocol4));
+    bp4->type = 0;
+    bp4->frame_count = frame_count;
+    bp4->payload_size = htons(frame_count * sizeof(uint16_t) + payload_size);
+    bp4->timestamp = htonl(packets[0]->timestamp);
+    return websocket_->Send(payload.data(), payload.size(), true);
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
@@ -72,30 +153,110 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    return websocket_ != nullptr && websocket_->IsConnected() && !parked_ && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel(bool send_goodbye) {
     (void)send_goodbye;  // Websocket doesn't need to send goodbye message
+#if CONFIG_WEBSOCKET_KEEP_WARM_SECONDS > 0
+    if (!parked_ && websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout()) {
+        /* Keep the connection, the next conversation skips TCP, TLS and the hello exchange */
+        ESP_LOGI(TAG, "Parking websocket connection for %d seconds", CONFIG_WEBSOCKET_KEEP_WARM_SECONDS);
+        parked_ = true;
+        esp_timer_stop(idle_timer_);
+        esp_timer_start_once(idle_timer_, CONFIG_WEBSOCKET_KEEP_WARM_SECONDS * 1000000ULL);
+        if (on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        return;
+    }
+#endif
+    esp_timer_stop(idle_timer_);
+    parked_ = false;
     websocket_.reset();
 }
 
+void WebsocketProtocol::PreConnect() {
+    if (connecting_ || preconnected_ != nullptr || (websocket_ != nullptr && websocket_->IsConnected())) {
+        return;
+    }
+
+    connecting_ = true;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_CONNECT_DONE_EVENT);
+    bool created = TaskTopology::GetInstance().Create(kTaskProtocolConnect, [](void* arg) {
+        auto protocol = (WebsocketProtocol*)arg;
+        protocol->preconnected_ = protocol->Connect(protocol->connect_error_, protocol->preconnected_version_);
+        /* A failed result is dropped the same way, so connecting_ never outlives the attempt */
+        esp_timer_stop(protocol->idle_timer_);
+        esp_timer_start_once(protocol->idle_timer_, WEBSOCKET_PRECONNECT_IDLE_MS * 1000ULL);
+        xEventGroupSetBits(protocol->event_group_handle_, WEBSOCKET_PROTOCOL_CONNECT_DONE_EVENT);
+        vTaskDelete(NULL);
+    }, this);
+    if (!created) {
+        connecting_ = false;
+    }
+}
+
 bool WebsocketProtocol::OpenAudioChannel() {
+    error_occurred_ = false;
+
+    if (connecting_) {
+        ESP_LOGI(TAG, "Waiting for the pre-connect to finish");
+        xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_CONNECT_DONE_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
+        connecting_ = false;
+        if (preconnected_ == nullptr) {
+            SetError(connect_error_);
+            return false;
+        }
+    }
+    // Stopped after the pre-connect task, which starts it for an unclaimed connection
+    esp_timer_stop(idle_timer_);
+
+    if (preconnected_ != nullptr) {
+        websocket_ = std::move(preconnected_);
+        version_ = preconnected_version_;
+    } else if (parked_) {
+        ESP_LOGI(TAG, "Resuming warm connection, session: %s", session_id_.c_str());
+    }
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        websocket_.reset();
+        std::string error;
+        int version;
+        websocket_ = Connect(error, version);
+        if (websocket_ == nullptr) {
+            SetError(error);
+            return false;
+        }
+        version_ = version;
+    }
+    parked_ = false;
+    last_incoming_time_ = std::chrono::steady_clock::now();
+
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+/*
+ * May run on the pre-connect task, so the protocol version of the new connection is returned in
+ * version instead of being written to version_, which the open channel keeps using meanwhile.
+ */
+std::unique_ptr<WebSocket> WebsocketProtocol::Connect(std::string& error, int& version) {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
-    int version = settings.GetInt("version");
-    if (version != 0) {
-        version_ = version;
+    version = settings.GetInt("version", 1);
+    if (version == 0) {
+        version = 1;
     }
 
-    error_occurred_ = false;
-
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
-    if (websocket_ == nullptr) {
+    auto ws = network->CreateWebSocket(1);
+    if (ws == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
-        return false;
+        error = Lang::Strings::SERVER_NOT_CONNECTED;
+        return nullptr;
     }
 
     if (!token.empty()) {
@@ -103,45 +264,59 @@ bool WebsocketProtocol::OpenAudioChannel() {
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        ws->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    ws->SetHeader("Protocol-Version", std::to_string(version).c_str());
+    ws->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    ws->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    ws->OnData([this, version](const char* data, size_t len, bool binary) {
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
+            /* Audio that arrives while the connection is parked belongs to no conversation */
+            if (on_incoming_audio_ != nullptr && !parked_) {
+                /* The incoming buffer is left untouched, the payload is copied once into the pool */
+                if (version == 2) {
+                    auto bp2 = (const BinaryProtocol2*)data;
+                    if (len < sizeof(BinaryProtocol2)) {
+                        ESP_LOGE(TAG, "Invalid audio packet size: %u", len);
+                        return;
+                    }
+                    uint32_t payload_size = ntohl(bp2->payload_size);
+                    if (payload_size > len - sizeof(BinaryProtocol2)) {
+                        ESP_LOGE(TAG, "Invalid audio payload size: %lu", payload_size);
+                        return;
+                    }
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
+                        .timestamp = ntohl(bp2->timestamp),
+                        .payload = AudioPayload(bp2->payload, bp2->payload + payload_size)
                     }));
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
+                } else if (version == 3) {
+                    auto bp3 = (const BinaryProtocol3*)data;
+                    if (len < sizeof(BinaryProtocol3)) {
+                        ESP_LOGE(TAG, "Invalid audio packet size: %u", len);
+                        return;
+                    }
+                    uint16_t payload_size = ntohs(bp3->payload_size);
+                    if (payload_size > len - sizeof(BinaryProtocol3)) {
+                        ESP_LOGE(TAG, "Invalid audio payload size: %u", payload_size);
+                        return;
+                    }
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
                         .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
+                        .payload = AudioPayload(bp3->payload, bp3->payload + payload_size)
                     }));
+                } else if (version == 4) {
+                    ParseBinaryProtocol4((const uint8_t*)data, len);
                 } else {
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
                         .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
+                        .payload = AudioPayload((const uint8_t*)data, (const uint8_t*)data + len)
                     }));
                 }
             }
@@ -152,10 +327,10 @@ bool WebsocketProtocol::OpenAudioChannel() {
             if (cJSON_IsString(type)) {
                 if (strcmp(type->valuestring, "hello") == 0) {
                     ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
+                } else if (parked_) {
+                    ESP_LOGW(TAG, "Dropped message while parked: %s", type->valuestring);
+                } else if (on_incoming_json_ != nullptr) {
+                    on_incoming_json_(root);
                 }
             } else {
                 ESP_LOGE(TAG, "Missing message type, data: %s", data);
@@ -165,46 +340,63 @@ bool WebsocketProtocol::OpenAudioChannel() {
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    /* Only the connection of an open channel reports a close, a parked or pre-connected one is dropped silently */
+    ws->OnDisconnected([this, socket = ws.get()]() {
         ESP_LOGI(TAG, "Websocket disconnected");
-        if (on_audio_channel_closed_ != nullptr) {
+        if (socket == websocket_.get() && !parked_ && on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
 
-    ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
-        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket_->GetLastError());
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
-        return false;
+    ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version);
+    if (!ws->Connect(url.c_str())) {
+        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", ws->GetLastError());
+        error = Lang::Strings::SERVER_NOT_CONNECTED;
+        return nullptr;
     }
 
+    /*
+     * With session resume the previous session id goes into the hello and the server hello is
+     * not waited for, the audio parameters of the previous session are kept until it arrives.
+     */
+#if CONFIG_WEBSOCKET_SESSION_RESUME
+    bool resume = !session_id_.empty();
+#else
+    bool resume = false;
+#endif
     // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
-        return false;
+    auto message = GetHelloMessage(version, resume);
+    auto hello_time = std::chrono::steady_clock::now();
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+    if (!ws->Send(message)) {
+        ESP_LOGE(TAG, "Failed to send hello");
+        error = Lang::Strings::SERVER_ERROR;
+        return nullptr;
+    }
+    if (resume) {
+        ESP_LOGI(TAG, "Resuming session: %s", session_id_.c_str());
+        return ws;
     }
 
     // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(WEBSOCKET_SERVER_HELLO_TIMEOUT_MS));
     if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
-        return false;
-    }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
+        error = Lang::Strings::SERVER_TIMEOUT;
+        return nullptr;
     }
-
-    return true;
+    link_rtt_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hello_time).count();
+    return ws;
 }
 
-std::string WebsocketProtocol::GetHelloMessage() {
+std::string WebsocketProtocol::GetHelloMessage(int version, bool resume) {
     // keys: message type, version, audio_params (format, sample_rate, channels)
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", version_);
+    cJSON_AddNumberToObject(root, "version", version);
+    if (resume) {
+        cJSON_AddStringToObject(root, "session_id", session_id_.c_str());
+    }
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
@@ -252,3 +444,38 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
+
+void WebsocketProtocol::ParseBinaryProtocol4(const uint8_t* data, size_t len) {
+    auto bp4 = (const BinaryProtocol4*)data;
+    if (len < sizeof(BinaryProtocol4)) {
+        ESP_LOGE(TAG, "Invalid audio packet size: %u", len);
+        return;
+    }
+    size_t payload_size = ntohs(bp4->payload_size);
+    size_t table_size = bp4->frame_count * sizeof(uint16_t);
+    if (payload_size > len - sizeof(BinaryProtocol4) || table_size > payload_size) {
+        ESP_LOGE(TAG, "Invalid audio payload size: %u", payload_size);
+        return;
+    }
+
+    /* Every frame becomes its own packet, timestamps advance by the frame duration */
+    const uint8_t* frame = bp4->payload + table_size;
+    const uint8_t* end = bp4->payload + payload_size;
+    uint32_t timestamp = ntohl(bp4->timestamp);
+    for (int i = 0; i < bp4->frame_count; i++) {
+        uint16_t frame_size;
+        memcpy(&frame_size, bp4->payload + i * sizeof(uint16_t), sizeof(frame_size));
+        frame_size = ntohs(frame_size);
+        if (frame_size > end - frame) {
+            ESP_LOGE(TAG, "Invalid audio frame size: %u", frame_size);
+            return;
+        }
+        on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
+            .sample_rate = server_sample_rate_,
+            .frame_duration = server_frame_duration_,
+            .timestamp = timestamp == 0 ? 0 : timestamp + i * server_frame_duration_,
+            .payload = AudioPayload(frame, frame + frame_size)
+        }));
+        frame += frame_size;
+    }
+}
@@ -7,8 +7,16 @@
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <memory>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define WEBSOCKET_PROTOCOL_CONNECT_DONE_EVENT (1 << 1)
+#define WEBSOCKET_SERVER_HELLO_TIMEOUT_MS 10000
+/* A pre-connected socket no conversation claims within this time is closed */
+#define WEBSOCKET_PRECONNECT_IDLE_MS 10000
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -17,18 +25,39 @@ public:
 
     bool Start() override;
     bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudioBatch(std::vector<std::unique_ptr<AudioStreamPacket>>& packets) override;
+    int audio_batch_frames() const override;
+    void PreConnect() override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel(bool send_goodbye = true) override;
     bool IsAudioChannelOpened() const override;
 
 private:
+    // Alive flag for safe scheduled callbacks - set to false in destructor
+    std::shared_ptr<std::atomic<bool>> alive_ = std::make_shared<std::atomic<bool>>(true);
+
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
 
+    /*
+     * The connection outlives a conversation: CloseAudioChannel() parks it for
+     * CONFIG_WEBSOCKET_KEEP_WARM_SECONDS and the next OpenAudioChannel() reuses it.
+     * PreConnect() runs Connect() on its own task, the result is handed over in preconnected_ and
+     * preconnected_version_. The idle timer also closes a pre-connected socket nobody opens.
+     */
+    std::atomic<bool> parked_{false};
+    std::atomic<bool> connecting_{false};
+    std::unique_ptr<WebSocket> preconnected_;
+    int preconnected_version_ = 1;
+    std::string connect_error_;
+    esp_timer_handle_t idle_timer_ = nullptr;
+
+    std::unique_ptr<WebSocket> Connect(std::string& error, int& version);
     void ParseServerHello(const cJSON* root);
+    void ParseBinaryProtocol4(const uint8_t* data, size_t len);
     bool SendText(const std::string& text) override;
-    std::string GetHelloMessage();
+    std::string GetHelloMessage(int version, bool resume = false);
 };
 
 #endif
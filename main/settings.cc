@@ -137,6 +137,49 @@ void Settings::SetBool(const std::string& key, bool value) {
     }
 }
 
+std::string Settings::GetBlob(const std::string& key) {
+    if (nvs_handle_ == 0) {
+        return "";
+    }
+
+    size_t length = 0;
+    if (nvs_get_blob(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
+        return "";
+    }
+
+    std::string value;
+    value.resize(length);
+    esp_err_t err = nvs_get_blob(nvs_handle_, key.c_str(), value.data(), &length);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to get blob from NVS: %s", esp_err_to_name(err));
+        return "";
+    }
+    return value;
+}
+
+void Settings::SetBlob(const std::string& key, const std::string& value) {
+    if (read_write_) {
+        esp_err_t err = nvs_set_blob(nvs_handle_, key.c_str(), value.data(), value.size());
+        if (err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
+            ESP_LOGW(TAG, "NVS full, erasing all entries in namespace %s to free space", ns_.c_str());
+            nvs_erase_all(nvs_handle_);
+            nvs_commit(nvs_handle_);
+            // Retry after erase
+            err = nvs_set_blob(nvs_handle_, key.c_str(), value.data(), value.size());
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to set blob after erasing NVS: %s", esp_err_to_name(err));
+                return;
+            }
+        } else if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to set blob in NVS: %s", esp_err_to_name(err));
+            return;
+        }
+        dirty_ = true;
+    } else {
+        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    }
+}
+
 void Settings::EraseKey(const std::string& key) {
     if (read_write_) {
         auto ret = nvs_erase_key(nvs_handle_, key.c_str());
@@ -15,6 +15,8 @@ public:
     void SetInt(const std::string& key, int32_t value);
     bool GetBool(const std::string& key, bool default_value = false);
     void SetBool(const std::string& key, bool value);
+    std::string GetBlob(const std::string& key);
+    void SetBlob(const std::string& key, const std::string& value);
     void EraseKey(const std::string& key);
     void EraseAll();
 
@@ -12,6 +12,8 @@
 #include "esp_wifi_remote.h"
 #endif
 
+#include "audio_frame_pool.h"
+
 #define TAG "SystemInfo"
 
 size_t SystemInfo::GetFlashSize() {
@@ -148,4 +150,5 @@ void SystemInfo::PrintHeapStats() {
     int free_sram = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
     int min_free_sram = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
     ESP_LOGI(TAG, "free sram: %u minimal sram: %u", free_sram, min_free_sram);
+    AudioFramePool::GetInstance().PrintStats();
 }
@@ -0,0 +1,180 @@
+#include "task_topology.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#define TAG "TaskTopology"
+
+/* Tasks with less free stack than this are reported as warnings */
+#define TASK_STACK_WARNING_BYTES 512
+
+#if CONFIG_FREERTOS_UNICORE
+#define CORE_0 tskNO_AFFINITY
+#define CORE_1 tskNO_AFFINITY
+#else
+#define CORE_0 0
+#define CORE_1 1
+#endif
+
+#if CONFIG_TASK_LAYOUT_SPLIT && !CONFIG_FREERTOS_UNICORE
+#define AUDIO_CORE(legacy) CORE_1
+#define UI_CORE(legacy) CORE_0
+#else
+#define AUDIO_CORE(legacy) (legacy)
+#define UI_CORE(legacy) (legacy)
+#endif
+
+TaskTopology::TaskTopology() {
+#if CONFIG_USE_AUDIO_PROCESSOR
+    specs_[kTaskAudioInput]      = {"audio_input", 2048 * 3, 8, AUDIO_CORE(CORE_0), false};
+    specs_[kTaskAudioOutput]     = {"audio_output", 2048 * 2, 4, AUDIO_CORE(tskNO_AFFINITY), false};
+#else
+    specs_[kTaskAudioInput]      = {"audio_input", 2048 * 2, 8, AUDIO_CORE(tskNO_AFFINITY), false};
+    specs_[kTaskAudioOutput]     = {"audio_output", 2048, 4, AUDIO_CORE(tskNO_AFFINITY), false};
+#endif
+    /* Codec stacks are large, put them in PSRAM to save SRAM */
+    specs_[kTaskOpusEncode]      = {"opus_encode", 2048 * 12, 2, AUDIO_CORE(CORE_0), true};
+    specs_[kTaskOpusDecode]      = {"opus_decode", 2048 * 8, 2, AUDIO_CORE(CORE_1), true};
+    specs_[kTaskAudioProcessor]  = {"audio_communication", 4096, 3, AUDIO_CORE(tskNO_AFFINITY), false};
+    specs_[kTaskWakeWord]        = {"audio_detection", 4096, 3, AUDIO_CORE(tskNO_AFFINITY), false};
+    /* The wake word engine pins the esp-sr tasks to core 1, the AFE processor keeps the esp-sr default */
+    specs_[kTaskAfe]             = {"afe", 0, 5, AUDIO_CORE(TASK_CORE_DEFAULT), false};
+    specs_[kTaskAudioDebugger]   = {"audio_debugger", 4096, 1, UI_CORE(tskNO_AFFINITY), false};
+    specs_[kTaskRadio]           = {"radio_stream", 1024 * 3 + 512, 5, AUDIO_CORE(tskNO_AFFINITY), false};
+    specs_[kTaskActivation]      = {"activation", 4096 * 2, 2, UI_CORE(tskNO_AFFINITY), false};
+    /* TLS handshakes need the same stack as the activation task */
+    specs_[kTaskProtocolConnect] = {"ws_connect", 4096 * 2, 3, UI_CORE(tskNO_AFFINITY), false};
+    specs_[kTaskTlsReceive]      = {"tls_receive", 4096, 3, UI_CORE(tskNO_AFFINITY), false};
+    /* Each display type keeps its own LVGL priority and core in the legacy layout */
+    specs_[kTaskDisplay]         = {"lvgl", 0, 0, UI_CORE(TASK_CORE_DEFAULT), false};
+    specs_[kTaskEmote]           = {"emote", 6 * 1024, 5, UI_CORE(CORE_0), false};
+
+    ApplyOverrides(CONFIG_TASK_TOPOLOGY_OVERRIDES);
+}
+
+void TaskTopology::ApplyOverrides(const char* overrides) {
+    std::string list(overrides);
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string entry = list.substr(start, end - start);
+        start = end + 1;
+
+        size_t colon = entry.find(':');
+        std::string name = entry.substr(0, colon);
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name.empty()) {
+            continue;
+        }
+        TaskSpec* spec = nullptr;
+        for (auto& s : specs_) {
+            if (name == s.name) {
+                spec = &s;
+                break;
+            }
+        }
+        if (spec == nullptr) {
+            ESP_LOGW(TAG, "Unknown task in overrides: %s", name.c_str());
+            continue;
+        }
+
+        /* core:priority:stack:psram, empty fields keep the default */
+        int field = 0;
+        while (colon != std::string::npos) {
+            size_t next = entry.find(':', colon + 1);
+            std::string value = entry.substr(colon + 1, next == std::string::npos ? std::string::npos : next - colon - 1);
+            colon = next;
+            if (value.empty()) {
+                field++;
+                continue;
+            }
+            long number = strtol(value.c_str(), nullptr, 10);
+            switch (field++) {
+            case 0:
+                spec->core = (number < 0 || number >= portNUM_PROCESSORS) ? tskNO_AFFINITY : (BaseType_t)number;
+                break;
+            case 1:
+                spec->priority = (UBaseType_t)std::min<long>(std::max<long>(number, 1), configMAX_PRIORITIES - 1);
+                break;
+            case 2:
+                spec->stack_size = (uint32_t)std::max<long>(number, 0);
+                break;
+            case 3:
+                spec->psram_stack = number != 0;
+                break;
+            }
+        }
+        ESP_LOGI(TAG, "%s: core %d, priority %u, stack %lu%s", spec->name, (int)spec->core,
+            (unsigned)spec->priority, spec->stack_size, spec->psram_stack ? " (PSRAM)" : "");
+    }
+}
+
+bool TaskTopology::Create(TaskRole role, TaskFunction_t entry, void* arg, TaskHandle_t* handle) {
+    const TaskSpec& spec = specs_[role];
+#if CONFIG_SPIRAM
+    if (spec.psram_stack) {
+        StackType_t* stack = (StackType_t*)heap_caps_malloc(spec.stack_size, MALLOC_CAP_SPIRAM);
+        StaticTask_t* task_buf = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (stack && task_buf) {
+            TaskHandle_t created = xTaskCreateStaticPinnedToCore(entry, spec.name, spec.stack_size, arg, spec.priority, stack, task_buf, spec.core);
+            if (handle != nullptr) {
+                *handle = created;
+            }
+            return created != nullptr;
+        }
+        ESP_LOGW(TAG, "Failed to alloc PSRAM for %s, falling back to SRAM", spec.name);
+        if (stack) heap_caps_free(stack);
+        if (task_buf) heap_caps_free(task_buf);
+    }
+#endif
+    if (xTaskCreatePinnedToCore(entry, spec.name, spec.stack_size, arg, spec.priority, handle, spec.core) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task %s", spec.name);
+        return false;
+    }
+    return true;
+}
+
+void TaskTopology::PrintReport() {
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t* tasks = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * count);
+    if (tasks == nullptr) {
+        return;
+    }
+    count = uxTaskGetSystemState(tasks, count, nullptr);
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& task = tasks[i];
+        /* The high-water mark is in bytes on ESP-IDF */
+        uint32_t free_bytes = task.usStackHighWaterMark;
+        int core = -1;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        core = task.xCoreID == tskNO_AFFINITY ? -1 : (int)task.xCoreID;
+#endif
+        const TaskSpec* spec = nullptr;
+        for (auto& s : specs_) {
+            if (strcmp(task.pcTaskName, s.name) == 0) {
+                spec = &s;
+                break;
+            }
+        }
+        if (free_bytes < TASK_STACK_WARNING_BYTES) {
+            ESP_LOGW(TAG, "%-20s core %2d prio %2u free stack %lu bytes", task.pcTaskName, core,
+                (unsigned)task.uxCurrentPriority, free_bytes);
+        } else if (spec != nullptr && spec->stack_size > 0) {
+            ESP_LOGI(TAG, "%-20s core %2d prio %2u free stack %lu of %lu bytes", task.pcTaskName, core,
+                (unsigned)task.uxCurrentPriority, free_bytes, spec->stack_size);
+        } else {
+            ESP_LOGI(TAG, "%-20s core %2d prio %2u free stack %lu bytes", task.pcTaskName, core,
+                (unsigned)task.uxCurrentPriority, free_bytes);
+        }
+    }
+    free(tasks);
+}
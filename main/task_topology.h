@@ -0,0 +1,80 @@
+#ifndef TASK_TOPOLOGY_H
+#define TASK_TOPOLOGY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+enum TaskRole {
+    kTaskAudioInput = 0,
+    kTaskAudioOutput,
+    kTaskOpusEncode,
+    kTaskOpusDecode,
+    kTaskAudioProcessor,    // AfeAudioProcessor fetch task
+    kTaskWakeWord,          // AfeWakeWord detection task
+    kTaskAfe,               // esp-sr feed and fetch tasks, only core and priority apply
+    kTaskAudioDebugger,
+    kTaskRadio,             // Radio download and playback threads
+    kTaskActivation,
+    kTaskProtocolConnect,   // Background connect of the audio channel after the wake word
+    kTaskTlsReceive,        // Receive task of each TLS connection with session resumption
+    kTaskDisplay,           // LVGL port task
+    kTaskEmote,             // Emote display render task
+    kTaskRoleCount,
+};
+
+/* Core of tasks whose creator keeps its own default, e.g. the LVGL task of each display type */
+#define TASK_CORE_DEFAULT (-2)
+
+struct TaskSpec {
+    const char* name;
+    uint32_t stack_size;    // Bytes, 0 keeps the library default
+    UBaseType_t priority;   // 0 keeps the library default
+    BaseType_t core;        // tskNO_AFFINITY lets the scheduler pick
+    bool psram_stack;
+};
+
+/*
+ * Core affinity, priority and stack placement of the audio, protocol and display tasks.
+ *
+ * The defaults come from the CONFIG_TASK_LAYOUT_* choice: the legacy layout, or audio on core 1
+ * with display and activation on core 0 (where the Wi-Fi and lwIP tasks run by default). A
+ * board adjusts single tasks with CONFIG_TASK_TOPOLOGY_OVERRIDES in its config.json
+ * sdkconfig_append, as a list of "name:core:priority:stack:psram" entries. Trailing fields may
+ * be omitted, and a core of -1 means no affinity, e.g. "opus_decode:0:3,lvgl:1".
+ *
+ * Tasks are created through Create(), libraries that create their own tasks read Get(). Fields
+ * left at their default (stack or priority 0, TASK_CORE_DEFAULT) keep the value the library
+ * caller sets.
+ */
+class TaskTopology {
+public:
+    static TaskTopology& GetInstance() {
+        static TaskTopology instance;
+        return instance;
+    }
+    // Delete copy constructor and assignment operator
+    TaskTopology(const TaskTopology&) = delete;
+    TaskTopology& operator=(const TaskTopology&) = delete;
+
+    const TaskSpec& Get(TaskRole role) const { return specs_[role]; }
+
+    /*
+     * PSRAM stacks are never freed, only tasks that live as long as the application use them.
+     * An internal stack is used if PSRAM is exhausted.
+     */
+    bool Create(TaskRole role, TaskFunction_t entry, void* arg, TaskHandle_t* handle = nullptr);
+
+    /* Logs the stack high-water mark of every task, and the configured stack of known ones */
+    void PrintReport();
+
+private:
+    TaskSpec specs_[kTaskRoleCount];
+
+    TaskTopology();
+    void ApplyOverrides(const char* overrides);
+};
+
+#endif // TASK_TOPOLOGY_H
@@ -1,4 +1,5 @@
 import sys
+import struct
 import numpy as np
 import asyncio
 import wave
@@ -20,6 +21,12 @@ from PyQt6.QtCore import QTimer
 from demod import RealTimeAFSKDecoder
 
 
+# 音频调试包头, 见 scripts/audio_debug_server.py
+AUDIO_DEBUG_HEADER = struct.Struct('!HBBB3xIIII')
+AUDIO_DEBUG_MAGIC = 0x4144
+AUDIO_DEBUG_TAP_MIC = 0
+
+
 class UDPServerProtocol(asyncio.DatagramProtocol):
     """UDP服务器协议类"""
     def __init__(self, data_queue):
@@ -37,8 +44,14 @@ class UDPServerProtocol(asyncio.DatagramProtocol):
         
         # 只处理来自已记录客户端的数据
         if addr == self.client_address:
+            # 跳过音频调试包头, 只取麦克风原始数据
+            if len(data) < AUDIO_DEBUG_HEADER.size:
+                return
+            magic, version, tap = AUDIO_DEBUG_HEADER.unpack_from(data)[:3]
+            if magic != AUDIO_DEBUG_MAGIC or tap != AUDIO_DEBUG_TAP_MIC:
+                return
             # 将接收到的音频数据添加到队列
-            self.data_queue.extend(data)
+            self.data_queue.extend(data[AUDIO_DEBUG_HEADER.size:])
         else:
             print(f"忽略来自未知地址 {addr} 的数据")
 
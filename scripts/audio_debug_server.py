@@ -1,54 +1,116 @@
 import socket
+import struct
 import wave
 import argparse
 
 
 '''
   Create a UDP socket and bind it to the server's IP:8000.
-  Listen for incoming messages and print them to the console.
-  Save the audio to a WAV file.
+  Receive the framed audio debugger stream and save every tap to its own WAV file.
+
+  Each datagram starts with a 24 byte header in network byte order:
+    magic(H) version(B) tap(B) channels(B) reserved(3x) sample_rate(I) sequence(I) position(I) timestamp_us(I)
+  A sequence gap means packets were lost on the network, a position jump without a sequence
+  gap means the device dropped audio. Both are filled with silence so the taps stay aligned.
 '''
-def main(samplerate, channels):
+HEADER = struct.Struct('!HBBB3xIIII')
+MAGIC = 0x4144
+VERSION = 1
+TAP_NAMES = ['mic', 'processed', 'decoded', 'speaker']
+
+
+class TapWriter:
+    def __init__(self, prefix, tap, channels, samplerate, segment):
+        self.name = TAP_NAMES[tap] if tap < len(TAP_NAMES) else f'tap{tap}'
+        suffix = f"_{segment}" if segment > 0 else ""
+        self.filename = f"{prefix}{self.name}_{samplerate}_{channels}{suffix}.wav"
+        self.channels = channels
+        self.samplerate = samplerate
+        self.wav_file = wave.open(self.filename, "wb")
+        self.wav_file.setnchannels(channels)
+        self.wav_file.setsampwidth(2)            # 2 bytes per sample (16-bit)
+        self.wav_file.setframerate(samplerate)
+        self.next_sequence = None
+        self.next_position = None
+        self.first_timestamp_us = None
+        self.network_lost = 0
+        self.device_dropped = 0
+        self.stale = 0
+
+    def write(self, sequence, position, timestamp_us, payload):
+        if self.first_timestamp_us is None:
+            self.first_timestamp_us = timestamp_us
+        frames = len(payload) // (2 * self.channels)
+        if self.next_position is not None:
+            gap = (position - self.next_position) & 0xFFFFFFFF
+            if gap >= 0x80000000:
+                # Reordered or duplicated datagram, its place in the file is already written
+                self.stale += 1
+                return
+            lost_packets = (sequence - self.next_sequence) & 0xFFFFFFFF
+            if gap > 0:
+                if lost_packets > 0:
+                    self.network_lost += lost_packets
+                else:
+                    self.device_dropped += gap
+                self.wav_file.writeframes(b'\x00' * gap * 2 * self.channels)
+        self.wav_file.writeframes(payload[:frames * 2 * self.channels])
+        self.next_sequence = (sequence + 1) & 0xFFFFFFFF
+        self.next_position = (position + frames) & 0xFFFFFFFF
+
+    def close(self):
+        self.wav_file.close()
+        print(f"{self.name}: saved '{self.filename}', first timestamp {self.first_timestamp_us} us, "
+              f"{self.network_lost} packets lost on network, {self.device_dropped} samples dropped on device, "
+              f"{self.stale} late packets")
+
+
+def main(prefix):
     # Create a UDP socket
     server_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     server_socket.bind(('0.0.0.0', 8000))
 
-    # Create WAV file with parameters
-    filename = f"{samplerate}_{channels}.wav"
-    wav_file = wave.open(filename, "wb")
-    wav_file.setnchannels(channels)     # channels parameter
-    wav_file.setsampwidth(2)            # 2 bytes per sample (16-bit)
-    wav_file.setframerate(samplerate)   # samplerate parameter
-
-    print(f"Start saving audio from 0.0.0.0:8000 to {filename}...")
+    writers = {}
+    segments = {}
+    print("Start saving audio from 0.0.0.0:8000...")
 
     try:
         while True:
             # Receive a message from the client
-            message, address = server_socket.recvfrom(8000)
-            
-            # Write PCM data to WAV file
-            wav_file.writeframes(message)
-
-            # Print length of the message
-            print(f"Received {len(message)} bytes from {address}")
-    
+            message, address = server_socket.recvfrom(2048)
+            if len(message) < HEADER.size:
+                continue
+            magic, version, tap, channels, samplerate, sequence, position, timestamp_us = HEADER.unpack_from(message)
+            if magic != MAGIC or version != VERSION or channels == 0:
+                print(f"Ignored {len(message)} bytes from {address}, not an audio debugger packet")
+                continue
+
+            writer = writers.get(tap)
+            if writer is not None and (writer.channels != channels or writer.samplerate != samplerate):
+                # The stream format changed, e.g. a new decoder sample rate, start another file
+                writer.close()
+                writer = None
+            if writer is None:
+                segments[tap] = segments.get(tap, -1) + 1
+                writer = TapWriter(prefix, tap, channels, samplerate, segments[tap])
+                writers[tap] = writer
+                print(f"{writer.name}: {samplerate} Hz, {channels} channels from {address}")
+            writer.write(sequence, position, timestamp_us, message[HEADER.size:])
+
     except KeyboardInterrupt:
         print("\nStopping recording...")
-    
+
     finally:
         # Close files and socket
-        wav_file.close()
+        for writer in writers.values():
+            writer.close()
         server_socket.close()
-        print(f"WAV file '{filename}' saved successfully")
 
 
 if __name__ == "__main__":
-    parser = argparse.ArgumentParser(description='UDP音频数据接收器，保存为WAV文件')
-    parser.add_argument('--samplerate', '-s', type=int, default=16000, 
-                        help='采样率 (默认: 16000)')
-    parser.add_argument('--channels', '-c', type=int, default=2, 
-                        help='声道数 (默认: 2)')
-    
+    parser = argparse.ArgumentParser(description='UDP音频调试数据接收器，每个采集点保存为一个WAV文件')
+    parser.add_argument('--prefix', '-p', type=str, default='',
+                        help='WAV文件名前缀 (默认: 无)')
+
     args = parser.parse_args()
-    main(args.samplerate, args.channels)
+    main(args.prefix)
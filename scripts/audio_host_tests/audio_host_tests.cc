@@ -0,0 +1,440 @@
+/*
+ * Host checks of the audio modules that do not depend on ESP-IDF drivers: the jitter buffer,
+ * the mixer, the output DSP, the Ogg demuxer and the PCM kernels, built from the firmware
+ * sources with the stub headers in host/. SpscRing has its own threaded test in
+ * scripts/spsc_ring_stress.
+ */
+#include "audio_jitter_buffer.h"
+#include "audio_mixer.h"
+#include "audio_output_dsp.h"
+#include "ogg_demuxer.h"
+#include "pcm_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "Check failed at line %d: %s\n", __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/* ---------------------------------------------------------------- Jitter buffer */
+
+static std::unique_ptr<AudioStreamPacket> MakePacket(uint32_t sequence) {
+    auto packet = std::make_unique<AudioStreamPacket>();
+    packet->sample_rate = 16000;
+    packet->frame_duration = 60;
+    packet->sequence = sequence;
+    packet->timestamp = sequence * 60;
+    return packet;
+}
+
+/* Pops everything that is playable at now_ms, packets as their sequence and concealed frames as 0 */
+static std::vector<uint32_t> PopAll(AudioJitterBuffer& buffer, int64_t now_ms) {
+    std::vector<uint32_t> played;
+    while (true) {
+        std::unique_ptr<AudioStreamPacket> packet;
+        int wait_ms = 0;
+        auto result = buffer.Pop(now_ms, packet, wait_ms);
+        if (result == AudioJitterBuffer::kPopNone) {
+            return played;
+        }
+        played.push_back(result == AudioJitterBuffer::kPopPacket ? packet->sequence : 0);
+    }
+}
+
+static void TestJitterBuffer() {
+    {
+        /* A clean link adds no delay, every packet plays as soon as it arrives */
+        AudioJitterBuffer buffer;
+        for (uint32_t seq = 1; seq <= 20; seq++) {
+            buffer.Push(MakePacket(seq), seq * 60);
+            EXPECT(PopAll(buffer, seq * 60) == std::vector<uint32_t>{seq});
+        }
+        EXPECT(buffer.stats().target_frames == 0);
+        EXPECT(buffer.stats().concealed == 0 && buffer.stats().late == 0);
+    }
+    {
+        /* Reordered packets are played in sequence */
+        AudioJitterBuffer buffer;
+        buffer.Push(MakePacket(1), 0);
+        buffer.Push(MakePacket(3), 1);
+        buffer.Push(MakePacket(2), 2);
+        EXPECT(PopAll(buffer, 2) == (std::vector<uint32_t>{1, 2, 3}));
+    }
+    {
+        /* A single missing frame is concealed once a later one is queued, then play continues */
+        AudioJitterBuffer buffer;
+        buffer.Push(MakePacket(1), 0);
+        buffer.Push(MakePacket(2), 60);
+        buffer.Push(MakePacket(4), 180);
+        buffer.Push(MakePacket(5), 240);
+        EXPECT(PopAll(buffer, 240) == (std::vector<uint32_t>{1, 2, 0, 4, 5}));
+        EXPECT(buffer.stats().concealed == 1);
+        /* The lost packet arriving after its slot was concealed is dropped */
+        buffer.Push(MakePacket(3), 260);
+        EXPECT(buffer.stats().late == 1 && buffer.Empty());
+    }
+    {
+        /* Duplicates are dropped */
+        AudioJitterBuffer buffer;
+        buffer.Push(MakePacket(1), 0);
+        buffer.Push(MakePacket(1), 10);
+        EXPECT(buffer.Size() == 1 && buffer.stats().late == 1);
+    }
+    {
+        /* Gaps longer than the concealment limit are skipped */
+        AudioJitterBuffer buffer;
+        buffer.Push(MakePacket(1), 0);
+        buffer.Push(MakePacket(10), 540);
+        EXPECT(PopAll(buffer, 540) == (std::vector<uint32_t>{1, 10}));
+        EXPECT(buffer.stats().skipped == 8);
+    }
+    {
+        /* A jump beyond the buffer resyncs to the new sequence */
+        AudioJitterBuffer buffer;
+        buffer.Push(MakePacket(1), 0);
+        EXPECT(PopAll(buffer, 0) == std::vector<uint32_t>{1});
+        buffer.Push(MakePacket(1000), 60);
+        EXPECT(PopAll(buffer, 60) == std::vector<uint32_t>{1000});
+    }
+    {
+        /* The buffer is bounded */
+        AudioJitterBuffer buffer;
+        for (uint32_t seq = 1; seq <= JITTER_BUFFER_MAX_FRAMES; seq++) {
+            buffer.Push(MakePacket(seq), 0);
+        }
+        EXPECT(buffer.Full() && buffer.Size() == JITTER_BUFFER_MAX_FRAMES);
+    }
+    {
+        /* Late arrivals grow the target depth, prebuffering then holds playback back */
+        AudioJitterBuffer buffer;
+        int64_t now = 0;
+        for (uint32_t seq = 1; seq <= 20; seq++) {
+            now = seq * 60 + (seq % 4 == 0 ? 150 : 0);
+            buffer.Push(MakePacket(seq), now);
+            PopAll(buffer, now);
+        }
+        EXPECT(buffer.stats().jitter_ms >= 100);
+        /* After an underrun the next packet waits for the target depth */
+        buffer.Push(MakePacket(21), now + 60);
+        std::unique_ptr<AudioStreamPacket> packet;
+        int wait_ms = 0;
+        EXPECT(buffer.Pop(now + 60, packet, wait_ms) == AudioJitterBuffer::kPopNone && wait_ms > 0);
+    }
+    {
+        /* Transports without numbering are numbered in arrival order */
+        AudioJitterBuffer buffer;
+        for (int i = 0; i < 3; i++) {
+            buffer.Push(MakePacket(0), i * 60);
+        }
+        EXPECT(PopAll(buffer, 120) == (std::vector<uint32_t>{0, 0, 0}) && buffer.stats().concealed == 0);
+    }
+}
+
+/* ---------------------------------------------------------------- Mixer */
+
+static void TestMixer() {
+    const size_t block = 320;  // 20ms at 16kHz
+    std::vector<int16_t> voice(block);
+    std::vector<int16_t> media(block, 10000);
+    std::vector<int32_t> output(block);
+    for (size_t i = 0; i < block; i++) {
+        voice[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * i / 16000.0));
+    }
+
+    {
+        /* A single source at unity gain passes through unchanged */
+        AudioMixer mixer;
+        const int16_t* inputs[kAudioMixSourceCount] = {voice.data(), nullptr};
+        mixer.Mix(inputs, block, output.data());
+        bool equal = true;
+        for (size_t i = 0; i < block; i++) {
+            equal = equal && output[i] == voice[i];
+        }
+        EXPECT(equal);
+
+        /* No source gives silence */
+        const int16_t* none[kAudioMixSourceCount] = {nullptr, nullptr};
+        mixer.Mix(none, block, output.data());
+        EXPECT(std::all_of(output.begin(), output.end(), [](int32_t v) { return v == 0; }));
+    }
+    {
+        /* Voice ducks media to CONFIG_AUDIO_MIXER_DUCK_PERCENT within the ramp time */
+        AudioMixer mixer;
+        std::vector<int16_t> silence(block, 0);
+        const int16_t* both[kAudioMixSourceCount] = {silence.data(), media.data()};
+        for (int i = 0; i < 3; i++) {
+            mixer.Mix(both, block, output.data());
+        }
+        EXPECT(std::abs(output[block - 1] - 2000) <= 10);
+
+        /* Media stays ducked for the hold time after voice stops, then ramps back up */
+        const int16_t* media_only[kAudioMixSourceCount] = {nullptr, media.data()};
+        int blocks_ducked = 0;
+        for (int i = 0; i < 50; i++) {
+            mixer.Mix(media_only, block, output.data());
+            if (output[block - 1] < 3000) {
+                blocks_ducked++;
+            }
+        }
+        EXPECT(blocks_ducked >= AUDIO_MIXER_DUCK_HOLD_MS / 20 && blocks_ducked <= AUDIO_MIXER_DUCK_HOLD_MS / 20 + 2);
+        EXPECT(output[block - 1] == 10000);
+    }
+    {
+        /* Gain changes are ramped, no block jumps by more than the ramp allows */
+        AudioMixer mixer;
+        const int16_t* inputs[kAudioMixSourceCount] = {nullptr, media.data()};
+        mixer.Mix(inputs, block, output.data());
+        mixer.SetGain(kAudioMixSourceMedia, 0.0f);
+        /* The integer ramp step takes slightly longer than AUDIO_MIXER_RAMP_MS to reach zero */
+        mixer.Mix(inputs, block, output.data());
+        int32_t largest_step = 0;
+        for (size_t i = 1; i < block; i++) {
+            largest_step = std::max(largest_step, std::abs(output[i] - output[i - 1]));
+        }
+        EXPECT(largest_step <= 10000 * 1000 / (16000 * AUDIO_MIXER_RAMP_MS) + 2);
+        EXPECT(output[block - 1] > 0 && output[block - 1] < 1000);
+        mixer.Mix(inputs, block, output.data());
+        mixer.Mix(inputs, block, output.data());
+        EXPECT(std::all_of(output.begin(), output.end(), [](int32_t v) { return v == 0; }));
+    }
+}
+
+/* ---------------------------------------------------------------- Output DSP */
+
+static void TestOutputDsp() {
+    const size_t samples = 16000;
+    std::vector<int32_t> mix(samples);
+    std::vector<int16_t> out(samples);
+    auto sine = [&](double amplitude) {
+        for (size_t i = 0; i < samples; i++) {
+            mix[i] = (int32_t)(amplitude * sin(2 * M_PI * 1000 * i / 16000.0));
+        }
+    };
+
+    {
+        /* Without EQ and limiter the mix is only saturated to 16 bits */
+        AudioOutputDsp dsp;
+        dsp.SetLimiter(0);
+        sine(40000);
+        std::vector<int32_t> input = mix;
+        dsp.Process(mix.data(), samples, out.data());
+        bool equal = true;
+        for (size_t i = 0; i < samples; i++) {
+            equal = equal && out[i] == std::clamp<int32_t>(input[i], INT16_MIN, INT16_MAX);
+        }
+        EXPECT(equal);
+    }
+    {
+        /* The limiter keeps a mix three times full scale under its threshold without clipping */
+        AudioOutputDsp dsp;
+        dsp.SetLimiter(-1.0f);
+        sine(3 * 32767.0);
+        dsp.Process(mix.data(), samples, out.data());
+        int threshold = (int)(32767 * pow(10.0, -1.0 / 20));
+        int peak = 0;
+        for (size_t i = 0; i < samples; i++) {
+            peak = std::max(peak, std::abs((int)out[i]));
+        }
+        EXPECT(peak <= threshold + 1);
+        EXPECT(peak >= threshold * 9 / 10);
+    }
+    {
+        /* Quiet audio passes the limiter unchanged, delayed by two sub-blocks */
+        AudioOutputDsp dsp;
+        dsp.SetLimiter(-1.0f);
+        sine(10000);
+        std::vector<int32_t> input = mix;
+        dsp.Process(mix.data(), samples, out.data());
+        size_t delay = 2 * 16000 * AUDIO_OUTPUT_LIMITER_BLOCK_MS / 1000;
+        bool equal = true;
+        for (size_t i = delay; i < samples; i++) {
+            equal = equal && out[i] == input[i - delay];
+        }
+        EXPECT(equal);
+    }
+    {
+        /* A high-pass band removes DC */
+        AudioOutputDsp dsp;
+        dsp.SetLimiter(0);
+        dsp.SetEq({{AudioEqBand::kHighPass, 100, 0.707f, 0.0f}});
+        std::fill(mix.begin(), mix.end(), 10000);
+        dsp.Process(mix.data(), samples, out.data());
+        EXPECT(std::abs(out[samples - 1]) <= 2);
+    }
+    {
+        /* A peaking band boosts its center frequency by its gain */
+        AudioOutputDsp dsp;
+        dsp.SetLimiter(0);
+        dsp.SetEq({{AudioEqBand::kPeaking, 1000, 1.0f, 6.0f}});
+        sine(8000);
+        dsp.Process(mix.data(), samples, out.data());
+        int peak = 0;
+        for (size_t i = samples / 2; i < samples; i++) {
+            peak = std::max(peak, std::abs((int)out[i]));
+        }
+        EXPECT(std::abs(peak - (int)(8000 * pow(10.0, 6.0 / 20))) <= 100);
+    }
+}
+
+/* ---------------------------------------------------------------- Ogg demuxer */
+
+/* Appends one Ogg page, `continued` marks a page whose first segment continues a packet */
+static void AppendPage(std::vector<uint8_t>& stream, const std::vector<uint8_t>& lacing,
+                       const std::vector<uint8_t>& body, int64_t granule, bool continued) {
+    uint8_t header[27] = {'O', 'g', 'g', 'S', 0, (uint8_t)(continued ? 1 : 0)};
+    for (int i = 0; i < 8; i++) {
+        header[6 + i] = (uint8_t)(granule >> (8 * i));
+    }
+    header[26] = (uint8_t)lacing.size();
+    stream.insert(stream.end(), header, header + sizeof(header));
+    stream.insert(stream.end(), lacing.begin(), lacing.end());
+    stream.insert(stream.end(), body.begin(), body.end());
+}
+
+static void AppendPacketLacing(std::vector<uint8_t>& lacing, size_t size) {
+    for (; size >= 255; size -= 255) {
+        lacing.push_back(255);
+    }
+    lacing.push_back((uint8_t)size);
+}
+
+static std::vector<uint8_t> MakePacketData(size_t size, uint8_t seed) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(seed + i * 7);
+    }
+    return data;
+}
+
+static void TestOggDemuxer() {
+    std::vector<uint8_t> stream = {'j', 'u', 'n', 'k', 'O', 'g'};  // Garbage before the first page
+    std::vector<std::vector<uint8_t>> expected;
+
+    std::vector<uint8_t> head = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 1, 0x38, 0x01,
+                                 0x80, 0x3e, 0x00, 0x00, 0, 0, 0};  // 16000Hz
+    AppendPage(stream, {(uint8_t)head.size()}, head, 0, false);
+    std::vector<uint8_t> tags = {'O', 'p', 'u', 's', 'T', 'a', 'g', 's', 0, 0, 0, 0, 0, 0, 0, 0};
+    AppendPage(stream, {(uint8_t)tags.size()}, tags, 0, false);
+
+    /* Three 60ms packets per page, one of them longer than a lacing segment */
+    int64_t granule = 0;
+    for (int page = 0; page < 4; page++) {
+        std::vector<uint8_t> lacing;
+        std::vector<uint8_t> body;
+        for (int i = 0; i < 3; i++) {
+            auto packet = MakePacketData(i == 1 ? 300 : 40 + page * 10 + i, (uint8_t)(page * 3 + i));
+            AppendPacketLacing(lacing, packet.size());
+            body.insert(body.end(), packet.begin(), packet.end());
+            expected.push_back(packet);
+        }
+        granule += 3 * 2880;
+        AppendPage(stream, lacing, body, granule, false);
+    }
+
+    /* A packet continued across two pages */
+    auto split = MakePacketData(600, 99);
+    AppendPage(stream, {255, 255}, std::vector<uint8_t>(split.begin(), split.begin() + 510), -1, false);
+    granule += 2880;
+    AppendPage(stream, {90}, std::vector<uint8_t>(split.begin() + 510, split.end()), granule, true);
+    expected.push_back(split);
+
+    for (size_t chunk : {stream.size(), (size_t)1, (size_t)7, (size_t)100}) {
+        std::vector<std::vector<uint8_t>> packets;
+        bool durations_ok = true;
+        bool rates_ok = true;
+        OggDemuxer demuxer([&](const OggDemuxer::Packet& packet) {
+            packets.emplace_back(packet.data, packet.data + packet.size);
+            durations_ok = durations_ok && packet.frame_duration == 60;
+            rates_ok = rates_ok && packet.sample_rate == 16000;
+        });
+        /* Feed from separate copies so views into a previous chunk would be caught by the sanitizers */
+        for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+            size_t size = std::min(chunk, stream.size() - offset);
+            std::vector<uint8_t> piece(stream.begin() + offset, stream.begin() + offset + size);
+            demuxer.Feed(piece.data(), piece.size());
+        }
+        if (packets != expected) {
+            fprintf(stderr, "Ogg demuxer with %zu byte chunks returned %zu packets\n", chunk, packets.size());
+            failures++;
+        }
+        EXPECT(durations_ok && rates_ok);
+    }
+}
+
+/* ---------------------------------------------------------------- PCM kernels */
+
+static int16_t Saturate(int64_t value) {
+    return (int16_t)std::clamp<int64_t>(value, -INT16_MAX, INT16_MAX);
+}
+
+static void TestPcmKernels() {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> sample(INT16_MIN, INT16_MAX);
+    EXPECT(PcmVolumeToGain(0) == 0 && PcmVolumeToGain(100) == 65536 && PcmVolumeToGain(50) == 16384);
+
+    /* Lengths that are not a multiple of the unrolled loop cover the tail */
+    for (size_t samples : {0, 1, 3, 4, 7, 960}) {
+        std::vector<int16_t> src(samples);
+        for (auto& value : src) {
+            value = (int16_t)sample(random);
+        }
+
+        int32_t gain = PcmVolumeToGain(70);
+        std::vector<int32_t> wide(samples);
+        PcmScaleWiden(src.data(), wide.data(), samples, gain);
+        bool ok = true;
+        for (size_t i = 0; i < samples; i++) {
+            ok = ok && wide[i] == src[i] * gain;
+        }
+        EXPECT(ok);
+
+        std::vector<int16_t> narrow(samples);
+        PcmNarrow(wide.data(), narrow.data(), samples, 14, 3);
+        ok = true;
+        for (size_t i = 0; i < samples; i++) {
+            ok = ok && narrow[i] == Saturate((int64_t)(wide[i] >> 14) * 3);
+        }
+        EXPECT(ok);
+
+        std::vector<int16_t> data = src;
+        PcmApplyGain(data.data(), samples, 2);
+        ok = true;
+        for (size_t i = 0; i < samples; i++) {
+            ok = ok && data[i] == Saturate(src[i] * 2);
+        }
+        EXPECT(ok);
+    }
+}
+
+int main() {
+    struct {
+        const char* name;
+        void (*run)();
+    } tests[] = {
+        { "AudioJitterBuffer", TestJitterBuffer },
+        { "AudioMixer", TestMixer },
+        { "AudioOutputDsp", TestOutputDsp },
+        { "OggDemuxer", TestOggDemuxer },
+        { "PCM kernels", TestPcmKernels },
+    };
+    for (auto& test : tests) {
+        int before = failures;
+        test.run();
+        printf("%-20s %s\n", test.name, failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,609 @@
+/*
+ * Host simulator of AudioService (main/audio/audio_service.cc) and benchmark of the voice pipeline.
+ *
+ * The firmware's AudioService, EspWakeWord, NoAudioProcessor and TaskTopology run unchanged on
+ * the host runtime in host/: FreeRTOS tasks are threads, and esp-sr, Opus and the resampler are
+ * stand-ins (libopus with HOST_USE_LIBOPUS). FileAudioCodec takes the place of the board codec,
+ * LoopbackProtocol the place of the server: every uplink packet comes back as downlink audio,
+ * optionally with loss. The main thread plays the part of Application, wake word -> listening ->
+ * send loop, and with libopus plays an Ogg/Opus file through PlaySound() once listening ends.
+ *
+ * One JSON object is printed: frames per second of the pipeline, the AudioLatencyTracer
+ * percentiles, heap allocations per frame once listening has settled, and the codec benchmark
+ * (main/audio/audio_benchmark.cc) on the same codecs. Returns 1 if audio did not make it from
+ * the microphone to the speaker, the speech after the wake word was not all sent, or the
+ * allocation budget was exceeded.
+ */
+#include "audio_service.h"
+#include "audio_benchmark.h"
+#include "audio_processor_harness.h"
+#include "codecs/dummy_audio_codec.h"
+#include "protocol.h"
+
+#include <esp_heap_caps.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SIM_OUTPUT_SAMPLE_RATE 24000
+#define SIM_SETTLE_MS 1000          // Listening time before allocations are counted
+#define SIM_DRAIN_TIMEOUT_MS 5000
+#define SIM_REACTION_MS 300         // Input read after the wake word before listening has started
+#define SIM_BENCHMARK_SECONDS 10
+
+#ifdef HOST_USE_LIBOPUS
+#define HOST_LIBOPUS true
+#else
+#define HOST_LIBOPUS false
+#endif
+
+/* Every operator new in the process, the heap_caps_malloc() calls are counted by host/esp_heap_caps.h */
+static std::atomic<size_t> new_allocations{0};
+
+void* operator new(size_t size) {
+    new_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+    free(ptr);
+}
+
+static size_t AllocationCount() {
+    return new_allocations.load() + host_heap_stats.allocations.load();
+}
+
+/* Sleeps until `samples` more samples are due at `rate`, restarting the clock after a pause */
+class Pacer {
+public:
+    void Advance(size_t samples, int rate) {
+        auto now = std::chrono::steady_clock::now();
+        if (samples_ == 0 || now - Due(rate) > std::chrono::milliseconds(100)) {
+            start_ = now;
+            samples_ = 0;
+        }
+        samples_ += samples;
+        std::this_thread::sleep_until(Due(rate));
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    uint64_t samples_ = 0;
+
+    std::chrono::steady_clock::time_point Due(int rate) const {
+        return start_ + std::chrono::microseconds(samples_ * 1000000 / rate);
+    }
+};
+
+/*
+ * The board codec on top of DummyAudioCodec: the microphone reads a PCM buffer (silence once it
+ * has been read), the speaker is written to memory. Without realtime both run as fast as the
+ * pipeline takes them, and Hold() stands in for the time the application takes to react: once
+ * `frames` more have been read, the microphone waits for Release().
+ */
+class FileAudioCodec : public DummyAudioCodec {
+public:
+    FileAudioCodec(std::vector<int16_t>&& input, int input_sample_rate, int input_channels, int output_sample_rate,
+                   bool realtime, bool keep_output)
+        : DummyAudioCodec(input_sample_rate, output_sample_rate), input_(std::move(input)), realtime_(realtime),
+          keep_output_(keep_output) {
+        input_channels_ = input_channels;
+    }
+
+    void Hold(size_t frames) {
+        std::lock_guard<std::mutex> lock(hold_mutex_);
+        hold_position_ = read_samples_ + frames * input_channels_;
+        holding_ = true;
+    }
+
+    void Release() {
+        std::lock_guard<std::mutex> lock(hold_mutex_);
+        holding_ = false;
+        hold_cv_.notify_all();
+    }
+
+    bool input_finished() const { return input_finished_; }
+    /* Samples per channel read so far, at the input rate */
+    size_t input_position() const { return input_position_ / input_channels_; }
+    size_t input_frames() const { return input_.size() / input_channels_; }
+    size_t output_samples() const { return output_samples_; }
+    double output_rms() const { return output_samples_ > 0 ? sqrt(output_energy_ / output_samples_) : 0; }
+    const std::vector<int16_t>& output() const { return output_; }
+
+private:
+    std::vector<int16_t> input_;
+    std::atomic<size_t> input_position_{0};
+    std::atomic<bool> input_finished_{false};
+    bool realtime_;
+    bool keep_output_;
+    std::mutex hold_mutex_;
+    std::condition_variable hold_cv_;
+    bool holding_ = false;
+    size_t hold_position_ = 0;
+    std::atomic<size_t> read_samples_{0};  // Including the silence after the input
+    Pacer input_pacer_;
+    Pacer output_pacer_;
+    std::vector<int16_t> output_;
+    std::atomic<size_t> output_samples_{0};
+    double output_energy_ = 0;
+
+    int Read(int16_t* dest, int samples) override {
+        if (!realtime_) {
+            std::unique_lock<std::mutex> lock(hold_mutex_);
+            hold_cv_.wait(lock, [this]() { return !holding_ || read_samples_ < hold_position_; });
+        }
+        size_t position = input_position_;
+        size_t copied = std::min((size_t)samples, input_.size() - position);
+        memcpy(dest, input_.data() + position, copied * sizeof(int16_t));
+        memset(dest + copied, 0, (samples - copied) * sizeof(int16_t));
+        input_position_ = position + copied;
+        read_samples_ += samples;
+        if (position + copied == input_.size()) {
+            input_finished_ = true;
+        }
+        if (realtime_) {
+            input_pacer_.Advance(samples / input_channels_, input_sample_rate_);
+        }
+        return samples;
+    }
+
+    int Write(const int16_t* data, int samples) override {
+        for (int i = 0; i < samples; i++) {
+            output_energy_ += (double)data[i] * data[i];
+        }
+        if (keep_output_) {
+            output_.insert(output_.end(), data, data + samples);
+        }
+        output_samples_ += samples;
+        if (realtime_) {
+            output_pacer_.Advance(samples, output_sample_rate_);
+        }
+        return samples;
+    }
+};
+
+/* The server: counts the uplink and returns every packet as downlink audio, numbered as UDP does */
+class LoopbackProtocol : public Protocol {
+public:
+    explicit LoopbackProtocol(int loss_percent) : loss_percent_(loss_percent) {}
+
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override {
+        opened_ = true;
+        session_id_ = "host";
+        if (on_audio_channel_opened_) {
+            on_audio_channel_opened_();
+        }
+        return true;
+    }
+    void CloseAudioChannel(bool send_goodbye = true) override { opened_ = false; }
+    bool IsAudioChannelOpened() const override { return opened_; }
+
+    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override {
+        uplink_packets_++;
+        uplink_bytes_ += packet->payload.size();
+        uplink_ms_ += packet->frame_duration;
+        packet->sequence = ++sequence_;
+        seed_ = seed_ * 1664525 + 1013904223;
+        if ((int)((seed_ >> 16) % 100) < loss_percent_) {
+            lost_packets_++;
+            return true;
+        }
+        if (on_incoming_audio_) {
+            on_incoming_audio_(std::move(packet));
+        }
+        return true;
+    }
+
+    size_t uplink_packets() const { return uplink_packets_; }
+    size_t uplink_bytes() const { return uplink_bytes_; }
+    size_t uplink_ms() const { return uplink_ms_; }
+    size_t lost_packets() const { return lost_packets_; }
+    size_t messages() const { return messages_; }
+
+private:
+    int loss_percent_;
+    bool opened_ = false;
+    uint32_t sequence_ = 0;
+    uint32_t seed_ = 1;
+    size_t uplink_packets_ = 0;
+    size_t uplink_bytes_ = 0;
+    size_t uplink_ms_ = 0;
+    size_t lost_packets_ = 0;
+    size_t messages_ = 0;
+
+    bool SendText(const std::string& text) override {
+        messages_++;
+        return true;
+    }
+};
+
+/* 16kHz mono: quiet noise, a loud 300ms burst the host wake word detects, speech band tones, quiet noise */
+static std::vector<int16_t> MakeInput(int silence_ms, int speech_ms, int tail_ms) {
+    const int burst_ms = 300;
+    size_t frames = (size_t)(silence_ms + burst_ms + speech_ms + tail_ms) * 16;
+    std::vector<int16_t> pcm(frames);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < frames; i++) {
+        seed = seed * 1664525 + 1013904223;
+        double sample = (int)(seed >> 24) - 128;  // About -50 dBFS of noise
+        double t = i / 16000.0;
+        int ms = (int)(i / 16);
+        if (ms >= silence_ms && ms < silence_ms + burst_ms) {
+            sample += 8000 * sin(2 * M_PI * 800 * t);
+        } else if (ms >= silence_ms + burst_ms && ms < silence_ms + burst_ms + speech_ms) {
+            double envelope = 0.75 + 0.25 * sin(2 * M_PI * 4 * t);
+            sample += envelope * (3000 * sin(2 * M_PI * 300 * t) + 2000 * sin(2 * M_PI * 1200 * t) +
+                                  1000 * sin(2 * M_PI * 2500 * t));
+        }
+        pcm[i] = (int16_t)sample;
+    }
+    return pcm;
+}
+
+static bool ReadFile(const char* path, std::string& data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static void Append16(std::string& out, uint16_t value) {
+    out.push_back((char)(value & 0xff));
+    out.push_back((char)(value >> 8));
+}
+
+static void Append32(std::string& out, uint32_t value) {
+    Append16(out, value & 0xffff);
+    Append16(out, value >> 16);
+}
+
+static bool WriteWav(const char* path, const std::vector<int16_t>& pcm, int sample_rate) {
+    std::string wav = "RIFF";
+    Append32(wav, (uint32_t)(36 + pcm.size() * 2));
+    wav += "WAVEfmt ";
+    Append32(wav, 16);
+    Append16(wav, 1);
+    Append16(wav, 1);
+    Append32(wav, sample_rate);
+    Append32(wav, sample_rate * 2);
+    Append16(wav, 2);
+    Append16(wav, 16);
+    wav += "data";
+    Append32(wav, (uint32_t)(pcm.size() * 2));
+    for (auto sample : pcm) {
+        Append16(wav, (uint16_t)sample);
+    }
+    std::ofstream file(path, std::ios::binary);
+    file.write(wav.data(), wav.size());
+    return (bool)file;
+}
+
+static void Usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--input mic.wav] [--output speaker.wav] [--play sound.ogg] [--realtime]\n"
+                    "          [--no-wake-word] [--loss percent] [--max-allocs-per-frame n] [--bench-seconds n]\n", program);
+}
+
+int main(int argc, char** argv) {
+    const char* input_path = nullptr;
+    const char* output_path = nullptr;
+    const char* play_path = nullptr;
+    bool realtime = false;
+    bool wake_word = true;
+    int loss_percent = 0;
+    double max_allocs_per_frame = -1;
+    int bench_seconds = SIM_BENCHMARK_SECONDS;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--input" && has_value) {
+            input_path = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            output_path = argv[++i];
+        } else if (arg == "--play" && has_value) {
+            play_path = argv[++i];
+        } else if (arg == "--realtime") {
+            realtime = true;
+        } else if (arg == "--no-wake-word") {
+            wake_word = false;
+        } else if (arg == "--loss" && has_value) {
+            loss_percent = atoi(argv[++i]);
+        } else if (arg == "--max-allocs-per-frame" && has_value) {
+            max_allocs_per_frame = atof(argv[++i]);
+        } else if (arg == "--bench-seconds" && has_value) {
+            bench_seconds = atoi(argv[++i]);
+        } else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<int16_t> input;
+    int input_rate = 16000;
+    int input_channels = 1;
+    if (input_path != nullptr) {
+        std::string wav;
+        const int16_t* pcm = nullptr;
+        size_t frames = 0;
+        if (!ReadFile(input_path, wav) || !AudioProcessorHarness::ParseWav((const uint8_t*)wav.data(), wav.size(),
+                                                                            input_channels, input_rate, pcm, frames)) {
+            fprintf(stderr, "Expected a 16-bit PCM WAV file: %s\n", input_path);
+            return 1;
+        }
+        input.assign(pcm, pcm + frames * input_channels);
+    } else {
+        input = MakeInput(1500, 3000, 1000);
+    }
+    std::string sound;
+    if (play_path != nullptr && !HOST_LIBOPUS) {
+        fprintf(stderr, "--play needs the libopus build (-DHOST_USE_LIBOPUS)\n");
+        return 1;
+    }
+    if (play_path != nullptr && !ReadFile(play_path, sound)) {
+        fprintf(stderr, "Cannot read %s\n", play_path);
+        return 1;
+    }
+
+    FileAudioCodec codec(std::move(input), input_rate, input_channels, SIM_OUTPUT_SAMPLE_RATE, realtime, output_path != nullptr);
+    LoopbackProtocol protocol(loss_percent);
+    auto service = std::make_unique<AudioService>();
+    AudioService& audio_service = *service;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool send_ready = false;
+    bool wake_word_pending = false;
+    size_t wake_word_position = 0;  // Input samples per channel read when the wake word was detected
+    AudioServiceCallbacks callbacks;
+    callbacks.on_send_queue_available = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        send_ready = true;
+        cv.notify_one();
+    };
+    callbacks.on_wake_word_detected = [&](const std::string& word) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake_word_pending = true;
+        wake_word_position = codec.input_position();
+        codec.Hold((size_t)SIM_REACTION_MS * codec.input_sample_rate() / 1000);
+        cv.notify_one();
+    };
+    audio_service.SetCallbacks(callbacks);
+    /* Without real time, back pressure replaces the drops a full decode queue causes on the device */
+    protocol.OnIncomingAudio([&](std::unique_ptr<AudioStreamPacket> packet) {
+        audio_service.GetLatencyTracer().OnResponsePacket();
+        audio_service.PushPacketToDecodeQueue(std::move(packet), !realtime);
+    });
+
+    audio_service.Initialize(&codec);
+    audio_service.Start();
+    if (wake_word) {
+        audio_service.SetModelsList(esp_srmodel_init("model"));
+    }
+
+    /* Only what is queued now, without real time the input never lets the queue run empty */
+    auto send_queued_audio = [&]() {
+        for (size_t n = audio_service.GetSendQueueSize(); n > 0; n--) {
+            auto packet = audio_service.PopPacketFromSendQueue();
+            if (!packet) {
+                break;
+            }
+            uint32_t send_start = AudioLatencyTracer::Now();
+            protocol.SendAudio(std::move(packet));
+            audio_service.GetLatencyTracer().Record(kLatencyStageSend, send_start);
+        }
+    };
+    bool listening = false;
+    auto start_listening = [&]() {
+        protocol.OpenAudioChannel();
+        if (wake_word) {
+            audio_service.EncodeWakeWord();
+#if CONFIG_SEND_WAKE_WORD_DATA
+            while (auto packet = audio_service.PopWakeWordPacket()) {
+                protocol.SendAudio(std::move(packet));
+            }
+#endif
+            protocol.SendWakeWordDetected(audio_service.GetLastWakeWord());
+        }
+        protocol.SendStartListening(kListeningModeRealtime);
+        audio_service.EnableVoiceProcessing(true);
+        audio_service.EnableWakeWordDetection(false);
+        listening = true;
+    };
+
+    auto start_time = std::chrono::steady_clock::now();
+    if (wake_word) {
+        audio_service.EnableWakeWordDetection(true);
+    } else {
+        start_listening();
+    }
+
+    /* Input after the wake word, in ms, which listening has to send before it stops */
+    auto speech_ms = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (codec.input_frames() - wake_word_position) * 1000.0 / input_rate;
+    };
+
+    /*
+     * Listening lasts until everything read after the wake word was sent, as the input may be read
+     * well ahead of the encoder while the pre-roll is replayed. Allocations are counted from
+     * SIM_SETTLE_MS into listening until it stops.
+     */
+    size_t settle_packets = 0;
+    size_t window_packets = 0;
+    size_t window_allocations = 0;
+    bool counting = false;
+    std::chrono::steady_clock::time_point sent_deadline;
+    bool input_finished = false;
+    while (true) {
+        bool wake = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(10), [&]() { return send_ready || wake_word_pending; });
+            /* A wake word is reported before the input can end, so one still pending is handled first */
+            if (!input_finished && codec.input_finished() && !wake_word_pending) {
+                input_finished = true;
+                sent_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SIM_DRAIN_TIMEOUT_MS);
+            }
+            send_ready = false;
+            std::swap(wake, wake_word_pending);
+        }
+        if (wake && !listening) {
+            start_listening();
+            codec.Release();
+            settle_packets = protocol.uplink_packets() + SIM_SETTLE_MS / audio_service.GetEncoderFrameDuration();
+        }
+        send_queued_audio();
+        if (listening && !counting && protocol.uplink_packets() >= settle_packets) {
+            counting = true;
+            window_packets = protocol.uplink_packets();
+            window_allocations = AllocationCount();
+        }
+        if (input_finished && (!listening || protocol.uplink_ms() >= speech_ms() ||
+                               std::chrono::steady_clock::now() >= sent_deadline)) {
+            break;
+        }
+    }
+    if (counting) {
+        window_packets = protocol.uplink_packets() - window_packets;
+        window_allocations = AllocationCount() - window_allocations;
+    }
+
+    /* Stop listening and let the queued audio drain */
+    audio_service.EnableVoiceProcessing(false);
+    audio_service.EnableWakeWordDetection(false);
+    auto drain = [&]() {
+        /* The output task may still hold a popped frame while the queues are empty */
+        int idle_polls = 0;
+        size_t output_samples = codec.output_samples();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SIM_DRAIN_TIMEOUT_MS);
+        while (idle_polls < 5 && std::chrono::steady_clock::now() < deadline) {
+            send_queued_audio();
+            bool idle = audio_service.IsIdle() && audio_service.GetSendQueueSize() == 0 &&
+                codec.output_samples() == output_samples;
+            idle_polls = idle ? idle_polls + 1 : 0;
+            output_samples = codec.output_samples();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    };
+    drain();
+    size_t echo_samples = codec.output_samples();
+    if (!sound.empty()) {
+        audio_service.PlaySound(sound);
+        audio_service.WaitForPlaybackQueueEmpty();
+        drain();
+    }
+    auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    audio_service.Stop();
+    host_wait_for_tasks();
+    std::string latency_json = audio_service.GetLatencyTracer().GetStatsJson();
+    service.reset();
+
+    /* The codec benchmark on the same codecs, with its own encoder, decoder and resampler */
+    size_t bench_allocations = AllocationCount();
+    AudioBenchmark benchmark(OPUS_FRAME_DURATION_MS, SIM_OUTPUT_SAMPLE_RATE);
+    bool bench_ok = bench_seconds <= 0 || benchmark.Run(bench_seconds);
+    bench_allocations = AllocationCount() - bench_allocations;
+
+    double audio_ms = codec.input_frames() * 1000.0 / input_rate;
+    size_t downlink_packets = protocol.uplink_packets() - protocol.lost_packets();
+    double allocs_per_frame = window_packets > 0 ? (double)window_allocations / window_packets : 0;
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "audio_ms", audio_ms);
+    cJSON_AddNumberToObject(root, "wall_ms", wall_ms);
+    if (wall_ms > 0) {
+        cJSON_AddNumberToObject(root, "realtime_factor", audio_ms / wall_ms);
+    }
+    cJSON_AddBoolToObject(root, "libopus", HOST_LIBOPUS);
+    cJSON* uplink = cJSON_CreateObject();
+    cJSON_AddNumberToObject(uplink, "packets", protocol.uplink_packets());
+    cJSON_AddNumberToObject(uplink, "audio_ms", protocol.uplink_ms());
+    cJSON_AddNumberToObject(uplink, "expected_ms", speech_ms());
+    if (protocol.uplink_ms() > 0) {
+        cJSON_AddNumberToObject(uplink, "kbps", protocol.uplink_bytes() * 8.0 / protocol.uplink_ms());
+    }
+    if (wall_ms > 0) {
+        cJSON_AddNumberToObject(uplink, "frames_per_second", protocol.uplink_packets() * 1000.0 / wall_ms);
+    }
+    cJSON_AddItemToObject(root, "uplink", uplink);
+    cJSON* downlink = cJSON_CreateObject();
+    cJSON_AddNumberToObject(downlink, "packets", downlink_packets);
+    cJSON_AddNumberToObject(downlink, "lost", protocol.lost_packets());
+    if (wall_ms > 0) {
+        cJSON_AddNumberToObject(downlink, "frames_per_second", downlink_packets * 1000.0 / wall_ms);
+    }
+    cJSON_AddNumberToObject(downlink, "output_ms", codec.output_samples() * 1000.0 / SIM_OUTPUT_SAMPLE_RATE);
+    cJSON_AddNumberToObject(downlink, "output_rms", codec.output_rms());
+    cJSON_AddItemToObject(root, "downlink", downlink);
+    cJSON_AddRawToObject(root, "latency", latency_json.c_str());
+    cJSON* allocations = cJSON_CreateObject();
+    cJSON_AddNumberToObject(allocations, "frames", window_packets);
+    cJSON_AddNumberToObject(allocations, "count", window_allocations);
+    cJSON_AddNumberToObject(allocations, "per_frame", allocs_per_frame);
+    size_t pool_fallbacks = 0;
+    for (int i = 0; i < AudioFramePool::kBlockClassCount; i++) {
+        pool_fallbacks += AudioFramePool::GetInstance().GetStats((AudioFramePool::BlockClass)i).fallbacks;
+    }
+    cJSON_AddNumberToObject(allocations, "pool_fallbacks", pool_fallbacks);
+    cJSON_AddItemToObject(root, "allocations", allocations);
+    if (bench_seconds > 0) {
+        std::string bench_json = benchmark.GetResultJson();
+        cJSON_AddRawToObject(root, "codec_benchmark", bench_json.c_str());
+        cJSON_AddNumberToObject(root, "codec_benchmark_allocations", bench_allocations);
+    }
+    char* json = cJSON_PrintUnformatted(root);
+    printf("%s\n", json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+
+    if (output_path != nullptr && !WriteWav(output_path, codec.output(), SIM_OUTPUT_SAMPLE_RATE)) {
+        fprintf(stderr, "Cannot write %s\n", output_path);
+        return 1;
+    }
+
+    bool ok = true;
+    if (wake_word && wake_word_position == 0) {
+        fprintf(stderr, "The wake word was not detected\n");
+        ok = false;
+    }
+    /* The last frame may be partial, and detection works on whole wake word chunks */
+    if (protocol.uplink_ms() + 2 * OPUS_FRAME_DURATION_MS < speech_ms()) {
+        fprintf(stderr, "Sent %zu ms of the %.0f ms after the wake word\n", protocol.uplink_ms(), speech_ms());
+        ok = false;
+    }
+    if (echo_samples == 0 || codec.output_rms() < 1) {
+        fprintf(stderr, "No audio reached the speaker\n");
+        ok = false;
+    }
+    if (max_allocs_per_frame >= 0 && allocs_per_frame > max_allocs_per_frame) {
+        fprintf(stderr, "%.2f allocations per frame, the budget is %.2f\n", allocs_per_frame, max_allocs_per_frame);
+        ok = false;
+    }
+    if (!bench_ok) {
+        fprintf(stderr, "Codec benchmark failed\n");
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/* Host stand-in for the cJSON calls the firmware modules make: objects of numbers, booleans and raw JSON */
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct cJSON {
+    bool object = false;
+    std::string value;  // Serialized number, boolean or raw JSON
+    std::vector<std::pair<std::string, cJSON*>> children;
+};
+
+static inline cJSON* cJSON_CreateObject() {
+    auto item = new cJSON();
+    item->object = true;
+    return item;
+}
+
+static inline void cJSON_AddItemToObject(cJSON* object, const char* name, cJSON* item) {
+    object->children.emplace_back(name, item);
+}
+
+static inline cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) {
+    auto item = new cJSON();
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.15g", number);
+    item->value = buffer;
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+static inline cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, bool value) {
+    auto item = new cJSON();
+    item->value = value ? "true" : "false";
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+static inline cJSON* cJSON_AddRawToObject(cJSON* object, const char* name, const char* raw) {
+    auto item = new cJSON();
+    item->value = raw;
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+static inline void cJSON_Delete(cJSON* item) {
+    for (auto& child : item->children) {
+        cJSON_Delete(child.second);
+    }
+    delete item;
+}
+
+static inline std::string cJSON_Serialize(const cJSON* item) {
+    if (!item->object) {
+        return item->value;
+    }
+    std::string json = "{";
+    for (auto& child : item->children) {
+        if (json.size() > 1) {
+            json += ",";
+        }
+        json += "\"" + child.first + "\":" + cJSON_Serialize(child.second);
+    }
+    return json + "}";
+}
+
+static inline char* cJSON_PrintUnformatted(const cJSON* item) {
+    return strdup(cJSON_Serialize(item).c_str());
+}
+
+static inline void cJSON_free(void* ptr) {
+    free(ptr);
+}
@@ -0,0 +1,4 @@
+/* Host stand-in for the I2S driver types named in audio_codec.h */
+#pragma once
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
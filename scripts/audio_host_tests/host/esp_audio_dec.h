@@ -0,0 +1,30 @@
+/* Host stand-in for the esp_audio_codec decoder frame types */
+#pragma once
+#include "esp_audio_types.h"
+
+typedef enum {
+    ESP_AUDIO_DEC_RECOVERY_NONE = 0,
+    ESP_AUDIO_DEC_RECOVERY_PLC = 1,
+} esp_audio_dec_recovery_t;
+
+typedef struct {
+    uint8_t* buffer;
+    uint32_t len;
+    uint32_t consumed;
+    esp_audio_dec_recovery_t frame_recover;
+} esp_audio_dec_in_raw_t;
+
+typedef struct {
+    uint8_t* buffer;
+    uint32_t len;
+    uint32_t needed_size;
+    uint32_t decoded_size;
+} esp_audio_dec_out_frame_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t channel;
+    uint8_t bits_per_sample;
+    uint32_t bitrate;
+    uint32_t frame_size;
+} esp_audio_dec_info_t;
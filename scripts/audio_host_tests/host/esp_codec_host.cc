@@ -0,0 +1,391 @@
+/*
+ * Host implementation of the esp_audio_codec Opus encoder / decoder and of the esp_audio_effects
+ * sample rate converter.
+ *
+ * With HOST_USE_LIBOPUS the Opus calls map to libopus, so packet sizes and codec cost are those
+ * of real Opus (the device runs the esp_audio_codec build of the same library). Without it a
+ * 4-bit IMA ADPCM stand-in keeps the framing, the packet sizes the frame pool sees and a per
+ * sample cost, but its numbers are not Opus numbers, and it cannot decode Ogg/Opus files.
+ * Codec state is allocated with heap_caps_malloc() so it shows up in the heap counters.
+ */
+#include "esp_opus_enc.h"
+#include "esp_opus_dec.h"
+#include "esp_ae_rate_cvt.h"
+#include "esp_heap_caps.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef HOST_USE_LIBOPUS
+#include <opus.h>
+#endif
+
+/* The audio frame pool's Opus block, enough for the speech bitrates used by the firmware */
+#define HOST_OPUS_MAX_PACKET 512
+
+static int EncFrameDurationUs(esp_opus_enc_frame_duration_t duration) {
+    static const int kDurationsUs[] = {2500, 5000, 10000, 20000, 40000, 60000, 80000, 100000, 120000};
+    if (duration < ESP_OPUS_ENC_FRAME_DURATION_2_5_MS || duration > ESP_OPUS_ENC_FRAME_DURATION_120_MS) {
+        return -1;
+    }
+    return kDurationsUs[duration];
+}
+
+static int DecFrameDurationUs(esp_opus_dec_frame_duration_t duration) {
+    return EncFrameDurationUs((esp_opus_enc_frame_duration_t)duration);
+}
+
+template <typename T>
+static T* HeapNew() {
+    void* memory = heap_caps_malloc(sizeof(T), MALLOC_CAP_8BIT);
+    return memory != nullptr ? new (memory) T() : nullptr;
+}
+
+template <typename T>
+static void HeapDelete(T* object) {
+    if (object != nullptr) {
+        object->~T();
+        heap_caps_free(object);
+    }
+}
+
+#ifndef HOST_USE_LIBOPUS
+/*
+ * IMA ADPCM packet: a 0xAD marker, the predictor (int16, little endian) and step index the
+ * frame starts from, then two samples per byte, low nibble first.
+ */
+#define ADPCM_MARKER 0xAD
+#define ADPCM_HEADER_SIZE 4
+
+static const int16_t kAdpcmSteps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767,
+};
+static const int8_t kAdpcmIndexStep[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+struct AdpcmState {
+    int predictor = 0;
+    int index = 0;
+
+    int Decode(uint8_t nibble) {
+        int step = kAdpcmSteps[index];
+        int diff = step >> 3;
+        if (nibble & 4) diff += step;
+        if (nibble & 2) diff += step >> 1;
+        if (nibble & 1) diff += step >> 2;
+        predictor = std::clamp(predictor + ((nibble & 8) ? -diff : diff), -32768, 32767);
+        index = std::clamp(index + kAdpcmIndexStep[nibble & 7], 0, 88);
+        return predictor;
+    }
+
+    uint8_t Encode(int sample) {
+        int step = kAdpcmSteps[index];
+        int diff = sample - predictor;
+        uint8_t nibble = 0;
+        if (diff < 0) {
+            nibble = 8;
+            diff = -diff;
+        }
+        if (diff >= step) { nibble |= 4; diff -= step; }
+        if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+        if (diff >= step >> 2) { nibble |= 1; }
+        /* Track the decoder exactly so that the two never drift apart */
+        Decode(nibble);
+        return nibble;
+    }
+};
+#endif
+
+struct HostOpusEncoder {
+    int sample_rate = 0;
+    int frame_samples = 0;
+#ifdef HOST_USE_LIBOPUS
+    OpusEncoder* opus = nullptr;
+#else
+    AdpcmState adpcm;
+#endif
+};
+
+struct HostOpusDecoder {
+    int sample_rate = 0;
+    int frame_samples = 0;
+#ifdef HOST_USE_LIBOPUS
+    OpusDecoder* opus = nullptr;
+#else
+    AdpcmState adpcm;
+    int16_t last_sample = 0;
+#endif
+};
+
+esp_audio_err_t esp_opus_enc_open(void* cfg, uint32_t cfg_sz, void** enc_hd) {
+    *enc_hd = nullptr;
+    if (cfg == nullptr || cfg_sz != sizeof(esp_opus_enc_config_t)) {
+        return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    }
+    auto config = (const esp_opus_enc_config_t*)cfg;
+    int duration_us = EncFrameDurationUs(config->frame_duration);
+    if (config->channel != ESP_AUDIO_MONO || config->bits_per_sample != ESP_AUDIO_BIT16 || duration_us < 0) {
+        return ESP_AUDIO_ERR_NOT_SUPPORT;
+    }
+    auto encoder = HeapNew<HostOpusEncoder>();
+    if (encoder == nullptr) {
+        return ESP_AUDIO_ERR_MEM_LACK;
+    }
+    encoder->sample_rate = config->sample_rate;
+    encoder->frame_samples = (int)((int64_t)config->sample_rate * duration_us / 1000000);
+#ifdef HOST_USE_LIBOPUS
+    encoder->opus = (OpusEncoder*)heap_caps_malloc(opus_encoder_get_size(1), MALLOC_CAP_8BIT);
+    int application = config->application_mode == ESP_OPUS_ENC_APPLICATION_VOIP ? OPUS_APPLICATION_VOIP :
+                      config->application_mode == ESP_OPUS_ENC_APPLICATION_LOWDELAY ? OPUS_APPLICATION_RESTRICTED_LOWDELAY :
+                      OPUS_APPLICATION_AUDIO;
+    if (encoder->opus == nullptr || opus_encoder_init(encoder->opus, config->sample_rate, 1, application) != OPUS_OK) {
+        heap_caps_free(encoder->opus);
+        HeapDelete(encoder);
+        return ESP_AUDIO_ERR_FAIL;
+    }
+    opus_encoder_ctl(encoder->opus, OPUS_SET_BITRATE(config->bitrate == ESP_OPUS_BITRATE_AUTO ? OPUS_AUTO : config->bitrate));
+    opus_encoder_ctl(encoder->opus, OPUS_SET_COMPLEXITY(config->complexity));
+    opus_encoder_ctl(encoder->opus, OPUS_SET_INBAND_FEC(config->enable_fec ? 1 : 0));
+    opus_encoder_ctl(encoder->opus, OPUS_SET_DTX(config->enable_dtx ? 1 : 0));
+    opus_encoder_ctl(encoder->opus, OPUS_SET_VBR(config->enable_vbr ? 1 : 0));
+#endif
+    *enc_hd = encoder;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_get_frame_size(void* enc_hd, int* in_size, int* out_size) {
+    auto encoder = (HostOpusEncoder*)enc_hd;
+    *in_size = encoder->frame_samples * sizeof(int16_t);
+#ifdef HOST_USE_LIBOPUS
+    *out_size = HOST_OPUS_MAX_PACKET;
+#else
+    *out_size = std::max(ADPCM_HEADER_SIZE + (encoder->frame_samples + 1) / 2, HOST_OPUS_MAX_PACKET);
+#endif
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_enc_process(void* enc_hd, esp_audio_enc_in_frame_t* in_frame, esp_audio_enc_out_frame_t* out_frame) {
+    auto encoder = (HostOpusEncoder*)enc_hd;
+    if (in_frame->len < encoder->frame_samples * sizeof(int16_t)) {
+        return ESP_AUDIO_ERR_DATA_LACK;
+    }
+    auto pcm = (const int16_t*)in_frame->buffer;
+#ifdef HOST_USE_LIBOPUS
+    int bytes = opus_encode(encoder->opus, pcm, encoder->frame_samples, out_frame->buffer, out_frame->len);
+    if (bytes < 0) {
+        return bytes == OPUS_BUFFER_TOO_SMALL ? ESP_AUDIO_ERR_BUFF_NOT_ENOUGH : ESP_AUDIO_ERR_FAIL;
+    }
+    out_frame->encoded_bytes = bytes;
+#else
+    uint32_t bytes = ADPCM_HEADER_SIZE + (encoder->frame_samples + 1) / 2;
+    if (out_frame->len < bytes) {
+        return ESP_AUDIO_ERR_BUFF_NOT_ENOUGH;
+    }
+    uint8_t* out = out_frame->buffer;
+    out[0] = ADPCM_MARKER;
+    out[1] = (uint8_t)(encoder->adpcm.predictor & 0xff);
+    out[2] = (uint8_t)((encoder->adpcm.predictor >> 8) & 0xff);
+    out[3] = (uint8_t)encoder->adpcm.index;
+    memset(out + ADPCM_HEADER_SIZE, 0, bytes - ADPCM_HEADER_SIZE);
+    for (int i = 0; i < encoder->frame_samples; i++) {
+        uint8_t nibble = encoder->adpcm.Encode(pcm[i]);
+        out[ADPCM_HEADER_SIZE + i / 2] |= (i & 1) ? nibble << 4 : nibble;
+    }
+    out_frame->encoded_bytes = bytes;
+#endif
+    return ESP_AUDIO_ERR_OK;
+}
+
+void esp_opus_enc_close(void* enc_hd) {
+    auto encoder = (HostOpusEncoder*)enc_hd;
+#ifdef HOST_USE_LIBOPUS
+    if (encoder != nullptr) {
+        heap_caps_free(encoder->opus);
+    }
+#endif
+    HeapDelete(encoder);
+}
+
+esp_audio_err_t esp_opus_dec_open(void* cfg, uint32_t cfg_sz, void** dec_hd) {
+    *dec_hd = nullptr;
+    if (cfg == nullptr || cfg_sz != sizeof(esp_opus_dec_cfg_t)) {
+        return ESP_AUDIO_ERR_INVALID_PARAMETER;
+    }
+    auto config = (const esp_opus_dec_cfg_t*)cfg;
+    int duration_us = DecFrameDurationUs(config->frame_duration);
+    if (config->channel != ESP_AUDIO_MONO || duration_us < 0) {
+        return ESP_AUDIO_ERR_NOT_SUPPORT;
+    }
+    auto decoder = HeapNew<HostOpusDecoder>();
+    if (decoder == nullptr) {
+        return ESP_AUDIO_ERR_MEM_LACK;
+    }
+    decoder->sample_rate = config->sample_rate;
+    decoder->frame_samples = (int)((int64_t)config->sample_rate * duration_us / 1000000);
+#ifdef HOST_USE_LIBOPUS
+    decoder->opus = (OpusDecoder*)heap_caps_malloc(opus_decoder_get_size(1), MALLOC_CAP_8BIT);
+    if (decoder->opus == nullptr || opus_decoder_init(decoder->opus, config->sample_rate, 1) != OPUS_OK) {
+        heap_caps_free(decoder->opus);
+        HeapDelete(decoder);
+        return ESP_AUDIO_ERR_FAIL;
+    }
+#endif
+    *dec_hd = decoder;
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_decode(void* dec_hd, esp_audio_dec_in_raw_t* raw, esp_audio_dec_out_frame_t* frame,
+    esp_audio_dec_info_t* dec_info) {
+    auto decoder = (HostOpusDecoder*)dec_hd;
+    auto pcm = (int16_t*)frame->buffer;
+    int max_samples = frame->len / sizeof(int16_t);
+    bool plc = raw->frame_recover == ESP_AUDIO_DEC_RECOVERY_PLC;
+#ifdef HOST_USE_LIBOPUS
+    int samples = opus_decode(decoder->opus, plc ? nullptr : raw->buffer, plc ? 0 : raw->len, pcm,
+                              plc ? std::min(max_samples, decoder->frame_samples) : max_samples, 0);
+    if (samples < 0) {
+        return samples == OPUS_BUFFER_TOO_SMALL ? ESP_AUDIO_ERR_BUFF_NOT_ENOUGH : ESP_AUDIO_ERR_FAIL;
+    }
+#else
+    int samples;
+    if (plc) {
+        /* Hold the last sample and fade it out, a stand-in for Opus concealment */
+        samples = std::min(max_samples, decoder->frame_samples);
+        int value = decoder->last_sample;
+        for (int i = 0; i < samples; i++) {
+            value = value * 15 / 16;
+            pcm[i] = (int16_t)value;
+        }
+        decoder->last_sample = (int16_t)value;
+        decoder->adpcm.predictor = value;
+    } else {
+        if (raw->len < ADPCM_HEADER_SIZE || raw->buffer[0] != ADPCM_MARKER) {
+            return ESP_AUDIO_ERR_NOT_SUPPORT;
+        }
+        samples = (raw->len - ADPCM_HEADER_SIZE) * 2;
+        if (samples > max_samples) {
+            frame->needed_size = samples * sizeof(int16_t);
+            return ESP_AUDIO_ERR_BUFF_NOT_ENOUGH;
+        }
+        decoder->adpcm.predictor = (int16_t)(raw->buffer[1] | (raw->buffer[2] << 8));
+        decoder->adpcm.index = std::min<int>(raw->buffer[3], 88);
+        for (int i = 0; i < samples; i++) {
+            uint8_t byte = raw->buffer[ADPCM_HEADER_SIZE + i / 2];
+            pcm[i] = (int16_t)decoder->adpcm.Decode((i & 1) ? byte >> 4 : byte & 0x0f);
+        }
+        if (samples > 0) {
+            decoder->last_sample = pcm[samples - 1];
+        }
+    }
+#endif
+    raw->consumed = raw->len;
+    frame->decoded_size = samples * sizeof(int16_t);
+    if (dec_info != nullptr) {
+        dec_info->sample_rate = decoder->sample_rate;
+        dec_info->channel = ESP_AUDIO_MONO;
+        dec_info->bits_per_sample = ESP_AUDIO_BIT16;
+        dec_info->frame_size = frame->decoded_size;
+    }
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_reset(void* dec_hd) {
+    auto decoder = (HostOpusDecoder*)dec_hd;
+#ifdef HOST_USE_LIBOPUS
+    opus_decoder_ctl(decoder->opus, OPUS_RESET_STATE);
+#else
+    decoder->adpcm = AdpcmState();
+    decoder->last_sample = 0;
+#endif
+    return ESP_AUDIO_ERR_OK;
+}
+
+esp_audio_err_t esp_opus_dec_close(void* dec_hd) {
+    auto decoder = (HostOpusDecoder*)dec_hd;
+#ifdef HOST_USE_LIBOPUS
+    if (decoder != nullptr) {
+        heap_caps_free(decoder->opus);
+    }
+#endif
+    HeapDelete(decoder);
+    return ESP_AUDIO_ERR_OK;
+}
+
+/* Linear interpolation, the position is kept across calls in 1/dest_rate units of a source sample */
+struct HostRateCvt {
+    uint32_t src_rate = 0;
+    uint32_t dest_rate = 0;
+    int channels = 0;
+    uint64_t position = 0;  // Of the next output sample, relative to previous[]
+    int16_t previous[8] = {};  // Last input frame of the previous call
+};
+
+esp_ae_err_t esp_ae_rate_cvt_open(esp_ae_rate_cvt_cfg_t* cfg, esp_ae_rate_cvt_handle_t* handle) {
+    *handle = nullptr;
+    if (cfg == nullptr || cfg->src_rate == 0 || cfg->dest_rate == 0 || cfg->channel == 0 || cfg->channel > 8 ||
+        cfg->bits_per_sample != ESP_AUDIO_BIT16) {
+        return ESP_AE_ERR_INVALID_PARAMETER;
+    }
+    auto cvt = HeapNew<HostRateCvt>();
+    if (cvt == nullptr) {
+        return ESP_AE_ERR_MEM_LACK;
+    }
+    cvt->src_rate = cfg->src_rate;
+    cvt->dest_rate = cfg->dest_rate;
+    cvt->channels = cfg->channel;
+    *handle = cvt;
+    return ESP_AE_ERR_OK;
+}
+
+esp_ae_err_t esp_ae_rate_cvt_get_max_out_sample_num(esp_ae_rate_cvt_handle_t handle, uint32_t in_sample_num,
+    uint32_t* out_sample_num) {
+    auto cvt = (HostRateCvt*)handle;
+    *out_sample_num = (uint32_t)(((uint64_t)in_sample_num * cvt->dest_rate + cvt->src_rate - 1) / cvt->src_rate) + 1;
+    return ESP_AE_ERR_OK;
+}
+
+esp_ae_err_t esp_ae_rate_cvt_process(esp_ae_rate_cvt_handle_t handle, esp_ae_sample_t in_samples, uint32_t sample_num,
+    esp_ae_sample_t out_samples, uint32_t* out_sample_num) {
+    auto cvt = (HostRateCvt*)handle;
+    auto in = (const int16_t*)in_samples;
+    auto out = (int16_t*)out_samples;
+    int channels = cvt->channels;
+    uint32_t capacity = *out_sample_num;
+    uint32_t written = 0;
+    /* Input frame i is previous[] for i == 0 and in[i - 1] after that */
+    uint64_t end = (uint64_t)sample_num * cvt->dest_rate;
+    while (cvt->position < end && written < capacity) {
+        uint64_t index = cvt->position / cvt->dest_rate;
+        uint32_t fraction = cvt->position % cvt->dest_rate;
+        for (int c = 0; c < channels; c++) {
+            int a = index == 0 ? cvt->previous[c] : in[(index - 1) * channels + c];
+            int b = in[index * channels + c];
+            out[written * channels + c] = (int16_t)(a + (int64_t)(b - a) * fraction / cvt->dest_rate);
+        }
+        written++;
+        cvt->position += cvt->src_rate;
+    }
+    if (sample_num > 0) {
+        for (int c = 0; c < channels; c++) {
+            cvt->previous[c] = in[(sample_num - 1) * channels + c];
+        }
+        cvt->position = cvt->position > end ? cvt->position - end : 0;
+    }
+    *out_sample_num = written;
+    return ESP_AE_ERR_OK;
+}
+
+esp_ae_err_t esp_ae_rate_cvt_reset(esp_ae_rate_cvt_handle_t handle) {
+    auto cvt = (HostRateCvt*)handle;
+    cvt->position = 0;
+    memset(cvt->previous, 0, sizeof(cvt->previous));
+    return ESP_AE_ERR_OK;
+}
+
+void esp_ae_rate_cvt_close(esp_ae_rate_cvt_handle_t handle) {
+    HeapDelete((HostRateCvt*)handle);
+}
@@ -0,0 +1,41 @@
+/*
+ * Host stand-in for the ESP-IDF capability allocator. Every capability maps to malloc, the calls
+ * are counted and the free size is that of a fixed HOST_HEAP_SIZE heap, so heap deltas and
+ * allocation counts can be reported as on the device.
+ */
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <malloc.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+#define HOST_HEAP_SIZE (8 * 1024 * 1024)
+
+struct HostHeapStats {
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> bytes_in_use{0};
+};
+inline HostHeapStats host_heap_stats;
+
+static inline void* heap_caps_malloc(size_t size, unsigned int caps) {
+    void* ptr = malloc(size);
+    if (ptr != nullptr) {
+        host_heap_stats.allocations++;
+        host_heap_stats.bytes_in_use += malloc_usable_size(ptr);
+    }
+    return ptr;
+}
+
+static inline void heap_caps_free(void* ptr) {
+    if (ptr != nullptr) {
+        host_heap_stats.bytes_in_use -= malloc_usable_size(ptr);
+        free(ptr);
+    }
+}
+
+static inline size_t heap_caps_get_free_size(unsigned int caps) {
+    return HOST_HEAP_SIZE - host_heap_stats.bytes_in_use.load();
+}
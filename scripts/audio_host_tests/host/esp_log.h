@@ -0,0 +1,9 @@
+/* Host stand-in for ESP-IDF logging, which also pulls in sdkconfig.h as the real header does */
+#pragma once
+#include <cstdio>
+#include "sdkconfig.h"
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
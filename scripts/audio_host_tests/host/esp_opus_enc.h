@@ -0,0 +1,46 @@
+/*
+ * Host stand-in for the esp_audio_codec Opus encoder (esp_codec_host.cc). It is libopus when the
+ * host build defines HOST_USE_LIBOPUS, otherwise a 4-bit IMA ADPCM stand-in with the same framing.
+ */
+#pragma once
+#include "esp_audio_enc.h"
+
+#define ESP_OPUS_BITRATE_AUTO 0
+
+typedef enum {
+    ESP_OPUS_ENC_FRAME_DURATION_ARG = -1,
+    ESP_OPUS_ENC_FRAME_DURATION_2_5_MS = 0,
+    ESP_OPUS_ENC_FRAME_DURATION_5_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_10_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_20_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_40_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_60_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_80_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_100_MS,
+    ESP_OPUS_ENC_FRAME_DURATION_120_MS,
+} esp_opus_enc_frame_duration_t;
+
+typedef enum {
+    ESP_OPUS_ENC_APPLICATION_VOIP = 0,
+    ESP_OPUS_ENC_APPLICATION_AUDIO,
+    ESP_OPUS_ENC_APPLICATION_LOWDELAY,
+} esp_opus_enc_application_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t channel;
+    uint8_t bits_per_sample;
+    int bitrate;
+    esp_opus_enc_frame_duration_t frame_duration;
+    esp_opus_enc_application_t application_mode;
+    int complexity;
+    bool enable_fec;
+    bool enable_dtx;
+    bool enable_vbr;
+} esp_opus_enc_config_t;
+
+esp_audio_err_t esp_opus_enc_open(void* cfg, uint32_t cfg_sz, void** enc_hd);
+/* in_size and out_size are in bytes */
+esp_audio_err_t esp_opus_enc_get_frame_size(void* enc_hd, int* in_size, int* out_size);
+esp_audio_err_t esp_opus_enc_process(void* enc_hd, esp_audio_enc_in_frame_t* in_frame, esp_audio_enc_out_frame_t* out_frame);
+void esp_opus_enc_close(void* enc_hd);
@@ -0,0 +1,102 @@
+/*
+ * Host implementation of the esp-sr model list and of a wakenet stand-in, so that EspWakeWord
+ * and the wake word -> listening path run unchanged. The "wn_host_energy" model detects the
+ * first 32ms chunk louder than -26 dBFS after at least one second of quieter input.
+ */
+#include "model_path.h"
+#include "esp_wn_iface.h"
+#include "esp_wn_models.h"
+
+#include <cmath>
+#include <cstring>
+
+#define HOST_WN_MODEL_NAME "wn_host_energy"
+#define HOST_WN_WORD_NAME "host_energy"
+#define HOST_WN_SAMPLE_RATE 16000
+#define HOST_WN_CHUNK_SAMPLES 512
+#define HOST_WN_THRESHOLD_RMS 1645  // -26 dBFS
+#define HOST_WN_QUIET_CHUNKS (HOST_WN_SAMPLE_RATE / HOST_WN_CHUNK_SAMPLES)
+
+struct model_iface_data_t {
+    int quiet_chunks = 0;
+};
+
+static char model_name_storage[] = HOST_WN_MODEL_NAME;
+static char word_name_storage[] = HOST_WN_WORD_NAME;
+
+srmodel_list_t* esp_srmodel_init(const char* partition_label) {
+    auto models = new srmodel_list_t();
+    models->model_name = new char*[1]{model_name_storage};
+    models->model_info = nullptr;
+    models->model_data = nullptr;
+    models->num = 1;
+    return models;
+}
+
+void esp_srmodel_deinit(srmodel_list_t* models) {
+    if (models != nullptr) {
+        delete[] models->model_name;
+        delete models;
+    }
+}
+
+char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2) {
+    if (models == nullptr) {
+        return nullptr;
+    }
+    for (int i = 0; i < models->num; i++) {
+        char* name = models->model_name[i];
+        if ((keyword1 == nullptr || strstr(name, keyword1) != nullptr) &&
+            (keyword2 == nullptr || strstr(name, keyword2) != nullptr)) {
+            return name;
+        }
+    }
+    return nullptr;
+}
+
+static model_iface_data_t* EnergyCreate(const void* model_name, det_mode_t det_mode) {
+    return new model_iface_data_t();
+}
+
+static int EnergyGetChunkSize(model_iface_data_t* model) {
+    return HOST_WN_CHUNK_SAMPLES;
+}
+
+static int EnergyGetSampleRate(model_iface_data_t* model) {
+    return HOST_WN_SAMPLE_RATE;
+}
+
+static char* EnergyGetWordName(model_iface_data_t* model, int word_index) {
+    return word_name_storage;
+}
+
+static wakenet_state_t EnergyDetect(model_iface_data_t* model, int16_t* samples) {
+    double energy = 0;
+    for (int i = 0; i < HOST_WN_CHUNK_SAMPLES; i++) {
+        energy += (double)samples[i] * samples[i];
+    }
+    if (sqrt(energy / HOST_WN_CHUNK_SAMPLES) < HOST_WN_THRESHOLD_RMS) {
+        model->quiet_chunks++;
+        return WAKENET_NO_DETECT;
+    }
+    bool detected = model->quiet_chunks >= HOST_WN_QUIET_CHUNKS;
+    model->quiet_chunks = 0;
+    return detected ? WAKENET_DETECTED : WAKENET_NO_DETECT;
+}
+
+static void EnergyDestroy(model_iface_data_t* model) {
+    delete model;
+}
+
+static const esp_wn_iface_t energy_wakenet = {
+    .create = EnergyCreate,
+    .get_samp_chunksize = EnergyGetChunkSize,
+    .get_samp_rate = EnergyGetSampleRate,
+    .get_word_name = EnergyGetWordName,
+    .detect = EnergyDetect,
+    .destroy = EnergyDestroy,
+};
+
+const esp_wn_iface_t* esp_wn_handle_from_name(const char* model_name) {
+    return strcmp(model_name, HOST_WN_MODEL_NAME) == 0 ? &energy_wakenet : nullptr;
+}
@@ -0,0 +1,25 @@
+/* Host stand-in for the esp-sr wakenet interface */
+#pragma once
+#include <cstdint>
+
+typedef struct model_iface_data_t model_iface_data_t;
+
+typedef enum {
+    DET_MODE_90 = 0,
+    DET_MODE_95 = 1,
+} det_mode_t;
+
+typedef enum {
+    WAKENET_NO_DETECT = 0,
+    WAKENET_CHANNEL_VERIFIED = -1,
+    WAKENET_DETECTED = 1,
+} wakenet_state_t;
+
+typedef struct {
+    model_iface_data_t* (*create)(const void* model_name, det_mode_t det_mode);
+    int (*get_samp_chunksize)(model_iface_data_t* model);
+    int (*get_samp_rate)(model_iface_data_t* model);
+    char* (*get_word_name)(model_iface_data_t* model, int word_index);
+    wakenet_state_t (*detect)(model_iface_data_t* model, int16_t* samples);
+    void (*destroy)(model_iface_data_t* model);
+} esp_wn_iface_t;
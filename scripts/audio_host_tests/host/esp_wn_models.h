@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for the esp-sr wakenet models (esp_sr_host.cc). The only model detects the first
+ * chunk louder than -26 dBFS after a second of quieter input, as if that were the wake word.
+ */
+#pragma once
+#include "esp_wn_iface.h"
+
+#define ESP_WN_PREFIX "wn"
+#define ESP_MN_PREFIX "mn"
+
+const esp_wn_iface_t* esp_wn_handle_from_name(const char* model_name);
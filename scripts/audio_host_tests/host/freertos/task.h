@@ -0,0 +1,37 @@
+/*
+ * Host stand-in for FreeRTOS tasks (host_runtime.cc). Every task is a thread, stack size,
+ * priority and core are recorded but not applied. Only vTaskDelete(NULL) at the end of the task
+ * function is supported, which is how the firmware ends its tasks.
+ */
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct { void* reserved; } StaticTask_t;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    UBaseType_t uxCurrentPriority;
+    uint32_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t entry, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buffer, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+/* The high-water mark is reported as the whole stack, the host cannot measure it */
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* tasks, UBaseType_t count, uint32_t* total_run_time);
+
+/* Host only: blocks until the functions of all created tasks have returned */
+void host_wait_for_tasks(void);
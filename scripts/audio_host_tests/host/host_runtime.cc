@@ -0,0 +1,360 @@
+/*
+ * Host implementation of the FreeRTOS and esp_timer calls the audio modules make, on std::thread.
+ *
+ * Task handles stay valid after their task has returned, as a handle kept by the firmware may
+ * still be notified while the service stops. Blocking calls made from threads that were not
+ * created here (the main thread) work the same as from tasks.
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HostTask {
+    std::string name;
+    UBaseType_t priority = 0;
+    BaseType_t core = tskNO_AFFINITY;
+    uint32_t stack_size = 0;
+    StackType_t* static_stack = nullptr;
+    StaticTask_t* static_buffer = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+};
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool given = false;
+};
+
+namespace {
+
+std::mutex tasks_mutex;
+std::condition_variable tasks_cv;
+/* Never destroyed, so that the static stacks of tasks stay reachable at exit */
+std::vector<std::unique_ptr<HostTask>>& tasks = *new std::vector<std::unique_ptr<HostTask>>();
+int running_tasks = 0;
+thread_local HostTask* current_task = nullptr;
+
+std::chrono::steady_clock::time_point Deadline(TickType_t ticks) {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+}
+
+HostTask* NewTask(const char* name, uint32_t stack_size, UBaseType_t priority, BaseType_t core) {
+    auto task = std::make_unique<HostTask>();
+    task->name = name != nullptr ? name : "";
+    task->stack_size = stack_size;
+    task->priority = priority;
+    task->core = core;
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks.push_back(std::move(task));
+    return tasks.back().get();
+}
+
+void StartTask(HostTask* task, TaskFunction_t entry, void* arg) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        running_tasks++;
+    }
+    std::thread([task, entry, arg]() {
+        current_task = task;
+        entry(arg);
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        running_tasks--;
+        tasks_cv.notify_all();
+    }).detach();
+}
+
+/* Threads that were not created by xTaskCreate get a handle on first use */
+HostTask* CurrentTask() {
+    if (current_task == nullptr) {
+        current_task = NewTask("host", 0, 0, tskNO_AFFINITY);
+    }
+    return current_task;
+}
+
+}  // namespace
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    HostTask* task = NewTask(name, stack_size, priority, core);
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    StartTask(task, entry, arg);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t entry, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buffer, BaseType_t core) {
+    HostTask* task = NewTask(name, stack_size, priority, core);
+    task->static_stack = stack;
+    task->static_buffer = task_buffer;
+    StartTask(task, entry, arg);
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != nullptr && task != current_task) {
+        fprintf(stderr, "vTaskDelete() of another task is not supported on the host\n");
+        abort();
+    }
+    /* The task function returns right after this call, which ends the thread */
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return CurrentTask();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    HostTask* task = CurrentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task]() { return task->notifications > 0; };
+    if (ticks == portMAX_DELAY) {
+        task->cv.wait(lock, ready);
+    } else {
+        task->cv.wait_until(lock, Deadline(ticks), ready);
+    }
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    return tasks.size();
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t count, uint32_t* total_run_time) {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    UBaseType_t n = 0;
+    for (auto& task : tasks) {
+        if (n == count) {
+            break;
+        }
+        status[n] = {task.get(), task->name.c_str(), n + 1, task->priority, task->stack_size, task->core};
+        n++;
+    }
+    if (total_run_time != nullptr) {
+        *total_run_time = 0;
+    }
+    return n;
+}
+
+void host_wait_for_tasks(void) {
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    tasks_cv.wait(lock, []() { return running_tasks == 0; });
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [group, bits, wait_for_all]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool satisfied;
+    if (ticks == portMAX_DELAY) {
+        group->cv.wait(lock, ready);
+        satisfied = true;
+    } else {
+        satisfied = group->cv.wait_until(lock, Deadline(ticks), ready);
+    }
+    /* Like FreeRTOS, returns the bits as they were when the wait ended */
+    EventBits_t value = group->bits;
+    if (satisfied && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return new HostSemaphore();
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->given) {
+        return pdFAIL;
+    }
+    semaphore->given = true;
+    semaphore->cv.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    auto ready = [semaphore]() { return semaphore->given; };
+    if (ticks == portMAX_DELAY) {
+        semaphore->cv.wait(lock, ready);
+    } else if (!semaphore->cv.wait_until(lock, Deadline(ticks), ready)) {
+        return pdFAIL;
+    }
+    semaphore->given = false;
+    return pdPASS;
+}
+
+struct HostTimer {
+    esp_timer_create_args_t args;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+    std::thread::id thread_id;
+    bool armed = false;
+    bool periodic = false;
+    bool in_callback = false;
+    bool deleted = false;
+    uint64_t period_us = 0;
+    std::chrono::steady_clock::time_point next;
+    uint32_t generation = 0;  // Bumped by every start and stop, so a stale expiry is not run
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!deleted) {
+            if (!armed) {
+                cv.wait(lock);
+                continue;
+            }
+            uint32_t armed_generation = generation;
+            if (cv.wait_until(lock, next) != std::cv_status::timeout || generation != armed_generation || !armed) {
+                continue;
+            }
+            if (periodic) {
+                next += std::chrono::microseconds(period_us);
+                /* skip_unhandled_events: a late callback does not run the missed periods */
+                auto now = std::chrono::steady_clock::now();
+                if (next < now) {
+                    next = now + std::chrono::microseconds(period_us);
+                }
+            } else {
+                armed = false;
+            }
+            in_callback = true;
+            lock.unlock();
+            args.callback(args.arg);
+            lock.lock();
+            in_callback = false;
+            cv.notify_all();
+        }
+    }
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    auto timer = new HostTimer();
+    timer->args = *args;
+    timer->thread = std::thread([timer]() { timer->Run(); });
+    timer->thread_id = timer->thread.get_id();
+    *handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t StartTimer(esp_timer_handle_t timer, uint64_t us, bool periodic) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->periodic = periodic;
+    timer->period_us = us;
+    timer->next = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    timer->generation++;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return StartTimer(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return StartTimer(timer, period_us, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    bool was_armed = timer->armed;
+    timer->armed = false;
+    timer->generation++;
+    timer->cv.notify_all();
+    /* Once stopped, the callback no longer touches its argument, unless the callback stops itself */
+    if (std::this_thread::get_id() != timer->thread_id) {
+        timer->cv.wait(lock, [timer]() { return !timer->in_callback; });
+    }
+    return was_armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->deleted = true;
+        timer->armed = false;
+        timer->cv.notify_all();
+    }
+    timer->thread.join();
+    delete timer;
+    return ESP_OK;
+}
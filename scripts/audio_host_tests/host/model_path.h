@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for the esp-sr model list (esp_sr_host.cc). esp_srmodel_init() returns a list
+ * with the host energy wake word model only.
+ */
+#pragma once
+
+typedef struct srmodel_list_t {
+    char** model_name;
+    char** model_info;
+    void* model_data;
+    int num;
+} srmodel_list_t;
+
+srmodel_list_t* esp_srmodel_init(const char* partition_label);
+void esp_srmodel_deinit(srmodel_list_t* models);
+char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2);
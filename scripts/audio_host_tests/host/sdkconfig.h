@@ -0,0 +1,16 @@
+/* Kconfig defaults of the options used by the modules under test, as on a board with PSRAM */
+#pragma once
+
+#define CONFIG_SPIRAM 1
+#define CONFIG_AUDIO_FRAME_POOL_IN_PSRAM 1
+#define CONFIG_AUDIO_FRAME_POOL_PACKET_BLOCKS 96
+#define CONFIG_AUDIO_FRAME_POOL_PCM_BLOCKS 8
+#define CONFIG_AUDIO_MIXER_DUCK_PERCENT 20
+#define CONFIG_AUDIO_OUTPUT_EQ_HIGHPASS_HZ 0
+#define CONFIG_AUDIO_OUTPUT_EQ_LOW_SHELF_HZ 0
+#define CONFIG_AUDIO_OUTPUT_EQ_PEAK_HZ 0
+#define CONFIG_AUDIO_OUTPUT_LIMITER 1
+#define CONFIG_AUDIO_OUTPUT_LIMITER_DBFS -1
+#define CONFIG_AUDIO_PREROLL_MS 3000
+#define CONFIG_TASK_LAYOUT_LEGACY 1
+#define CONFIG_TASK_TOPOLOGY_OVERRIDES ""
@@ -0,0 +1,31 @@
+/* Host stand-in for the NVS backed settings, kept in memory for the life of the process */
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) : ns_(ns) {}
+
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) {
+        auto it = Store().find(ns_ + "." + key);
+        return it == Store().end() ? default_value : std::stoi(it->second);
+    }
+    void SetInt(const std::string& key, int32_t value) { Store()[ns_ + "." + key] = std::to_string(value); }
+    bool GetBool(const std::string& key, bool default_value = false) { return GetInt(key, default_value) != 0; }
+    void SetBool(const std::string& key, bool value) { SetInt(key, value); }
+    std::string GetString(const std::string& key, const std::string& default_value = "") {
+        auto it = Store().find(ns_ + "." + key);
+        return it == Store().end() ? default_value : it->second;
+    }
+    void SetString(const std::string& key, const std::string& value) { Store()[ns_ + "." + key] = value; }
+
+private:
+    std::string ns_;
+
+    static std::map<std::string, std::string>& Store() {
+        static std::map<std::string, std::string> store;
+        return store;
+    }
+};
@@ -0,0 +1,247 @@
+/*
+ * Host run of AudioProcessorHarness (main/audio/audio_processor_harness.cc) against a stand-in
+ * processor, so harness changes can be checked without a device.
+ *
+ * EnergyVadProcessor mimics the parts of AfeAudioProcessor the harness measures: a fetch thread
+ * outputs the first microphone channel in 512 sample frames, and an energy VAD with minimum
+ * speech and noise durations reports speech. Without arguments a synthetic recording is used
+ * (silence, two seconds of a speech band signal, silence); a WAV file with speech labels can be
+ * given instead. A second run is interrupted through the abort flag, as EnableVoiceProcessing()
+ * does on the device.
+ */
+#include "audio_processor_harness.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FETCH_SAMPLES 512
+#define VAD_THRESHOLD_RMS 300
+#define VAD_MIN_SPEECH_FRAMES 3  // 96ms
+#define VAD_MIN_NOISE_FRAMES 4   // 128ms, vad_min_noise_ms of the AFE rounded up to frames
+
+class EnergyVadProcessor : public AudioProcessor {
+public:
+    EnergyVadProcessor(int channels, int processing_us) : channels_(channels), processing_us_(processing_us) {}
+    ~EnergyVadProcessor() override { Stop(); }
+
+    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override {}
+
+    void Feed(AudioPcm&& data) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < data.size(); i += channels_) {
+            input_.push_back(data[i]);
+        }
+        cv_.notify_one();
+    }
+
+    void Start() override {
+        if (running_) {
+            return;
+        }
+        running_ = true;
+        speaking_ = false;
+        run_frames_ = 0;
+        thread_ = std::thread(&EnergyVadProcessor::FetchTask, this);
+    }
+
+    void Stop() override {
+        if (!running_) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+            input_.clear();
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    bool IsRunning() override { return running_; }
+    void OnOutput(std::function<void(AudioPcm&& data)> callback) override { on_output_ = callback; }
+    void OnVadStateChange(std::function<void(bool speaking)> callback) override { on_vad_state_change_ = callback; }
+    size_t GetFeedSize() override { return FETCH_SAMPLES; }
+    void EnableDeviceAec(bool enable) override {}
+
+private:
+    int channels_;
+    int processing_us_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<int16_t> input_;
+    std::function<void(AudioPcm&& data)> on_output_;
+    std::function<void(bool speaking)> on_vad_state_change_;
+    bool speaking_ = false;
+    int run_frames_ = 0;  // Consecutive frames disagreeing with the current state
+
+    void FetchTask() {
+        while (true) {
+            AudioPcm frame(FETCH_SAMPLES);
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return !running_ || input_.size() >= FETCH_SAMPLES; });
+                if (!running_) {
+                    return;
+                }
+                std::copy(input_.begin(), input_.begin() + FETCH_SAMPLES, frame.begin());
+                input_.erase(input_.begin(), input_.begin() + FETCH_SAMPLES);
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(processing_us_));
+
+            double sum = 0;
+            for (auto sample : frame) {
+                sum += (double)sample * sample;
+            }
+            bool voice = sqrt(sum / FETCH_SAMPLES) > VAD_THRESHOLD_RMS;
+            if (voice != speaking_) {
+                run_frames_++;
+                if (run_frames_ >= (speaking_ ? VAD_MIN_NOISE_FRAMES : VAD_MIN_SPEECH_FRAMES)) {
+                    speaking_ = voice;
+                    run_frames_ = 0;
+                    if (on_vad_state_change_) {
+                        on_vad_state_change_(speaking_);
+                    }
+                }
+            } else {
+                run_frames_ = 0;
+            }
+            if (on_output_) {
+                on_output_(std::move(frame));
+            }
+        }
+    }
+};
+
+static void Append16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void Append32(std::vector<uint8_t>& out, uint32_t value) {
+    Append16(out, value & 0xffff);
+    Append16(out, value >> 16);
+}
+
+/* 16kHz WAV with a microphone and a silent reference channel: quiet noise, speech band tones, quiet noise */
+static std::vector<uint8_t> MakeRecording(int silence_ms, int speech_ms, int tail_ms) {
+    const int channels = 2;
+    size_t frames = (size_t)(silence_ms + speech_ms + tail_ms) * 16;
+    std::vector<uint8_t> wav;
+    wav.insert(wav.end(), {'R', 'I', 'F', 'F'});
+    Append32(wav, (uint32_t)(36 + frames * channels * 2));
+    wav.insert(wav.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    Append32(wav, 16);
+    Append16(wav, 1);
+    Append16(wav, channels);
+    Append32(wav, 16000);
+    Append32(wav, 16000 * channels * 2);
+    Append16(wav, channels * 2);
+    Append16(wav, 16);
+    wav.insert(wav.end(), {'d', 'a', 't', 'a'});
+    Append32(wav, (uint32_t)(frames * channels * 2));
+
+    uint32_t seed = 1;
+    for (size_t i = 0; i < frames; i++) {
+        seed = seed * 1664525 + 1013904223;
+        double sample = (int)(seed >> 24) - 128;  // About -50 dBFS of noise
+        size_t ms = i / 16;
+        if (ms >= (size_t)silence_ms && ms < (size_t)(silence_ms + speech_ms)) {
+            double t = i / 16000.0;
+            double envelope = 0.75 + 0.25 * sin(2 * M_PI * 4 * t);  // Syllable rate, never silent
+            sample += envelope * (3000 * sin(2 * M_PI * 300 * t) + 2000 * sin(2 * M_PI * 1200 * t) +
+                                  1000 * sin(2 * M_PI * 2500 * t));
+        }
+        Append16(wav, (uint16_t)(int16_t)sample);
+        Append16(wav, 0);
+    }
+    return wav;
+}
+
+static double JsonNumber(const std::string& json, const char* key) {
+    auto position = json.find("\"" + std::string(key) + "\":");
+    return position == std::string::npos ? NAN : atof(json.c_str() + position + strlen(key) + 3);
+}
+
+int main(int argc, char** argv) {
+    std::vector<uint8_t> wav;
+    int speech_start_ms = 1000;
+    int speech_end_ms = 3000;
+    if (argc >= 4) {
+        std::ifstream file(argv[1], std::ios::binary);
+        wav.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        speech_start_ms = atoi(argv[2]);
+        speech_end_ms = atoi(argv[3]);
+    } else if (argc > 1) {
+        fprintf(stderr, "Usage: %s [recording.wav speech_start_ms speech_end_ms]\n", argv[0]);
+        return 1;
+    } else {
+        wav = MakeRecording(speech_start_ms, speech_end_ms - speech_start_ms, 1500);
+    }
+
+    int channels = 0;
+    int sample_rate = 0;
+    const int16_t* pcm = nullptr;
+    size_t frames = 0;
+    if (!AudioProcessorHarness::ParseWav(wav.data(), wav.size(), channels, sample_rate, pcm, frames) || sample_rate != 16000) {
+        fprintf(stderr, "Expected a 16kHz 16-bit PCM WAV file\n");
+        return 1;
+    }
+
+    bool ok = true;
+    {
+        EnergyVadProcessor processor(channels, 2000);
+        AudioProcessorHarness harness(channels, speech_start_ms, speech_end_ms);
+        bool run_ok = harness.Run(processor, pcm, frames);
+        auto json = harness.GetResultJson();
+        printf("%s\n", json.c_str());
+        if (!run_ok) {
+            fprintf(stderr, "Harness run failed\n");
+            ok = false;
+        } else if (argc == 1) {
+            /* The synthetic recording has one utterance the stand-in VAD finds with known delays */
+            double onset_latency = JsonNumber(json, "onset_latency_ms");
+            double offset_latency = JsonNumber(json, "offset_latency_ms");
+            double segments = JsonNumber(json, "segments");
+            printf("onset latency %.0f ms, offset latency %.0f ms, %.0f segment(s)\n", onset_latency, offset_latency, segments);
+            if (!(onset_latency >= 0 && onset_latency <= 200 && offset_latency >= 0 && offset_latency <= 300 && segments == 1)) {
+                fprintf(stderr, "Unexpected VAD results\n");
+                ok = false;
+            }
+        }
+    }
+
+    {
+        /* Listening interrupts the harness, which must give the processor back within a chunk or two */
+        EnergyVadProcessor processor(channels, 2000);
+        AudioProcessorHarness harness(channels, speech_start_ms, speech_end_ms);
+        std::atomic<bool> abort{false};
+        std::thread interrupter([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            abort = true;
+        });
+        auto start = std::chrono::steady_clock::now();
+        bool run_ok = harness.Run(processor, pcm, frames, &abort);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        interrupter.join();
+        printf("interrupted run: %s after %lld ms\n", harness.interrupted() ? "stopped" : "not stopped", (long long)elapsed);
+        if (run_ok || !harness.interrupted() || elapsed > 300 || processor.IsRunning()) {
+            fprintf(stderr, "Harness did not stop on abort\n");
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
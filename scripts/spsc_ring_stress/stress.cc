@@ -0,0 +1,230 @@
+/*
+ * Host stress test of SpscRing (main/audio/spsc_ring.h) with the wakeup scheme AudioService
+ * uses: the consumer sleeps on a task-notification stand-in when the ring is empty and is only
+ * notified on the empty->non-empty transition, the producer sleeps when the ring is full and is
+ * only notified on the full->non-full transition.
+ *
+ * Checks that every item arrives exactly once and in order, that no wakeup is lost (a lost one
+ * hangs the test, which is caught by a watchdog), and that a Clear() from a third thread only
+ * drops items without reordering or duplicating any. A single-threaded pass checks the exact
+ * was_empty / was_full transitions first. Prints the number of wakeups against the
+ * number of items, the previous mutex queue notified on every push.
+ */
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/* Binary semaphore with the semantics of xTaskNotifyGive / ulTaskNotifyTake(pdTRUE) */
+class Notification {
+public:
+    void Give() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+        gives_++;
+        cv_.notify_one();
+    }
+
+    void Take() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return pending_; });
+        pending_ = false;
+        takes_++;
+    }
+
+    size_t gives() const { return gives_; }
+    size_t takes() const { return takes_; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool pending_ = false;
+    size_t gives_ = 0;
+    size_t takes_ = 0;
+};
+
+struct Result {
+    bool ok = true;
+    size_t received = 0;
+    size_t consumer_wakeups = 0;
+    size_t producer_wakeups = 0;
+};
+
+/* Items are heap objects, so a slot that is moved from twice or never freed shows up as a crash or in the count */
+static std::atomic<long> live_items{0};
+
+struct Item {
+    explicit Item(uint32_t value) : value(value) { live_items++; }
+    ~Item() { live_items--; }
+    uint32_t value;
+};
+
+#define EXPECT(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "Transition check failed at line %d: %s\n", __LINE__, #condition); \
+            ok = false; \
+        } \
+    } while (0)
+
+/* Single-threaded, so the reported transitions are exact */
+static bool CheckTransitions() {
+    bool ok = true;
+    SpscRing<int> ring(3);
+    bool was_empty = false;
+    bool was_full = false;
+    int item = 0;
+
+    EXPECT(ring.Push(1, &was_empty) && was_empty);
+    EXPECT(ring.Push(2, &was_empty) && !was_empty);
+    EXPECT(ring.Push(3, &was_empty) && !was_empty);
+    EXPECT(ring.Full() && !ring.Push(4, &was_empty));
+    EXPECT(ring.Pop(item, &was_full) && item == 1 && was_full);
+    EXPECT(ring.Pop(item, &was_full) && item == 2 && !was_full);
+    EXPECT(ring.Pop(item, &was_full) && item == 3 && !was_full);
+    EXPECT(!ring.Pop(item, &was_full) && !was_full);
+
+    /* Flushed items are dropped by the consumer, a push after Clear() sees an empty ring */
+    EXPECT(ring.Push(5, &was_empty) && was_empty);
+    EXPECT(ring.Push(6, &was_empty) && !was_empty);
+    EXPECT(ring.Push(7, &was_empty) && !was_empty);
+    ring.Clear();
+    EXPECT(ring.Empty() && ring.Full() && ring.HasFlushed());
+    /* Dropping the flushed slots of a full ring frees space, the producer must be woken */
+    EXPECT(!ring.Pop(item, &was_full) && was_full);
+    EXPECT(!ring.Full() && !ring.HasFlushed());
+    EXPECT(ring.Push(8, &was_empty) && was_empty);
+    EXPECT(ring.Pop(item, &was_full) && item == 8 && !was_full);
+    return ok;
+}
+
+static Result Run(size_t capacity, uint32_t count, bool bursty, bool clear) {
+    SpscRing<std::unique_ptr<Item>> ring(capacity);
+    Notification consumer_notify;
+    Notification producer_notify;
+    std::atomic<bool> producer_done{false};
+    std::atomic<bool> consumer_done{false};
+    std::atomic<size_t> received{0};
+    Result result;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 1; i <= count; i++) {
+            auto item = std::make_unique<Item>(i);
+            while (true) {
+                bool was_empty = false;
+                if (ring.Push(std::move(item), &was_empty)) {
+                    if (was_empty) {
+                        consumer_notify.Give();
+                    }
+                    break;
+                }
+                producer_notify.Take();
+            }
+            if (bursty && i % 64 == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        producer_done = true;
+        consumer_notify.Give();
+    });
+
+    std::thread consumer([&]() {
+        uint32_t last = 0;
+        while (true) {
+            std::unique_ptr<Item> item;
+            bool was_full = false;
+            bool popped = ring.Pop(item, &was_full);
+            if (was_full) {
+                producer_notify.Give();
+            }
+            if (!popped) {
+                if (producer_done && ring.Empty()) {
+                    break;
+                }
+                consumer_notify.Take();
+                continue;
+            }
+            uint32_t value = item->value;
+            /* With Clear() items may be skipped, never repeated or reordered */
+            if (clear ? value <= last : value != last + 1) {
+                fprintf(stderr, "Out of order: got %u after %u\n", value, last);
+                result.ok = false;
+            }
+            last = value;
+            received.fetch_add(1, std::memory_order_relaxed);
+        }
+        consumer_done = true;
+    });
+
+    std::thread clearer;
+    if (clear) {
+        clearer = std::thread([&]() {
+            while (!producer_done) {
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                ring.Clear();
+            }
+        });
+    }
+
+    /* A lost wakeup leaves both threads asleep */
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    while (!consumer_done && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!consumer_done) {
+        fprintf(stderr, "Stalled: %zu received, ring size %zu, a wakeup was lost\n", received.load(), ring.Size());
+        std::exit(1);
+    }
+    producer.join();
+    consumer.join();
+    result.received = received.load();
+    if (clearer.joinable()) {
+        clearer.join();
+    }
+
+    if (!clear && result.received != count) {
+        fprintf(stderr, "Lost items: %zu of %u received\n", result.received, count);
+        result.ok = false;
+    }
+    result.consumer_wakeups = consumer_notify.takes();
+    result.producer_wakeups = producer_notify.takes();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    uint32_t count = argc > 1 ? (uint32_t)atoi(argv[1]) : 500000;
+    struct Case {
+        const char* name;
+        size_t capacity;
+        bool bursty;
+        bool clear;
+    } cases[] = {
+        { "capacity 1", 1, false, false },
+        { "capacity 3 (not a power of two)", 3, false, false },
+        { "capacity 40, streaming", 40, false, false },
+        { "capacity 40, bursts", 40, true, false },
+        { "capacity 40, Clear() from a third thread", 40, false, true },
+    };
+
+    bool ok = CheckTransitions();
+    printf("%-42s %s\n", "was_empty / was_full transitions", ok ? "ok" : "FAILED");
+    for (auto& c : cases) {
+        uint32_t n = c.bursty ? count / 20 : count;
+        auto result = Run(c.capacity, n, c.bursty, c.clear);
+        printf("%-42s %s: %zu/%u received, consumer wakeups %zu (%.3f per item), producer wakeups %zu\n",
+               c.name, result.ok ? "ok" : "FAILED", result.received, n, result.consumer_wakeups,
+               (double)result.consumer_wakeups / n, result.producer_wakeups);
+        ok = ok && result.ok;
+    }
+    if (live_items != 0) {
+        fprintf(stderr, "%ld items leaked\n", live_items.load());
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+/* Host stand-in for the ESP-IDF random number generator */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+inline uint32_t esp_random() {
+    static std::random_device device;
+    return device();
+}
+
+inline void esp_fill_random(void* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        ((uint8_t*)buffer)[i] = (uint8_t)esp_random();
+    }
+}
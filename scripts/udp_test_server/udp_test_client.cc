@@ -0,0 +1,157 @@
+/*
+ * Host client of the UDP transport, built from the firmware's UdpSession: it runs the exchange
+ * of one conversation against udp_test_server.py (or a real server) and prints what came back.
+ *
+ * listen start, a 3 KB MCP message that is split into fragments, audio frames for the given
+ * duration, listen stop, then it waits for the server to finish speaking. --loss drops that
+ * share of datagrams on the client side in both directions, on top of the loss of the server.
+ */
+#include "udp_session.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+#define FRAME_DURATION_MS 60
+
+static std::string DecodeHex(const std::string& hex) {
+    std::string bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        bytes.push_back((char)std::stoi(hex.substr(i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+int main(int argc, char** argv) {
+    std::string host = "127.0.0.1";
+    std::string port = "8884";
+    std::string key;
+    double loss = 0;
+    int seconds = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--host") host = argv[i + 1];
+        else if (option == "--port") port = argv[i + 1];
+        else if (option == "--key") key = DecodeHex(argv[i + 1]);
+        else if (option == "--loss") loss = atof(argv[i + 1]);
+        else if (option == "--seconds") seconds = atoi(argv[i + 1]);
+    }
+    if (key.size() != 16) {
+        fprintf(stderr, "Usage: %s --key <32 hex digits> [--host 127.0.0.1] [--port 8884] [--loss 0.1] [--seconds 3]\n", argv[0]);
+        return 1;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0) {
+        fprintf(stderr, "Failed to resolve %s\n", host.c_str());
+        return 1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    connect(fd, address->ai_addr, address->ai_addrlen);
+    freeaddrinfo(address);
+    timeval timeout = {0, 20000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::mt19937 random(std::random_device{}());
+    std::uniform_real_distribution<double> uniform(0, 1);
+    auto dropped = [&]() { return uniform(random) < loss; };
+
+    UdpSession session([&](const std::string& datagram) {
+        return dropped() || send(fd, datagram.data(), datagram.size(), 0) == (ssize_t)datagram.size();
+    });
+    std::atomic<int> audio_frames{0};
+    std::atomic<bool> speaking_done{false};
+    session.OnAudio([&](uint32_t sequence, uint32_t timestamp, const uint8_t* data, size_t size) {
+        audio_frames++;
+    });
+    session.OnMessage([&](UdpStream stream, const std::string& message) {
+        printf("<< [%d] %s\n", stream, message.c_str());
+        if (message.find("\"tts\"") != std::string::npos && message.find("\"stop\"") != std::string::npos) {
+            speaking_done = true;
+        }
+    });
+    session.OnReport([](const UdpLinkReport& report) {
+        printf("<< report: rtt %dms, loss %d%%, jitter %dms\n", report.rtt_ms, report.loss_percent, report.jitter_ms);
+    });
+    session.OnClose([&]() {
+        printf("<< close\n");
+        speaking_done = true;
+    });
+
+    auto hello = session.Hello(key, "{\"type\":\"hello\",\"version\":1,\"transport\":\"udp\",\"audio_params\":"
+        "{\"format\":\"opus\",\"sample_rate\":16000,\"channels\":1,\"frame_duration\":60}}");
+    char buffer[2048];
+    std::string server_hello;
+    for (int attempt = 0; attempt < 20 && !session.established(); attempt++) {
+        if (!dropped()) {
+            send(fd, hello.data(), hello.size(), 0);
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (!session.established() && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500)) {
+            ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+            if (size > 0 && !dropped()) {
+                session.Accept(std::string(buffer, size), server_hello);
+            }
+        }
+    }
+    if (!session.established()) {
+        fprintf(stderr, "No server hello\n");
+        return 1;
+    }
+    printf("Connected, connection id %08x: %s\n", session.connection_id(), server_hello.c_str());
+
+    std::atomic<bool> running{true};
+    std::thread receiver([&]() {
+        char data[2048];
+        while (running) {
+            ssize_t size = recv(fd, data, sizeof(data), 0);
+            if (size > 0 && !dropped()) {
+                session.Receive(std::string(data, size));
+            }
+        }
+    });
+
+    bool failed = false;
+    auto poll = [&]() {
+        if (!session.Poll()) {
+            fprintf(stderr, "A message was not acknowledged\n");
+            failed = true;
+        }
+        return !failed;
+    };
+
+    session.SendMessage(kUdpStreamControl, "{\"type\":\"listen\",\"state\":\"start\",\"mode\":\"manual\"}");
+    session.SendMessage(kUdpStreamMcp, "{\"type\":\"mcp\",\"payload\":{\"padding\":\"" + std::string(3000, 'x') + "\"}}");
+    uint8_t frame[120];
+    memset(frame, 0x55, sizeof(frame));
+    int frames = seconds * 1000 / FRAME_DURATION_MS;
+    for (int i = 0; i < frames && poll(); i++) {
+        session.SendAudio(i * FRAME_DURATION_MS, frame, sizeof(frame));
+        std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_DURATION_MS));
+    }
+    session.SendMessage(kUdpStreamControl, "{\"type\":\"listen\",\"state\":\"stop\"}");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds + 10);
+    while (!speaking_done && std::chrono::steady_clock::now() < deadline && poll()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    printf("Sent %d audio frames, received %d, rtt %dms\n", frames, audio_frames.load(), session.rtt_ms());
+    session.SendClose();
+    running = false;
+    receiver.join();
+    close(fd);
+    return failed || !speaking_done ? 1 : 0;
+}
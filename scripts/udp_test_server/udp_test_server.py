@@ -0,0 +1,340 @@
+import argparse
+import hashlib
+import hmac
+import json
+import os
+import random
+import socket
+import struct
+import time
+
+from cryptography.hazmat.primitives.ciphers.aead import AESGCM
+
+
+'''
+  Local stand-in for the UDP transport server (docs/udp.md), to test a device without the cloud.
+
+  Completes the handshake, acknowledges and retransmits the reliable streams, sends receiver
+  reports of the device audio, and plays the audio of every listen session back as TTS once
+  the device stops listening. --loss drops that share of datagrams in both directions.
+'''
+HEADER = struct.Struct('!BBHII')
+TAG_SIZE = 16
+NONCE_SIZE = 12
+FLAG_SERVER = 0x01
+KEY_LABEL = b'xiaozhi-udp'
+
+PACKET_HELLO = 1
+PACKET_HELLO_ACK = 2
+PACKET_DATA = 3
+
+FRAME_AUDIO = 1
+FRAME_STREAM = 2
+FRAME_ACK = 3
+FRAME_REPORT = 4
+FRAME_PING = 5
+FRAME_CLOSE = 6
+
+STREAM_CONTROL = 0
+STREAM_MCP = 1
+
+MAX_FRAGMENT = 1100
+RTO = 0.3
+REPORT_INTERVAL = 1.0
+FRAME_DURATION_MS = 60
+
+
+def seal(aead, packet_type, flags, connection_id, packet_number, plaintext):
+    # Handshake packets are sealed with the long-lived key and carry a random nonce in the clear
+    nonce = os.urandom(NONCE_SIZE) if packet_type != PACKET_DATA else b''
+    header = HEADER.pack(packet_type, flags, len(nonce) + len(plaintext) + TAG_SIZE, connection_id, packet_number)
+    if nonce:
+        iv = nonce
+    else:
+        iv = bytes([flags & FLAG_SERVER, 0, 0, 0]) + struct.pack('!II', connection_id, packet_number)
+    return header + nonce + aead.encrypt(iv, plaintext, header + nonce)
+
+
+def open_packet(aead, datagram):
+    if len(datagram) < HEADER.size + TAG_SIZE:
+        return None
+    header = datagram[:HEADER.size]
+    packet_type, flags, length, connection_id, packet_number = HEADER.unpack(header)
+    if length != len(datagram) - HEADER.size or flags & FLAG_SERVER:
+        return None
+    nonce_size = NONCE_SIZE if packet_type != PACKET_DATA else 0
+    if len(datagram) < HEADER.size + nonce_size + TAG_SIZE:
+        return None
+    aad = datagram[:HEADER.size + nonce_size]
+    if nonce_size:
+        iv = datagram[HEADER.size:HEADER.size + nonce_size]
+    else:
+        iv = bytes([flags & FLAG_SERVER, 0, 0, 0]) + struct.pack('!II', connection_id, packet_number)
+    try:
+        plaintext = aead.decrypt(iv, datagram[HEADER.size + nonce_size:], aad)
+    except Exception:
+        return None
+    return packet_type, connection_id, packet_number, plaintext
+
+
+class Connection:
+    def __init__(self, server, address, connection_id, session_key, hello):
+        self.server = server
+        self.address = address
+        self.connection_id = connection_id
+        self.aead = AESGCM(session_key)
+        self.hello = hello
+        self.next_packet_number = 1
+        self.seen = set()
+        self.ack_largest = None
+        self.ack_bitmap = 0
+        self.next_message_id = [1, 1]
+        self.next_delivery_id = [1, 1]
+        self.pending = [{}, {}]
+        self.unacked = {}
+        self.audio_sequence = 1
+        self.audio_base = None
+        self.audio_highest = None
+        self.audio_received = 0
+        self.jitter = 0.0
+        self.last_arrival = None
+        self.last_timestamp = None
+        self.last_report = time.monotonic()
+        self.recording = []
+        self.listening = False
+        self.playback = []
+        self.next_playback = 0.0
+
+    def send_frames(self, frames):
+        packet_number = self.next_packet_number
+        self.next_packet_number += 1
+        self.server.send(seal(self.aead, PACKET_DATA, FLAG_SERVER, self.connection_id, packet_number, frames), self.address)
+        return packet_number
+
+    def send_message(self, stream, message):
+        data = json.dumps(message).encode()
+        message_id = self.next_message_id[stream]
+        self.next_message_id[stream] += 1
+        parts = [data[i:i + MAX_FRAGMENT] for i in range(0, len(data), MAX_FRAGMENT)] or [b'']
+        print(f'>> [{stream}] {data.decode()}')
+        for index, part in enumerate(parts):
+            frames = struct.pack('!BBIBBH', FRAME_STREAM, stream, message_id, index, len(parts), len(part)) + part
+            packet_number = self.send_frames(frames)
+            self.unacked[packet_number] = (frames, time.monotonic())
+
+    def send_ack(self):
+        bitmap = (self.ack_bitmap >> 1) & 0xFFFFFFFF
+        self.send_frames(struct.pack('!BIIH', FRAME_ACK, self.ack_largest, bitmap, 0))
+
+    def record_ack(self, packet_number):
+        if self.ack_largest is None or packet_number > self.ack_largest:
+            shift = 0 if self.ack_largest is None else packet_number - self.ack_largest
+            self.ack_bitmap = ((self.ack_bitmap << shift) | 1) & ((1 << 64) - 1)
+            self.ack_largest = packet_number
+        elif self.ack_largest - packet_number < 64:
+            self.ack_bitmap |= 1 << (self.ack_largest - packet_number)
+
+    def receive(self, packet_number, plaintext):
+        if packet_number in self.seen:
+            return
+        self.seen.add(packet_number)
+        ack_eliciting = False
+        pos = 0
+        while pos < len(plaintext):
+            frame_type = plaintext[pos]
+            pos += 1
+            if frame_type == FRAME_AUDIO:
+                sequence, timestamp, length = struct.unpack_from('!IIH', plaintext, pos)
+                pos += 10
+                self.receive_audio(sequence, timestamp, plaintext[pos:pos + length])
+                pos += length
+            elif frame_type == FRAME_STREAM:
+                stream, message_id, index, count, length = struct.unpack_from('!BIBBH', plaintext, pos)
+                pos += 9
+                self.receive_fragment(stream, message_id, index, count, plaintext[pos:pos + length])
+                pos += length
+                ack_eliciting = True
+            elif frame_type == FRAME_ACK:
+                largest, bitmap, _ = struct.unpack_from('!IIH', plaintext, pos)
+                pos += 10
+                for number in list(self.unacked):
+                    behind = largest - number
+                    if behind == 0 or (0 < behind <= 32 and bitmap & (1 << (behind - 1))):
+                        del self.unacked[number]
+            elif frame_type == FRAME_REPORT:
+                expected, lost, jitter = struct.unpack_from('!HHH', plaintext, pos)
+                pos += 6
+                print(f'<< report: expected {expected}, lost {lost}, jitter {jitter} ms')
+            elif frame_type == FRAME_PING:
+                ack_eliciting = True
+            elif frame_type == FRAME_CLOSE:
+                print(f'Connection {self.connection_id:08x} closed by the device')
+                self.server.connections.pop(self.connection_id, None)
+                return
+            else:
+                print(f'Unknown frame type {frame_type}')
+                return
+        if ack_eliciting:
+            self.record_ack(packet_number)
+            self.send_ack()
+
+    def receive_audio(self, sequence, timestamp, data):
+        now = time.monotonic() * 1000
+        if self.audio_base is None:
+            self.audio_base = self.audio_highest = sequence - 1
+        if sequence > self.audio_highest:
+            self.audio_highest = sequence
+        self.audio_received += 1
+        if self.last_arrival is not None:
+            transit = (now - self.last_arrival) - (timestamp - self.last_timestamp)
+            self.jitter += (abs(transit) - self.jitter) / 16
+        self.last_arrival = now
+        self.last_timestamp = timestamp
+        if self.listening:
+            self.recording.append(data)
+
+    def receive_fragment(self, stream, message_id, index, count, data):
+        if stream > STREAM_MCP or message_id < self.next_delivery_id[stream]:
+            return
+        parts = self.pending[stream].setdefault(message_id, [None] * count)
+        if index < len(parts):
+            parts[index] = data
+        while True:
+            parts = self.pending[stream].get(self.next_delivery_id[stream])
+            if parts is None or None in parts:
+                break
+            del self.pending[stream][self.next_delivery_id[stream]]
+            self.next_delivery_id[stream] += 1
+            self.handle_message(stream, json.loads(b''.join(parts)))
+
+    def handle_message(self, stream, message):
+        print(f'<< [{stream}] {json.dumps(message, ensure_ascii=False)}')
+        if stream == STREAM_MCP:
+            return
+        if message.get('type') != 'listen':
+            return
+        state = message.get('state')
+        if state == 'start':
+            self.listening = True
+            self.recording = []
+        elif state == 'stop' and self.listening:
+            self.listening = False
+            self.start_playback()
+        elif state == 'detect':
+            self.send_message(STREAM_CONTROL, {'type': 'stt', 'text': message.get('text', '')})
+
+    def start_playback(self):
+        self.send_message(STREAM_CONTROL, {'type': 'tts', 'state': 'start'})
+        self.playback = self.recording
+        self.recording = []
+        self.next_playback = time.monotonic()
+        if not self.playback:
+            self.send_message(STREAM_CONTROL, {'type': 'tts', 'state': 'stop'})
+
+    def poll(self):
+        now = time.monotonic()
+        for number, (frames, sent) in list(self.unacked.items()):
+            if now - sent >= RTO:
+                del self.unacked[number]
+                packet_number = self.send_frames(frames)
+                self.unacked[packet_number] = (frames, now)
+
+        # Echo the recorded audio at its original pace
+        while self.playback and now >= self.next_playback:
+            data = self.playback.pop(0)
+            timestamp = (self.audio_sequence * FRAME_DURATION_MS) & 0xFFFFFFFF
+            self.send_frames(struct.pack('!BIIH', FRAME_AUDIO, self.audio_sequence, timestamp, len(data)) + data)
+            self.audio_sequence += 1
+            self.next_playback += FRAME_DURATION_MS / 1000
+            if not self.playback:
+                self.send_message(STREAM_CONTROL, {'type': 'tts', 'state': 'stop'})
+
+        if now - self.last_report >= REPORT_INTERVAL:
+            self.last_report = now
+            if self.audio_received > 0:
+                expected = self.audio_highest - self.audio_base
+                lost = max(expected - self.audio_received, 0)
+                self.send_frames(struct.pack('!BHHH', FRAME_REPORT, min(expected, 0xFFFF), min(lost, 0xFFFF), int(self.jitter)))
+                self.audio_base = self.audio_highest
+                self.audio_received = 0
+
+
+class Server:
+    def __init__(self, host, port, key, loss):
+        self.key = key
+        self.loss = loss
+        self.hello_aead = AESGCM(key)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind((host, port))
+        self.sock.settimeout(0.01)
+        self.connections = {}
+
+    def send(self, datagram, address):
+        if random.random() >= self.loss:
+            self.sock.sendto(datagram, address)
+
+    def handle_hello(self, datagram, address):
+        opened = open_packet(self.hello_aead, datagram)
+        if opened is None or opened[0] != PACKET_HELLO or opened[2] != 0 or len(opened[3]) < 16:
+            return
+        _, connection_id, _, plaintext = opened
+        client_random = plaintext[:16]
+        hello = json.loads(plaintext[16:])
+        connection = self.connections.get(connection_id)
+        if connection is None:
+            server_random = os.urandom(16)
+            session_key = hmac.new(self.key, KEY_LABEL + client_random + server_random, hashlib.sha256).digest()[:16]
+            connection = Connection(self, address, connection_id, session_key, hello)
+            connection.server_random = server_random
+            self.connections[connection_id] = connection
+            print(f'Connection {connection_id:08x} from {address[0]}:{address[1]}: {json.dumps(hello, ensure_ascii=False)}')
+        # The device repeats its hello until it is answered, a lost answer is sent again unchanged
+        reply = {
+            'type': 'hello',
+            'transport': 'udp',
+            'session_id': f'{connection_id:08x}',
+            'audio_params': hello.get('audio_params', {}),
+        }
+        plaintext = connection.server_random + json.dumps(reply).encode()
+        self.send(seal(self.hello_aead, PACKET_HELLO_ACK, FLAG_SERVER, connection_id, 0, plaintext), address)
+
+    def run(self):
+        print(f'Listening on {self.sock.getsockname()[0]}:{self.sock.getsockname()[1]}, loss {self.loss:.0%}')
+        while True:
+            try:
+                datagram, address = self.sock.recvfrom(2048)
+                if random.random() < self.loss:
+                    datagram = None
+            except socket.timeout:
+                datagram = None
+            if datagram and len(datagram) >= HEADER.size:
+                packet_type, _, _, connection_id, _ = HEADER.unpack_from(datagram)
+                if packet_type == PACKET_HELLO:
+                    self.handle_hello(datagram, address)
+                elif packet_type == PACKET_DATA and connection_id in self.connections:
+                    connection = self.connections[connection_id]
+                    opened = open_packet(connection.aead, datagram)
+                    if opened is not None and opened[0] == PACKET_DATA:
+                        # The device may roam to a new address, the connection id identifies it
+                        connection.address = address
+                        connection.receive(opened[2], opened[3])
+            for connection in list(self.connections.values()):
+                connection.poll()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Local test server of the UDP transport')
+    parser.add_argument('--host', default='0.0.0.0')
+    parser.add_argument('--port', type=int, default=8884)
+    parser.add_argument('--key', required=True, help='32 hex digits, the udp.key of the OTA config')
+    parser.add_argument('--loss', type=float, default=0.0, help='share of datagrams to drop, e.g. 0.05')
+    args = parser.parse_args()
+
+    key = bytes.fromhex(args.key)
+    if len(key) != 16:
+        parser.error('the key must be 16 bytes')
+    Server(args.host, args.port, key, args.loss).run()
+
+
+if __name__ == '__main__':
+    main()